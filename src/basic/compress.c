@@ -1285,3 +1285,112 @@ int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes
         else
                 return -EPROTONOSUPPORT;
 }
+
+struct Decompressor {
+        Compression compression;
+#if HAVE_ZSTD
+        ZSTD_DCtx *dctx;
+#endif
+        void *buffer;
+        size_t buffer_size;
+};
+
+int decompressor_new(Decompressor **ret, Compression compression) {
+        assert(ret);
+
+#if HAVE_ZSTD
+        _cleanup_(decompressor_freep) Decompressor *d = NULL;
+        int r;
+
+        /* Only ZSTD is implemented for now, which is all that is needed by the current users. */
+        if (compression != COMPRESSION_ZSTD)
+                return -EPROTONOSUPPORT;
+
+        r = dlopen_zstd();
+        if (r < 0)
+                return r;
+
+        d = new(Decompressor, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (Decompressor) {
+                .compression = compression,
+                .buffer_size = sym_ZSTD_DStreamOutSize(),
+        };
+
+        d->dctx = sym_ZSTD_createDCtx();
+        if (!d->dctx)
+                return -ENOMEM;
+
+        d->buffer = malloc(d->buffer_size);
+        if (!d->buffer)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+Decompressor* decompressor_free(Decompressor *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        sym_ZSTD_freeDCtx(d->dctx);
+#endif
+        free(d->buffer);
+        return mfree(d);
+}
+
+int decompressor_push(
+                Decompressor *d,
+                const void *src,
+                size_t src_size,
+                DecompressorCallback callback,
+                void *userdata) {
+
+        assert(d);
+        assert(src || src_size == 0);
+        assert(callback);
+
+#if HAVE_ZSTD
+        ZSTD_inBuffer input = {
+                .src = src,
+                .size = src_size,
+        };
+
+        assert(d->compression == COMPRESSION_ZSTD);
+
+        /* The input may be one or more concatenated frames, split at arbitrary points. Keep going until
+         * all input is consumed and the decoder did not fill the whole output buffer, as it might still
+         * hold back decompressed data otherwise. */
+        for (;;) {
+                ZSTD_outBuffer output = {
+                        .dst = d->buffer,
+                        .size = d->buffer_size,
+                };
+                size_t k;
+                int r;
+
+                k = sym_ZSTD_decompressStream(d->dctx, &output, &input);
+                if (sym_ZSTD_isError(k)) {
+                        log_debug("ZSTD decoder failed: %s", sym_ZSTD_getErrorName(k));
+                        return zstd_ret_to_errno(k);
+                }
+
+                if (output.pos > 0) {
+                        r = callback(output.dst, output.pos, userdata);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (input.pos >= input.size && output.pos < output.size)
+                        return 0;
+        }
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
@@ -131,3 +131,14 @@ static inline const char* default_compression_extension(void) {
 }
 
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes);
+
+/* Incremental decompression of a stream that is pushed to us in arbitrarily sized pieces, e.g. an
+ * HTTP request body. Decompressed data is handed to the callback as soon as it is available. */
+typedef struct Decompressor Decompressor;
+typedef int (*DecompressorCallback)(const void *data, size_t size, void *userdata);
+
+int decompressor_new(Decompressor **ret, Compression compression);
+Decompressor* decompressor_free(Decompressor *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(Decompressor*, decompressor_free);
+
+int decompressor_push(Decompressor *d, const void *src, size_t src_size, DecompressorCallback callback, void *userdata);
@@ -5,6 +5,7 @@
 #include "hash-funcs.h"
 #include "path-util.h"
 #include "strv.h"
+#include "unaligned.h"
 
 void string_hash_func(const char *p, struct siphash *state) {
         siphash24_compress(p, strlen(p) + 1, state);
@@ -119,3 +120,134 @@ int devt_compare_func(const dev_t *a, const dev_t *b) {
 }
 
 DEFINE_HASH_OPS(devt_hash_ops, dev_t, devt_hash_func, devt_compare_func);
+
+/* The following follows wyhash (final version 4) by Wang Yi, which was released into the public domain. All
+ * mixing is done by multiplying two 64-bit values and folding the 128-bit result. */
+
+static const uint64_t wyhash_secret[4] = {
+        UINT64_C(0x2d358dccaa6c78a5),
+        UINT64_C(0x8bb84b93962eacc9),
+        UINT64_C(0x4b33a62ed433d4a3),
+        UINT64_C(0x4d5a2da51de1aa47),
+};
+
+static void wyhash_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+        unsigned __int128 r = (unsigned __int128) *a * *b;
+
+        *a = (uint64_t) r;
+        *b = (uint64_t) (r >> 64);
+#else
+        uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b,
+                rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb,
+                t = rl + (rm0 << 32), lo;
+        unsigned carry = t < rl;
+
+        lo = t + (rm1 << 32);
+        carry += lo < t;
+
+        *a = lo;
+        *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static uint64_t wyhash_mix(uint64_t a, uint64_t b) {
+        wyhash_mum(&a, &b);
+        return a ^ b;
+}
+
+uint64_t hash_bytes_trusted(const void *p, size_t n, uint64_t seed) {
+        const uint8_t *q = ASSERT_PTR(p);
+        uint64_t a, b;
+
+        seed ^= wyhash_mix(seed ^ wyhash_secret[0], wyhash_secret[1]);
+
+        if (n <= 16) {
+                if (n >= 4) {
+                        /* Two possibly overlapping 32-bit reads from each end cover everything */
+                        size_t k = (n >> 3) << 2;
+
+                        a = (uint64_t) unaligned_read_ne32(q) << 32 | unaligned_read_ne32(q + k);
+                        b = (uint64_t) unaligned_read_ne32(q + n - 4) << 32 | unaligned_read_ne32(q + n - 4 - k);
+                } else if (n > 0) {
+                        a = (uint64_t) q[0] << 16 | (uint64_t) q[n >> 1] << 8 | q[n - 1];
+                        b = 0;
+                } else
+                        a = b = 0;
+        } else {
+                size_t i = n;
+
+                if (i > 48) {
+                        uint64_t seed1 = seed, seed2 = seed;
+
+                        do {
+                                seed = wyhash_mix(unaligned_read_ne64(q) ^ wyhash_secret[1], unaligned_read_ne64(q + 8) ^ seed);
+                                seed1 = wyhash_mix(unaligned_read_ne64(q + 16) ^ wyhash_secret[2], unaligned_read_ne64(q + 24) ^ seed1);
+                                seed2 = wyhash_mix(unaligned_read_ne64(q + 32) ^ wyhash_secret[3], unaligned_read_ne64(q + 40) ^ seed2);
+                                q += 48;
+                                i -= 48;
+                        } while (i > 48);
+
+                        seed ^= seed1 ^ seed2;
+                }
+
+                for (; i > 16; q += 16, i -= 16)
+                        seed = wyhash_mix(unaligned_read_ne64(q) ^ wyhash_secret[1], unaligned_read_ne64(q + 8) ^ seed);
+
+                /* The last 16 bytes, which may overlap with what we already consumed */
+                a = unaligned_read_ne64(q + i - 16);
+                b = unaligned_read_ne64(q + i - 8);
+        }
+
+        a ^= wyhash_secret[1];
+        b ^= seed;
+        wyhash_mum(&a, &b);
+
+        return wyhash_mix(a ^ wyhash_secret[0] ^ n, b ^ wyhash_secret[1]);
+}
+
+uint64_t hash_uint64_trusted(uint64_t v, uint64_t seed) {
+        uint64_t a = v ^ wyhash_secret[0], b = seed ^ wyhash_secret[1];
+
+        wyhash_mum(&a, &b);
+
+        return wyhash_mix(a ^ wyhash_secret[0], b ^ wyhash_secret[1]);
+}
+
+uint64_t string_hash_func_trusted(const char *p, uint64_t seed) {
+        return hash_bytes_trusted(p, strlen(p), seed);
+}
+
+const struct hash_ops string_hash_ops_trusted = {
+        .hash = (hash_func_t) string_hash_func,
+        .hash_trusted = (trusted_hash_func_t) string_hash_func_trusted,
+        .compare = (compare_func_t) string_compare_func,
+};
+
+const struct hash_ops string_hash_ops_trusted_free_free = {
+        .hash = (hash_func_t) string_hash_func,
+        .hash_trusted = (trusted_hash_func_t) string_hash_func_trusted,
+        .compare = (compare_func_t) string_compare_func,
+        .free_key = free,
+        .free_value = free,
+};
+
+uint64_t trivial_hash_func_trusted(const void *p, uint64_t seed) {
+        return hash_uint64_trusted((uint64_t) (uintptr_t) p, seed);
+}
+
+const struct hash_ops trivial_hash_ops_trusted = {
+        .hash = trivial_hash_func,
+        .hash_trusted = trivial_hash_func_trusted,
+        .compare = trivial_compare_func,
+};
+
+uint64_t uint64_hash_func_trusted(const uint64_t *p, uint64_t seed) {
+        return hash_uint64_trusted(*p, seed);
+}
+
+const struct hash_ops uint64_hash_ops_trusted = {
+        .hash = (hash_func_t) uint64_hash_func,
+        .hash_trusted = (trusted_hash_func_t) uint64_hash_func_trusted,
+        .compare = (compare_func_t) uint64_compare_func,
+};
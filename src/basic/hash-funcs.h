@@ -6,6 +6,7 @@
 #include "siphash24.h"
 
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
+typedef uint64_t (*trusted_hash_func_t)(const void *p, uint64_t seed);
 typedef int (*compare_func_t)(const void *a, const void *b);
 
 struct hash_ops {
@@ -13,6 +14,7 @@ struct hash_ops {
         compare_func_t compare;
         free_func_t free_key;
         free_func_t free_value;
+        trusted_hash_func_t hash_trusted; /* if set, used instead of 'hash', see below */
 };
 
 #define _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func, free_key_func, free_value_func, scope) \
@@ -109,3 +111,20 @@ void devt_hash_func(const dev_t *p, struct siphash *state);
 
 int devt_compare_func(const dev_t *a, const dev_t *b) _pure_;
 extern const struct hash_ops devt_hash_ops;
+
+/* Hash functions for tables whose keys can never be chosen by an untrusted party, for example pointers to our
+ * own objects or identifiers we assign ourselves. They are modelled after wyhash and are a lot cheaper than
+ * SipHash for short keys, but make no attempt to resist hash flooding. Hence, do not use them for anything
+ * that is derived from client requests, file contents or network data. */
+uint64_t hash_bytes_trusted(const void *p, size_t n, uint64_t seed) _pure_;
+uint64_t hash_uint64_trusted(uint64_t v, uint64_t seed) _pure_;
+
+uint64_t string_hash_func_trusted(const char *p, uint64_t seed) _pure_;
+extern const struct hash_ops string_hash_ops_trusted;
+extern const struct hash_ops string_hash_ops_trusted_free_free;
+
+uint64_t trivial_hash_func_trusted(const void *p, uint64_t seed) _pure_;
+extern const struct hash_ops trivial_hash_ops_trusted;
+
+uint64_t uint64_hash_func_trusted(const uint64_t *p, uint64_t seed) _pure_;
+extern const struct hash_ops uint64_hash_ops_trusted;
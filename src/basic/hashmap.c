@@ -24,6 +24,7 @@
 #include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unaligned.h"
 
 #if ENABLE_DEBUG_HASHMAP
 #include "list.h"
@@ -295,8 +296,8 @@ void hashmap_trim_pools(void) {
         if (r != 1)
                 return (void) log_debug("Not cleaning up memory pools, running in multi-threaded process.");
 
-        mempool_trim(&hashmap_pool);
-        mempool_trim(&ordered_hashmap_pool);
+        /* This covers all pools, not only the ones backing hashmaps */
+        mempool_trim_all();
 }
 
 #if HAVE_VALGRIND_VALGRIND_H
@@ -345,11 +346,15 @@ static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (h->hash_ops->hash_trusted)
+                hash = h->hash_ops->hash_trusted(p, unaligned_read_ne64(hash_key(h)));
+        else {
+                siphash24_init(&state, hash_key(h));
 
-        h->hash_ops->hash(p, &state);
+                h->hash_ops->hash(p, &state);
 
-        hash = siphash24_finalize(&state);
+                hash = siphash24_finalize(&state);
+        }
 
         return (unsigned) (hash % n_buckets(h));
 }
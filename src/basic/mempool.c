@@ -7,6 +7,7 @@
 #include "macro.h"
 #include "memory-util.h"
 #include "mempool.h"
+#include "string-util.h"
 
 struct pool {
         struct pool *next;
@@ -14,6 +15,9 @@ struct pool {
         size_t n_used;
 };
 
+/* Like the pools themselves, only ever touched from the main thread */
+static struct mempool *mempools = NULL;
+
 static void* pool_ptr(struct pool *p) {
         return ((uint8_t*) ASSERT_PTR(p)) + ALIGN(sizeof(struct pool));
 }
@@ -33,6 +37,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
 
                 t = mp->freelist;
                 mp->freelist = *(void**) mp->freelist;
+                mp->n_used++;
                 return t;
         }
 
@@ -55,9 +60,16 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 p->n_used = 0;
 
                 mp->first_pool = p;
+
+                if (!mp->registered) {
+                        mp->next = mempools;
+                        mempools = mp;
+                        mp->registered = true;
+                }
         }
 
         i = mp->first_pool->n_used++;
+        mp->n_used++;
 
         return (uint8_t*) pool_ptr(mp->first_pool) + i*mp->tile_size;
 }
@@ -80,6 +92,9 @@ void* mempool_free_tile(struct mempool *mp, void *p) {
         *(void**) p = mp->freelist;
         mp->freelist = p;
 
+        assert(mp->n_used > 0);
+        mp->n_used--;
+
         return NULL;
 }
 
@@ -171,5 +186,30 @@ void mempool_trim(struct mempool *mp) {
                 }
         }
 
-        log_debug("Trimmed %s from memory pool %p. (%s left)", FORMAT_BYTES(trimmed), mp, FORMAT_BYTES(left));
+        log_debug("Trimmed %s from memory pool %s. (%s left)", FORMAT_BYTES(trimmed), strna(mp->name), FORMAT_BYTES(left));
+}
+
+void mempool_trim_all(void) {
+        for (struct mempool *mp = mempools; mp; mp = mp->next)
+                mempool_trim(mp);
+}
+
+void mempool_info(FILE *f) {
+        assert(f);
+
+        /* Meant to be appended to the output of malloc_info(). That is a single XML document, hence write
+         * one XML comment per pool, which may follow the root element without making the document
+         * invalid. */
+
+        for (struct mempool *mp = mempools; mp; mp = mp->next) {
+                size_t n_pools = 0, n_tiles = 0;
+
+                for (struct pool *p = mp->first_pool; p; p = p->next) {
+                        n_pools++;
+                        n_tiles += p->n_tiles;
+                }
+
+                fprintf(f, "<!-- mempool name=%s tile_size=%zu pools=%zu tiles=%zu used=%zu bytes=%zu -->\n",
+                        strna(mp->name), mp->tile_size, n_pools, n_tiles, mp->n_used, n_tiles * mp->tile_size);
+        }
 }
@@ -3,14 +3,23 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 struct pool;
 
 struct mempool {
+        const char *name;
         struct pool *first_pool;
         void *freelist;
         size_t tile_size;
         size_t at_least;
+
+        size_t n_used; /* tiles currently handed out */
+
+        /* All pools that ever allocated memory are linked up, so that they can be trimmed and inspected
+         * together */
+        struct mempool *next;
+        bool registered;
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
@@ -19,6 +28,7 @@ void* mempool_free_tile(struct mempool *mp, void *p);
 
 #define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
 static struct mempool pool_name = { \
+        .name = STRINGIFY(pool_name), \
         .tile_size = sizeof(tile_type), \
         .at_least = alloc_at_least, \
 }
@@ -26,3 +36,6 @@ static struct mempool pool_name = { \
 __attribute__((weak)) bool mempool_enabled(void);
 
 void mempool_trim(struct mempool *mp);
+void mempool_trim_all(void);
+
+void mempool_info(FILE *f);
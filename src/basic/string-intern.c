@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "missing_threads.h"
+#include "set.h"
+#include "string-intern.h"
+
+typedef struct InternedString {
+        unsigned n_ref;
+        char s[];
+} InternedString;
+
+/* Keyed by the string itself, so that looking up any copy finds the interned one */
+static thread_local Set *interned_strings = NULL;
+
+static InternedString* interned_string_from_string(const char *s) {
+        InternedString *i;
+
+        assert(s);
+
+        i = (InternedString*) (s - offsetof(InternedString, s));
+        assert(i->n_ref > 0);
+
+        return i;
+}
+
+const char* string_intern(const char *s) {
+        _cleanup_free_ InternedString *i = NULL;
+        const char *e;
+        size_t l;
+
+        assert(s);
+
+        e = set_get(interned_strings, s);
+        if (e)
+                return string_intern_ref(e);
+
+        l = strlen(s);
+        i = malloc(offsetof(InternedString, s) + l + 1);
+        if (!i)
+                return NULL;
+
+        i->n_ref = 1;
+        memcpy(i->s, s, l + 1);
+
+        if (set_ensure_put(&interned_strings, &string_hash_ops, i->s) < 0)
+                return NULL;
+
+        return TAKE_PTR(i)->s;
+}
+
+const char* string_intern_ref(const char *s) {
+        InternedString *i;
+
+        if (!s)
+                return NULL;
+
+        i = interned_string_from_string(s);
+        assert(i->n_ref < UINT_MAX);
+        i->n_ref++;
+
+        return s;
+}
+
+const char* string_intern_unref(const char *s) {
+        InternedString *i;
+
+        if (!s)
+                return NULL;
+
+        i = interned_string_from_string(s);
+        if (--i->n_ref > 0)
+                return NULL;
+
+        assert_se(set_remove(interned_strings, s) == s);
+        if (set_isempty(interned_strings))
+                interned_strings = set_free(interned_strings);
+
+        free(i);
+        return NULL;
+}
+
+int string_intern_replace(const char **p, const char *s) {
+        const char *t;
+
+        /* Like free_and_strdup(), but for interned strings */
+
+        assert(p);
+
+        if (s) {
+                t = string_intern(s);
+                if (!t)
+                        return -ENOMEM;
+        } else
+                t = NULL;
+
+        if (t == *p) {
+                string_intern_unref(t);
+                return 0;
+        }
+
+        string_intern_unref(*p);
+        *p = t;
+        return 1;
+}
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "macro.h"
+
+/* A table of reference counted strings: interning the same string twice returns the same pointer, hence
+ * interned strings may be compared by pointer. This is useful for strings that many objects carry around
+ * identically, such as the fragment path shared by all instances of a template unit.
+ *
+ * The table is per thread. Interned strings must be released with string_intern_unref(), on the thread
+ * that interned them. */
+
+const char* string_intern(const char *s);
+const char* string_intern_ref(const char *s);
+const char* string_intern_unref(const char *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(const char*, string_intern_unref);
+
+int string_intern_replace(const char **p, const char *s);
@@ -25,6 +25,7 @@
 #include "service.h"
 #include "signal-util.h"
 #include "special.h"
+#include "string-intern.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -2185,8 +2186,26 @@ static int bus_unit_set_transient_property(
         /* Handles settings when transient units are created. This settings cannot be altered anymore after
          * the unit has been created. */
 
-        if (streq(name, "SourcePath"))
-                return bus_set_transient_path(u, name, &u->source_path, message, flags, error);
+        if (streq(name, "SourcePath")) {
+                const char *v;
+
+                r = sd_bus_message_read(message, "s", &v);
+                if (r < 0)
+                        return r;
+
+                if (!isempty(v) && !path_is_absolute(v))
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid %s setting: %s", name, v);
+
+                if (!UNIT_WRITE_FLAGS_NOOP(flags)) {
+                        r = string_intern_replace(&u->source_path, empty_to_null(v));
+                        if (r < 0)
+                                return r;
+
+                        unit_write_settingf(u, flags|UNIT_ESCAPE_SPECIFIERS, name, "%s=%s", name, strempty(v));
+                }
+
+                return 1;
+        }
 
         if (streq(name, "StopWhenUnneeded"))
                 return bus_set_transient_bool(u, name, &u->stop_when_unneeded, message, flags, error);
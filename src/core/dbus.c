@@ -702,6 +702,13 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        /* systemctl and friends may receive large replies from us, let's offer passing those as memfd */
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable memfd body passing for new connection: %m");
+                return 0;
+        }
+
         r = sd_bus_set_sender(bus, "org.freedesktop.systemd1");
         if (r < 0) {
                 log_warning_errno(r, "Failed to set direct connection sender: %m");
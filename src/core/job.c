@@ -16,7 +16,9 @@
 #include "job.h"
 #include "log.h"
 #include "macro.h"
+#include "mempool.h"
 #include "parse-util.h"
+#include "process-util.h"
 #include "serialize.h"
 #include "set.h"
 #include "sort-util.h"
@@ -29,6 +31,11 @@
 #include "unit.h"
 #include "virt.h"
 
+/* Every transaction allocates and drops a job and a couple of dependency links for each unit it pulls in, keep
+ * these in pools rather than going through malloc() for each of them. */
+DEFINE_MEMPOOL(job_pool, Job, 64);
+DEFINE_MEMPOOL(job_dependency_pool, JobDependency, 64);
+
 Job* job_new_raw(Unit *unit) {
         Job *j;
 
@@ -36,7 +43,9 @@ Job* job_new_raw(Unit *unit) {
 
         assert(unit);
 
-        j = new(Job, 1);
+        bool use_pool = mempool_enabled && mempool_enabled();  /* mempool_enabled is a weak symbol */
+
+        j = use_pool ? mempool_alloc_tile(&job_pool) : malloc(sizeof(Job));
         if (!j)
                 return NULL;
 
@@ -44,6 +53,7 @@ Job* job_new_raw(Unit *unit) {
                 .manager = unit->manager,
                 .unit = unit,
                 .type = _JOB_TYPE_INVALID,
+                .from_pool = use_pool,
         };
 
         return j;
@@ -129,6 +139,11 @@ Job* job_free(Job *j) {
 
         activation_details_unref(j->activation_details);
 
+        if (j->from_pool) {
+                assert_se(is_main_thread());
+                return mempool_free_tile(&job_pool, j);
+        }
+
         return mfree(j);
 }
 
@@ -301,7 +316,7 @@ int job_install_deserialized(Job *j) {
         if (j->id <= 0)
                 j->id = manager_get_new_job_id(j->manager);
 
-        r = hashmap_ensure_put(&j->manager->jobs, NULL, UINT32_TO_PTR(j->id), j);
+        r = hashmap_ensure_put(&j->manager->jobs, &trivial_hash_ops_trusted, UINT32_TO_PTR(j->id), j);
         if (r == -EEXIST)
                 return log_unit_debug_errno(j->unit, r, "Job ID %" PRIu32 " already used, cannot deserialize job.", j->id);
         if (r < 0)
@@ -329,14 +344,19 @@ JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool
          * this means the 'anchor' job (i.e. the one the user
          * explicitly asked for) is the requester. */
 
-        l = new0(JobDependency, 1);
+        bool use_pool = mempool_enabled && mempool_enabled();
+
+        l = use_pool ? mempool_alloc_tile(&job_dependency_pool) : malloc(sizeof(JobDependency));
         if (!l)
                 return NULL;
 
-        l->subject = subject;
-        l->object = object;
-        l->matters = matters;
-        l->conflicts = conflicts;
+        *l = (JobDependency) {
+                .subject = subject,
+                .object = object,
+                .matters = matters,
+                .conflicts = conflicts,
+                .from_pool = use_pool,
+        };
 
         if (subject)
                 LIST_PREPEND(subject, subject->subject_list, l);
@@ -354,7 +374,11 @@ void job_dependency_free(JobDependency *l) {
 
         LIST_REMOVE(object, l->object->object_list, l);
 
-        free(l);
+        if (l->from_pool) {
+                assert_se(is_main_thread());
+                mempool_free_tile(&job_dependency_pool, l);
+        } else
+                free(l);
 }
 
 void job_dump(Job *j, FILE *f, const char *prefix) {
@@ -112,6 +112,7 @@ struct JobDependency {
 
         bool matters:1;
         bool conflicts:1;
+        bool from_pool:1;
 };
 
 struct Job {
@@ -164,6 +165,7 @@ struct Job {
         bool irreversible:1;
         bool in_gc_queue:1;
         bool ref_by_private_bus:1;
+        bool from_pool:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
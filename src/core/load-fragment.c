@@ -65,6 +65,7 @@
 #include "socket-netlink.h"
 #include "specifier.h"
 #include "stat-util.h"
+#include "string-intern.h"
 #include "string-util.h"
 #include "strv.h"
 #include "syslog-util.h"
@@ -459,6 +460,38 @@ int config_parse_unit_path_printf(
         return config_parse_path(unit, filename, line, section, section_line, lvalue, ltype, k, data, userdata);
 }
 
+int config_parse_unit_source_path(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        _cleanup_free_ char *k = NULL;
+        const char **s = ASSERT_PTR(data);
+        int r;
+
+        assert(rvalue);
+
+        /* Like config_parse_unit_path_printf(), but the result is interned, see unit.h */
+
+        r = config_parse_unit_path_printf(unit, filename, line, section, section_line, lvalue, ltype, rvalue, &k, userdata);
+        if (r < 0)
+                return r;
+        if (!k && !isempty(rvalue)) /* invalid and ignored */
+                return 0;
+
+        if (string_intern_replace(s, k) < 0)
+                return log_oom();
+
+        return 0;
+}
+
 int config_parse_colon_separated_paths(
                 const char *unit,
                 const char *filename,
@@ -6213,7 +6246,7 @@ int unit_load_fragment(Unit *u) {
                 if (fstat(fileno(f), &st) < 0)
                         return -errno;
 
-                r = free_and_strdup(&u->fragment_path, fragment);
+                r = string_intern_replace(&u->fragment_path, fragment);
                 if (r < 0)
                         return r;
 
@@ -6300,6 +6333,7 @@ void unit_dump_config_items(FILE *f) {
                 { config_parse_string,                "STRING" },
                 { config_parse_path,                  "PATH" },
                 { config_parse_unit_path_printf,      "PATH" },
+                { config_parse_unit_source_path,      "PATH" },
                 { config_parse_colon_separated_paths, "PATH" },
                 { config_parse_strv,                  "STRING [...]" },
                 { config_parse_exec_nice,             "NICE" },
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include "build.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
@@ -85,8 +86,10 @@ void manager_dump(Manager *m, FILE *f, char **patterns, const char *prefix) {
 
         /* If no pattern is provided, dump the full manager state including the manager version, features and
          * so on. Otherwise limit the dump to the units/jobs matching the specified patterns. */
-        if (!patterns)
+        if (!patterns) {
                 manager_dump_header(m, f, prefix);
+                event_dump_statistics(m->event, f, prefix);
+        }
 
         manager_dump_units(m, f, patterns, prefix);
         manager_dump_jobs(m, f, patterns, prefix);
@@ -84,6 +84,7 @@
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "string-intern.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -2399,7 +2400,7 @@ int manager_load_unit_prepare(
         }
 
         if (path) {
-                r = free_and_strdup(&unit->fragment_path, path);
+                r = string_intern_replace(&unit->fragment_path, path);
                 if (r < 0)
                         return r;
         }
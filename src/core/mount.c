@@ -29,6 +29,7 @@
 #include "serialize.h"
 #include "special.h"
 #include "stat-util.h"
+#include "string-intern.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -1714,7 +1715,7 @@ static int mount_setup_new_unit(
 
         mnt = ASSERT_PTR(MOUNT(u));
 
-        r = free_and_strdup(&u->source_path, "/proc/self/mountinfo");
+        r = string_intern_replace(&u->source_path, "/proc/self/mountinfo");
         if (r < 0)
                 return r;
 
@@ -436,6 +436,9 @@ static ServiceFDStore* service_fd_store_unlink(ServiceFDStore *fs) {
 DEFINE_TRIVIAL_CLEANUP_FUNC(ServiceFDStore*, service_fd_store_unlink);
 
 static void service_release_fd_store(Service *s) {
+        _cleanup_free_ int *fds = NULL;
+        size_t n_fds = 0;
+
         assert(s);
 
         if (!s->fd_store)
@@ -443,9 +446,19 @@ static void service_release_fd_store(Service *s) {
 
         log_unit_debug(UNIT(s), "Releasing all stored fds");
 
+        /* The fd store might contain a lot of fds. Let's close them all from a single asynchronous helper,
+         * instead of forking off one per fd. If we can't allocate the array, they'll be closed one by one
+         * below. */
+        fds = new(int, s->n_fd_store);
+        if (fds)
+                LIST_FOREACH(fd_store, fs, s->fd_store)
+                        fds[n_fds++] = TAKE_FD(fs->fd);
+
         while (s->fd_store)
                 service_fd_store_unlink(s->fd_store);
 
+        asynchronous_close_many(fds, n_fds);
+
         assert(s->n_fd_store == 0);
 }
 
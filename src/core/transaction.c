@@ -647,7 +647,7 @@ static int transaction_apply(
                 assert(!j->transaction_prev);
                 assert(!j->transaction_next);
 
-                r = hashmap_ensure_put(&m->jobs, NULL, UINT32_TO_PTR(j->id), j);
+                r = hashmap_ensure_put(&m->jobs, &trivial_hash_ops_trusted, UINT32_TO_PTR(j->id), j);
                 if (r < 0)
                         goto rollback;
         }
@@ -1233,7 +1233,7 @@ Transaction *transaction_new(bool irreversible) {
         if (!tr)
                 return NULL;
 
-        tr->jobs = hashmap_new(NULL);
+        tr->jobs = hashmap_new(&trivial_hash_ops_trusted);
         if (!tr->jobs)
                 return mfree(tr);
 
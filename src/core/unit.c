@@ -54,6 +54,7 @@
 #include "specifier.h"
 #include "stat-util.h"
 #include "stdio-util.h"
+#include "string-intern.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -847,8 +848,8 @@ Unit* unit_free(Unit *u) {
 
         free(u->description);
         strv_free(u->documentation);
-        free(u->fragment_path);
-        free(u->source_path);
+        string_intern_unref(u->fragment_path);
+        string_intern_unref(u->source_path);
         strv_free(u->dropin_paths);
         free(u->instance);
 
@@ -928,7 +929,7 @@ static int unit_reserve_dependencies(Unit *u, Unit *other) {
 
         n_reserve = MIN(hashmap_size(other->dependencies), LESS_BY((size_t) _UNIT_DEPENDENCY_MAX, hashmap_size(u->dependencies)));
         if (n_reserve > 0) {
-                r = hashmap_ensure_allocated(&u->dependencies, NULL);
+                r = hashmap_ensure_allocated(&u->dependencies, &trivial_hash_ops_trusted);
                 if (r < 0)
                         return r;
 
@@ -3019,11 +3020,13 @@ static Hashmap *unit_get_dependency_hashmap_per_type(Unit *u, UnitDependency d)
         if (!deps) {
                 _cleanup_hashmap_free_ Hashmap *h = NULL;
 
-                h = hashmap_new(NULL);
+                /* Keyed by dependency type, and by the Unit objects themselves, hence by nothing a client
+                 * could pick */
+                h = hashmap_new(&trivial_hash_ops_trusted);
                 if (!h)
                         return NULL;
 
-                if (hashmap_ensure_put(&u->dependencies, NULL, UNIT_DEPENDENCY_TO_PTR(d), h) < 0)
+                if (hashmap_ensure_put(&u->dependencies, &trivial_hash_ops_trusted, UNIT_DEPENDENCY_TO_PTR(d), h) < 0)
                         return NULL;
 
                 deps = TAKE_PTR(h);
@@ -4664,9 +4667,10 @@ int unit_make_transient(Unit *u) {
         safe_fclose(u->transient_file);
         u->transient_file = f;
 
-        free_and_replace(u->fragment_path, path);
+        if (string_intern_replace(&u->fragment_path, path) < 0)
+                return -ENOMEM;
 
-        u->source_path = mfree(u->source_path);
+        u->source_path = string_intern_unref(u->source_path);
         u->dropin_paths = strv_free(u->dropin_paths);
         u->fragment_mtime = u->source_mtime = u->dropin_mtime = 0;
 
@@ -242,8 +242,10 @@ typedef struct Unit {
          * for processes) */
         char *access_selinux_context;
 
-        char *fragment_path; /* if loaded from a config file this is the primary path to it */
-        char *source_path; /* if converted, the source file */
+        /* Both interned, as all instances of a template unit, or all units made by the same generator, share
+         * them */
+        const char *fragment_path; /* if loaded from a config file this is the primary path to it */
+        const char *source_path; /* if converted, the source file */
         char **dropin_paths;
 
         usec_t fragment_not_found_timestamp_hash;
@@ -11,6 +11,7 @@
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
+#include "sd-event.h"
 #include "sd-journal.h"
 
 #include "alloc-util.h"
@@ -24,6 +25,7 @@
 #include "hostname-util.h"
 #include "journal-internal.h"
 #include "journal-remote.h"
+#include "list.h"
 #include "log.h"
 #include "logs-show.h"
 #include "main-func.h"
@@ -32,13 +34,17 @@
 #include "os-util.h"
 #include "parse-util.h"
 #include "pretty-print.h"
+#include "pthread-util.h"
 #include "sigbus.h"
-#include "signal-util.h"
 #include "time-util.h"
 #include "tmpfile-util.h"
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* Requests that don't follow the journal walk it synchronously, which may take a while. Spread connections
+ * over a few threads, so that one slow request doesn't hold up everybody else. */
+#define WORKER_THREADS 8U
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
@@ -52,7 +58,10 @@ STATIC_DESTRUCTOR_REGISTER(arg_cert_pem, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_trust_pem, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_file, strv_freep);
 
-typedef struct RequestMeta {
+typedef struct RequestMeta RequestMeta;
+
+struct RequestMeta {
+        struct MHD_Connection *connection;
         sd_journal *journal;
 
         OutputMode mode;
@@ -70,7 +79,23 @@ typedef struct RequestMeta {
 
         bool follow;
         bool discrete;
-} RequestMeta;
+
+        /* The followers_generation seen when we last checked for new entries, see below. */
+        uint64_t generation;
+        bool suspended;
+        LIST_FIELDS(RequestMeta, followers);
+};
+
+/* Connections following the journal are suspended while there are no new entries, instead of blocking a
+ * thread each in sd_journal_wait(). A single journal instance owned by the main thread watches for changes
+ * and resumes all of them at once. Whenever it notices a change it bumps the generation counter, so that a
+ * connection can tell whether it needs to look again before suspending itself. The list is accessed from
+ * both the main thread and the μhttpd threads, hence it is protected by a mutex. */
+static pthread_mutex_t followers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(RequestMeta, followers) = NULL;
+static uint64_t followers_generation = 0;
+static uint64_t followers_invalidated_generation = 0;
+static bool followers_stopping = false;
 
 static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_SHORT] = "text/plain",
@@ -80,21 +105,38 @@ static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_EXPORT] = "application/vnd.fdo.journal",
 };
 
-static RequestMeta *request_meta(void **connection_cls) {
+static RequestMeta *request_meta(struct MHD_Connection *connection, void **connection_cls) {
         RequestMeta *m;
 
+        assert(connection);
         assert(connection_cls);
         if (*connection_cls)
                 return *connection_cls;
 
-        m = new0(RequestMeta, 1);
+        m = new(RequestMeta, 1);
         if (!m)
                 return NULL;
 
+        *m = (RequestMeta) {
+                .connection = connection,
+        };
+
         *connection_cls = m;
         return m;
 }
 
+static void follower_remove(RequestMeta *m) {
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&followers_mutex);
+
+        assert(m);
+
+        /* The main thread clears 'suspended' when it wakes up the followers, hence check it under the lock */
+        if (m->suspended) {
+                LIST_REMOVE(followers, followers, m);
+                m->suspended = false;
+        }
+}
+
 static void request_meta_free(
                 void *cls,
                 struct MHD_Connection *connection,
@@ -106,6 +148,8 @@ static void request_meta_free(
         if (!m)
                 return;
 
+        follower_remove(m);
+
         sd_journal_close(m->journal);
 
         safe_fclose(m->tmp);
@@ -114,18 +158,18 @@ static void request_meta_free(
         free(m);
 }
 
-static int open_journal(RequestMeta *m) {
-        assert(m);
+static int open_journal(sd_journal **j) {
+        assert(j);
 
-        if (m->journal)
+        if (*j)
                 return 0;
 
         if (arg_directory)
-                return sd_journal_open_directory(&m->journal, arg_directory, arg_journal_type);
+                return sd_journal_open_directory(j, arg_directory, arg_journal_type);
         else if (arg_file)
-                return sd_journal_open_files(&m->journal, (const char**) arg_file, 0);
+                return sd_journal_open_files(j, (const char**) arg_file, 0);
         else
-                return sd_journal_open(&m->journal, (arg_merge ? 0 : SD_JOURNAL_LOCAL_ONLY) | arg_journal_type);
+                return sd_journal_open(j, (arg_merge ? 0 : SD_JOURNAL_LOCAL_ONLY) | arg_journal_type);
 }
 
 static int request_meta_ensure_tmp(RequestMeta *m) {
@@ -148,6 +192,125 @@ static int request_meta_ensure_tmp(RequestMeta *m) {
         return 0;
 }
 
+static int request_parse_arguments(RequestMeta *m, struct MHD_Connection *connection);
+
+static int request_seek(RequestMeta *m) {
+        assert(m);
+
+        if (m->cursor)
+                return sd_journal_seek_cursor(m->journal, m->cursor);
+        if (m->since_set)
+                return sd_journal_seek_realtime_usec(m->journal, m->since);
+        if (m->n_skip >= 0)
+                return sd_journal_seek_head(m->journal);
+        if (m->until_set)
+                return sd_journal_seek_realtime_usec(m->journal, m->until);
+
+        return sd_journal_seek_tail(m->journal);
+}
+
+static int request_reopen_journal(RequestMeta *m) {
+        _cleanup_free_ char *cursor = NULL;
+        int r;
+
+        assert(m);
+
+        /* Journal files were added or removed, e.g. because of rotation. Our journal instance does not
+         * watch the journal directories itself, hence reopen it and continue after the last entry sent. */
+
+        r = sd_journal_get_cursor(m->journal, &cursor);
+        if (r < 0 && r != -EADDRNOTAVAIL)
+                return r;
+
+        sd_journal_close(m->journal);
+        m->journal = NULL;
+
+        r = open_journal(&m->journal);
+        if (r < 0)
+                return r;
+
+        r = request_parse_arguments(m, m->connection);
+        if (r < 0)
+                return r;
+
+        if (!cursor)
+                return request_seek(m);
+
+        r = sd_journal_seek_cursor(m->journal, cursor);
+        if (r < 0)
+                return r;
+
+        /* Position on the entry we sent last, or right before the one following it if it is gone. */
+        r = sd_journal_next(m->journal);
+        if (r <= 0)
+                return r;
+
+        r = sd_journal_test_cursor(m->journal, cursor);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                r = sd_journal_previous(m->journal);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int request_follow_wait(RequestMeta *m) {
+        bool reopen;
+
+        assert(m);
+        assert(!m->suspended);
+
+        /* Returns 0 if the connection got suspended until the journal changes, > 0 if it changed since we
+         * last checked and we should just look again. */
+
+        {
+                _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&followers_mutex);
+
+                if (followers_stopping)
+                        return -ESHUTDOWN;
+
+                if (m->generation == followers_generation) {
+                        MHD_suspend_connection(m->connection);
+                        m->suspended = true;
+                        LIST_PREPEND(followers, followers, m);
+                        return 0;
+                }
+
+                reopen = m->generation < followers_invalidated_generation;
+                m->generation = followers_generation;
+        }
+
+        if (reopen) {
+                int r;
+
+                r = request_reopen_journal(m);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
+static void followers_wake_up(bool invalidated, bool stopping) {
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&followers_mutex);
+        RequestMeta *m;
+
+        followers_generation++;
+        if (invalidated)
+                followers_invalidated_generation = followers_generation;
+        if (stopping)
+                followers_stopping = true;
+
+        while ((m = followers)) {
+                LIST_REMOVE(followers, followers, m);
+                m->suspended = false;
+                MHD_resume_connection(m->connection);
+        }
+}
+
 static ssize_t request_reader_entries(
                 void *cls,
                 uint64_t pos,
@@ -189,13 +352,16 @@ static ssize_t request_reader_entries(
                 } else if (r == 0) {
 
                         if (m->follow) {
-                                r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
+                                r = request_follow_wait(m);
+                                if (r == -ESHUTDOWN)
+                                        return MHD_CONTENT_READER_END_OF_STREAM;
                                 if (r < 0) {
                                         log_error_errno(r, "Couldn't wait for journal event: %m");
                                         return MHD_CONTENT_READER_END_WITH_ERROR;
                                 }
-                                if (r == SD_JOURNAL_NOP)
-                                        break;
+                                if (r == 0)
+                                        /* Suspended, we'll be called again once there are new entries. */
+                                        return 0;
 
                                 continue;
                         }
@@ -558,7 +724,7 @@ static int request_handler_entries(
 
         assert(connection);
 
-        r = open_journal(m);
+        r = open_journal(&m->journal);
         if (r < 0)
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "Failed to open journal: %m");
 
@@ -579,20 +745,16 @@ static int request_handler_entries(
                 m->n_entries_set = true;
         }
 
-        if (m->cursor)
-                r = sd_journal_seek_cursor(m->journal, m->cursor);
-        else if (m->since_set)
-                r = sd_journal_seek_realtime_usec(m->journal, m->since);
-        else if (m->n_skip >= 0)
-                r = sd_journal_seek_head(m->journal);
-        else if (m->until_set && m->n_skip < 0)
-                r = sd_journal_seek_realtime_usec(m->journal, m->until);
-        else if (m->n_skip < 0)
-                r = sd_journal_seek_tail(m->journal);
-
+        r = request_seek(m);
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
+        if (m->follow) {
+                _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&followers_mutex);
+
+                m->generation = followers_generation;
+        }
+
         response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
@@ -710,7 +872,7 @@ static int request_handler_fields(
 
         assert(connection);
 
-        r = open_journal(m);
+        r = open_journal(&m->journal);
         if (r < 0)
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "Failed to open journal: %m");
 
@@ -824,7 +986,7 @@ static int request_handler_machine(
 
         assert(connection);
 
-        r = open_journal(m);
+        r = open_journal(&m->journal);
         if (r < 0)
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "Failed to open journal: %m");
 
@@ -905,7 +1067,7 @@ static mhd_result request_handler(
                 return mhd_respond(connection, MHD_HTTP_NOT_ACCEPTABLE, "Unsupported method.");
 
         if (!*connection_cls) {
-                if (!request_meta(connection_cls))
+                if (!request_meta(connection, connection_cls))
                         return respond_oom(connection);
                 return MHD_YES;
         }
@@ -1093,24 +1255,90 @@ static int parse_argv(int argc, char *argv[]) {
         return 1;
 }
 
+static void process_journal_change(sd_journal *j, bool force) {
+        int r;
+
+        assert(j);
+
+        r = sd_journal_process(j);
+        if (r < 0)
+                /* Wake everybody up anyway, so that they reopen their journals and don't get stuck. */
+                log_warning_errno(r, "Failed to process journal changes, ignoring: %m");
+        else if (r == SD_JOURNAL_NOP && !force)
+                return;
+
+        followers_wake_up(/* invalidated= */ r < 0 || r == SD_JOURNAL_INVALIDATE, /* stopping= */ false);
+}
+
+static int dispatch_journal_io(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        process_journal_change(ASSERT_PTR(userdata), /* force= */ false);
+        return 0;
+}
+
+static int dispatch_journal_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        sd_journal *j = ASSERT_PTR(userdata);
+        int r;
+
+        /* Inotify is not reliable for this journal (e.g. it's on a network file system), hence have
+         * followers look for new entries on their own every now and then. */
+
+        process_journal_change(j, /* force= */ true);
+
+        r = sd_event_source_set_time_relative(s, JOURNAL_WAIT_TIMEOUT);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int setup_journal_watch(sd_event *event, sd_journal **ret) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        int fd, r;
+
+        assert(event);
+        assert(ret);
+
+        r = open_journal(&j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open journal: %m");
+
+        fd = sd_journal_get_fd(j);
+        if (fd < 0)
+                return log_error_errno(fd, "Failed to get journal fd: %m");
+
+        r = sd_event_add_io(event, NULL, fd, sd_journal_get_events(j), dispatch_journal_io, j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch journal: %m");
+
+        if (!sd_journal_reliable_fd(j)) {
+                r = sd_event_add_time_relative(event, NULL, CLOCK_MONOTONIC, JOURNAL_WAIT_TIMEOUT, 0,
+                                               dispatch_journal_timer, j);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add journal timer: %m");
+        }
+
+        *ret = TAKE_PTR(j);
+        return 0;
+}
+
 static int run(int argc, char *argv[]) {
         _cleanup_(MHD_stop_daemonp) struct MHD_Daemon *d = NULL;
-        static const struct sigaction sigterm = {
-                .sa_handler = nop_signal_handler,
-                .sa_flags = SA_RESTART,
-        };
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
         struct MHD_OptionItem opts[] = {
                 { MHD_OPTION_EXTERNAL_LOGGER,
                   (intptr_t) microhttpd_logger, NULL },
                 { MHD_OPTION_NOTIFY_COMPLETED,
                   (intptr_t) request_meta_free, NULL },
+                { MHD_OPTION_THREAD_POOL_SIZE,
+                  WORKER_THREADS, NULL },
                 { MHD_OPTION_END, 0, NULL },
                 { MHD_OPTION_END, 0, NULL },
                 { MHD_OPTION_END, 0, NULL },
                 { MHD_OPTION_END, 0, NULL },
                 { MHD_OPTION_END, 0, NULL },
         };
-        int opts_pos = 2;
+        int opts_pos = 3;
 
         /* We force MHD_USE_ITC here, in order to make sure
          * libmicrohttpd doesn't use shutdown() on our listening
@@ -1118,14 +1346,20 @@ static int run(int argc, char *argv[]) {
          *
          * https://lists.gnu.org/archive/html/libmicrohttpd/2015-09/msg00014.html
          * https://github.com/systemd/systemd/pull/1286
-         */
+         *
+         * MHD_USE_ITC is also what makes MHD_resume_connection() safe
+         * to call from our main thread. Connections are served by a
+         * small pool of epoll-driven threads, connections following
+         * the journal are suspended while idle, so that they don't
+         * occupy any of them. */
 
         int flags =
                 MHD_USE_DEBUG |
                 MHD_USE_DUAL_STACK |
                 MHD_USE_ITC |
-                MHD_USE_POLL_INTERNAL_THREAD |
-                MHD_USE_THREAD_PER_CONNECTION;
+                MHD_USE_INTERNAL_POLLING_THREAD |
+                MHD_USE_EPOLL |
+                MHD_ALLOW_SUSPEND_RESUME;
         int r, n;
 
         log_setup();
@@ -1135,7 +1369,19 @@ static int run(int argc, char *argv[]) {
                 return r;
 
         sigbus_install();
-        assert_se(sigaction(SIGTERM, &sigterm, NULL) >= 0);
+
+        /* Set this up before starting the daemon, so that its thread inherits the blocked signals. */
+        r = sd_event_default(&event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        r = sd_event_set_signal_exit(event, true);
+        if (r < 0)
+                return log_error_errno(r, "Failed to install SIGINT/SIGTERM handlers: %m");
+
+        r = setup_journal_watch(event, &j);
+        if (r < 0)
+                return r;
 
         r = setup_gnutls_logger(NULL);
         if (r < 0)
@@ -1174,7 +1420,12 @@ static int run(int argc, char *argv[]) {
         if (!d)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Failed to start daemon!");
 
-        pause();
+        r = sd_event_loop(event);
+        if (r < 0)
+                return log_error_errno(r, "Event loop failed: %m");
+
+        /* Let suspended followers finish their responses, so that the daemon can be stopped. */
+        followers_wake_up(/* invalidated= */ false, /* stopping= */ true);
 
         return 0;
 }
@@ -6,6 +6,7 @@
 #include "sd-daemon.h"
 
 #include "build.h"
+#include "compress.h"
 #include "conf-parser.h"
 #include "constants.h"
 #include "daemon-util.h"
@@ -155,7 +156,8 @@ static int dispatch_http_event(sd_event_source *event,
                                uint32_t revents,
                                void *userdata);
 
-static int request_meta(void **connection_cls, int fd, char *hostname) {
+static int request_meta(void **connection_cls, int fd, char *hostname, Compression compression) {
+        _cleanup_(decompressor_freep) Decompressor *decompressor = NULL;
         RemoteSource *source;
         Writer *writer;
         int r;
@@ -164,6 +166,13 @@ static int request_meta(void **connection_cls, int fd, char *hostname) {
         if (*connection_cls)
                 return 0;
 
+        if (compression != COMPRESSION_NONE) {
+                r = decompressor_new(&decompressor, compression);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to set up %s decompression for source %s: %m",
+                                                 compression_to_string(compression), hostname);
+        }
+
         r = journal_remote_get_writer(journal_remote_server_global, hostname, &writer);
         if (r < 0)
                 return log_warning_errno(r, "Failed to get writer for source %s: %m",
@@ -175,6 +184,8 @@ static int request_meta(void **connection_cls, int fd, char *hostname) {
                 return log_oom();
         }
 
+        source->decompressor = TAKE_PTR(decompressor);
+
         log_debug("Added RemoteSource as connection metadata %p", source);
 
         *connection_cls = source;
@@ -197,37 +208,48 @@ static void request_meta_free(void *cls,
         }
 }
 
-static int process_http_upload(
+static const char* upload_accept_encoding(void) {
+#if HAVE_ZSTD
+        if (dlopen_zstd() >= 0)
+                return "zstd";
+#endif
+        return "identity";
+}
+
+static mhd_result respond_with_accept_encoding(
                 struct MHD_Connection *connection,
-                const char *upload_data,
-                size_t *upload_data_size,
-                RemoteSource *source) {
+                unsigned code,
+                const char *message) {
 
-        bool finished = false;
-        size_t remaining;
-        int r;
+        _cleanup_(MHD_destroy_responsep) struct MHD_Response *response = NULL;
 
-        assert(source);
+        assert(connection);
+        assert(message);
 
-        log_trace("%s: connection %p, %zu bytes",
-                  __func__, connection, *upload_data_size);
+        response = MHD_create_response_from_buffer(strlen(message), (char*) message, MHD_RESPMEM_PERSISTENT);
+        if (!response)
+                return MHD_NO;
 
-        if (*upload_data_size) {
-                log_trace("Received %zu bytes", *upload_data_size);
+        log_debug("Queueing response %u: %s", code, message);
+        if (MHD_add_response_header(response, "Content-Type", "text/plain") == MHD_NO)
+                return MHD_NO;
 
-                r = journal_importer_push_data(&source->importer,
-                                               upload_data, *upload_data_size);
-                if (r < 0)
-                        return mhd_respond_oom(connection);
+        /* Tell the uploader which Content-Encoding it may use for request bodies, see RFC 7694. */
+        if (MHD_add_response_header(response, "Accept-Encoding", upload_accept_encoding()) == MHD_NO)
+                return MHD_NO;
 
-                *upload_data_size = 0;
-        } else
-                finished = true;
+        return MHD_queue_response(connection, code, response);
+}
+
+static int process_http_upload_data(struct MHD_Connection *connection, RemoteSource *source) {
+        int r;
+
+        assert(source);
 
         for (;;) {
                 r = process_source(source, journal_remote_server_global->file_flags);
                 if (r == -EAGAIN)
-                        break;
+                        return 0;
                 if (r < 0) {
                         if (r == -ENOBUFS)
                                 log_warning_errno(r, "Entry is above the maximum of %u, aborting connection %p.",
@@ -238,9 +260,80 @@ static int process_http_upload(
                         else
                                 log_warning_errno(r, "Failed to process data, aborting connection %p: %m",
                                                   connection);
-                        return MHD_NO;
+                        return r;
                 }
         }
+}
+
+typedef struct DecompressedUpload {
+        struct MHD_Connection *connection;
+        RemoteSource *source;
+        bool failed;
+} DecompressedUpload;
+
+static int push_decompressed_upload_data(const void *data, size_t size, void *userdata) {
+        DecompressedUpload *u = ASSERT_PTR(userdata);
+        int r;
+
+        /* Process every decompressed piece right away, so that the importer buffer stays bounded by the
+         * size of a single entry no matter how well the data compresses. */
+        r = journal_importer_push_data(&u->source->importer, data, size);
+        if (r >= 0)
+                r = process_http_upload_data(u->connection, u->source);
+        if (r < 0)
+                u->failed = true;
+
+        return r;
+}
+
+static int process_http_upload(
+                struct MHD_Connection *connection,
+                const char *upload_data,
+                size_t *upload_data_size,
+                RemoteSource *source) {
+
+        bool finished = false;
+        size_t remaining;
+        int r;
+
+        assert(source);
+
+        log_trace("%s: connection %p, %zu bytes",
+                  __func__, connection, *upload_data_size);
+
+        if (*upload_data_size) {
+                log_trace("Received %zu bytes", *upload_data_size);
+
+                if (source->decompressor) {
+                        DecompressedUpload u = {
+                                .connection = connection,
+                                .source = source,
+                        };
+
+                        r = decompressor_push(source->decompressor,
+                                              upload_data, *upload_data_size,
+                                              push_decompressed_upload_data, &u);
+                        if (r < 0) {
+                                /* Errors from processing the decompressed data are logged already */
+                                if (!u.failed)
+                                        log_warning_errno(r, "Failed to decompress data, aborting connection %p: %m",
+                                                          connection);
+                                return MHD_NO;
+                        }
+                } else {
+                        r = journal_importer_push_data(&source->importer,
+                                                       upload_data, *upload_data_size);
+                        if (r < 0)
+                                return mhd_respond_oom(connection);
+                }
+
+                *upload_data_size = 0;
+        } else
+                finished = true;
+
+        r = process_http_upload_data(connection, source);
+        if (r < 0)
+                return MHD_NO;
 
         if (!finished)
                 return MHD_YES;
@@ -256,7 +349,7 @@ static int process_http_upload(
                                     remaining);
         }
 
-        return mhd_respond(connection, MHD_HTTP_ACCEPTED, "OK.");
+        return respond_with_accept_encoding(connection, MHD_HTTP_ACCEPTED, "OK.\n");
 };
 
 static mhd_result request_handler(
@@ -272,6 +365,7 @@ static mhd_result request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
+        Compression compression = COMPRESSION_NONE;
         bool chunked = false;
 
         assert(connection);
@@ -297,6 +391,15 @@ static mhd_result request_handler(
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
                                    "Content-Type: application/vnd.fdo.journal is required.");
 
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Encoding");
+        if (header && !strcaseeq(header, "identity")) {
+                if (!strcaseeq(header, "zstd") || !streq(upload_accept_encoding(), "zstd"))
+                        return respond_with_accept_encoding(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                                            "Unsupported Content-Encoding.\n");
+
+                compression = COMPRESSION_ZSTD;
+        }
+
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Transfer-Encoding");
         if (header) {
                 if (!strcaseeq(header, "chunked"))
@@ -355,7 +458,7 @@ static mhd_result request_handler(
 
         assert(hostname);
 
-        r = request_meta(connection_cls, fd, hostname);
+        r = request_meta(connection_cls, fd, hostname, compression);
         if (r == -ENOMEM)
                 return respond_oom(connection);
         else if (r < 0)
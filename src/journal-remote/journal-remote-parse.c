@@ -11,6 +11,7 @@ void source_free(RemoteSource *source) {
                 return;
 
         journal_importer_cleanup(&source->importer);
+        decompressor_free(source->decompressor);
 
         log_debug("Writer ref count %u", source->writer->n_ref);
         writer_unref(source->writer);
@@ -3,12 +3,16 @@
 
 #include "sd-event.h"
 
+#include "compress.h"
 #include "journal-importer.h"
 #include "journal-remote-write.h"
 
 typedef struct RemoteSource {
         JournalImporter importer;
 
+        /* Set if the data pushed into the importer is received compressed (Content-Encoding) */
+        Decompressor *decompressor;
+
         Writer *writer;
 
         sd_event_source *event;
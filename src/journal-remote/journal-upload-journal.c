@@ -6,6 +6,7 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "journal-upload.h"
 #include "log.h"
 #include "string-util.h"
@@ -264,6 +265,13 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
         while (j && filled < size * nmemb) {
                 if (u->entry_state == ENTRY_DONE) {
+                        if (u->batch_full) {
+                                /* End this request, so that the cursor is saved, and continue with a new
+                                 * one right away. */
+                                u->uploading = false;
+                                break;
+                        }
+
                         r = sd_journal_next(j);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to move to next entry in journal: %m");
@@ -298,6 +306,9 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
                 log_debug("Entry %zu (%s) has been uploaded.",
                           u->entries_sent, u->current_cursor);
+
+                if (u->batch_size > 0 && ++u->entries_in_batch >= u->batch_size)
+                        u->batch_full = true;
         }
 
         return filled;
@@ -321,6 +332,9 @@ static int process_journal_input(Uploader *u, int skip) {
         if (u->uploading)
                 return 0;
 
+        u->batch_full = false;
+        u->entries_in_batch = 0;
+
         r = sd_journal_next_skip(u->journal, skip);
         if (r < 0)
                 return log_error_errno(r, "Failed to skip to next entry: %m");
@@ -332,6 +346,16 @@ static int process_journal_input(Uploader *u, int skip) {
         return start_upload(u, journal_input_callback, u);
 }
 
+static int dispatch_batch_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        Uploader *u = ASSERT_PTR(userdata);
+
+        if (!u->journal)
+                return 0;
+
+        log_debug("Batch latency elapsed, uploading new entries.");
+        return process_journal_input(u, 1);
+}
+
 int check_journal_input(Uploader *u) {
         if (u->input_event) {
                 int r;
@@ -343,8 +367,22 @@ int check_journal_input(Uploader *u) {
                         return r;
                 }
 
-                if (r == SD_JOURNAL_NOP)
+                /* If the last request was cut short because the batch was full, there's more to send
+                 * even though the journal did not change. */
+                if (r == SD_JOURNAL_NOP && !u->batch_full)
+                        return 0;
+
+                /* Collect new entries for a while, to send them in one go instead of one request each. */
+                if (r != SD_JOURNAL_NOP && u->batch_latency_usec > 0 && !u->batch_full) {
+                        r = event_reset_time_relative(u->event, &u->batch_event, CLOCK_MONOTONIC,
+                                                      u->batch_latency_usec, 0,
+                                                      dispatch_batch_timer, u,
+                                                      SD_EVENT_PRIORITY_NORMAL, "upload-batch", /* force_reset = */ false);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to set up batch timer: %m");
+
                         return 0;
+                }
         }
 
         return process_journal_input(u, 1);
@@ -15,6 +15,7 @@
 #include "constants.h"
 #include "daemon-util.h"
 #include "env-file.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
@@ -58,6 +59,9 @@ static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
 static usec_t arg_network_timeout_usec = USEC_INFINITY;
+static int arg_compression = -1;
+static uint64_t arg_batch_size = 0;
+static usec_t arg_batch_latency_usec = 0;
 
 STATIC_DESTRUCTOR_REGISTER(arg_file, strv_freep);
 
@@ -99,6 +103,96 @@ static size_t output_callback(char *buf,
         return size * nmemb;
 }
 
+static bool zstd_available(void) {
+#if HAVE_ZSTD
+        return dlopen_zstd() >= 0;
+#else
+        return false;
+#endif
+}
+
+static size_t header_callback(char *buf,
+                              size_t size,
+                              size_t nmemb,
+                              void *userp) {
+        Uploader *u = ASSERT_PTR(userp);
+        _cleanup_free_ char *line = NULL;
+        const char *p;
+
+        /* The server lists the encodings it accepts for request bodies in its responses (RFC 7694). */
+        line = strndup(buf, size * nmemb);
+        if (!line)
+                return size * nmemb;
+
+        p = startswith_no_case(line, "Accept-Encoding:");
+        if (!p)
+                return size * nmemb;
+
+        for (;;) {
+                _cleanup_free_ char *word = NULL;
+                int r;
+
+                r = extract_first_word(&p, &word, ", \t\r\n", 0);
+                if (r <= 0)
+                        break;
+
+                /* Ignore any parameters, e.g. quality values */
+                word[strcspn(word, ";")] = '\0';
+                if (strcaseeq(word, "zstd"))
+                        u->server_accepts_zstd = true;
+        }
+
+        return size * nmemb;
+}
+
+static size_t upload_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
+        Uploader *u = ASSERT_PTR(userp);
+        size_t n, max, filled, compressed;
+        int r;
+
+        assert(u->input_callback);
+        assert(!size_multiply_overflow(size, nmemb));
+
+        n = size * nmemb;
+
+        if (u->compression == COMPRESSION_NONE) {
+                filled = u->input_callback(buf, size, nmemb, u->input_data);
+                if (!IN_SET(filled, CURL_READFUNC_ABORT, CURL_READFUNC_PAUSE)) {
+                        u->bytes_read += filled;
+                        u->bytes_sent += filled;
+                }
+                return filled;
+        }
+
+        /* Every chunk handed to curl is compressed as a separate frame, concatenated frames form a valid
+         * stream. Read only as much input as is guaranteed to fit after compression: zstd may expand
+         * incompressible data by 1/256 of its size plus a small per-frame overhead. */
+        max = n / 128 + 128 < n ? n - n / 128 - 128 : 0;
+        if (max == 0) {
+                log_error("Buffer space is too small to compress entry.");
+                return CURL_READFUNC_ABORT;
+        }
+
+        if (!GREEDY_REALLOC(u->compression_buffer, max)) {
+                log_oom();
+                return CURL_READFUNC_ABORT;
+        }
+
+        filled = u->input_callback(u->compression_buffer, 1, max, u->input_data);
+        if (filled == 0 || IN_SET(filled, CURL_READFUNC_ABORT, CURL_READFUNC_PAUSE))
+                return filled;
+
+        r = compress_blob(u->compression, u->compression_buffer, filled, buf, n, &compressed);
+        if (r < 0) {
+                log_error_errno(r, "Failed to compress %zu bytes of upload data: %m", filled);
+                return CURL_READFUNC_ABORT;
+        }
+
+        u->bytes_read += filled;
+        u->bytes_sent += compressed;
+        return compressed;
+}
+
 static int check_cursor_updating(Uploader *u) {
         _cleanup_free_ char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
@@ -185,7 +279,7 @@ int start_upload(Uploader *u,
         assert(u);
         assert(input_callback);
 
-        if (!u->header) {
+        if (!u->header || u->header_compression != u->compression) {
                 _cleanup_(curl_slist_free_allp) struct curl_slist *h = NULL;
                 struct curl_slist *l;
 
@@ -203,7 +297,18 @@ int start_upload(Uploader *u,
                         return log_oom();
                 h = l;
 
+                if (u->compression != COMPRESSION_NONE) {
+                        assert(u->compression == COMPRESSION_ZSTD);
+
+                        l = curl_slist_append(h, "Content-Encoding: zstd");
+                        if (!l)
+                                return log_oom();
+                        h = l;
+                }
+
+                curl_slist_free_all(u->header);
                 u->header = TAKE_PTR(h);
+                u->header_compression = u->compression;
         }
 
         if (!u->easy) {
@@ -234,15 +339,18 @@ int start_upload(Uploader *u,
                 easy_setopt(curl, CURLOPT_WRITEDATA, data,
                             LOG_ERR, return -EXFULL);
 
-                /* set where to read from */
-                easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
+                /* look for the encodings the server accepts */
+                easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback,
                             LOG_ERR, return -EXFULL);
 
-                easy_setopt(curl, CURLOPT_READDATA, data,
+                easy_setopt(curl, CURLOPT_HEADERDATA, u,
                             LOG_ERR, return -EXFULL);
 
-                /* use our special own mime type and chunked transfer */
-                easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
+                /* set where to read from, the data is compressed on the way if requested */
+                easy_setopt(curl, CURLOPT_READFUNCTION, upload_input_callback,
+                            LOG_ERR, return -EXFULL);
+
+                easy_setopt(curl, CURLOPT_READDATA, u,
                             LOG_ERR, return -EXFULL);
 
                 if (DEBUG_LOGGING)
@@ -279,6 +387,13 @@ int start_upload(Uploader *u,
                 u->answer = mfree(u->answer);
         }
 
+        /* use our special own mime type and chunked transfer */
+        code = curl_easy_setopt(u->easy, CURLOPT_HTTPHEADER, u->header);
+        if (code)
+                return log_error_errno(SYNTHETIC_ERRNO(EXFULL),
+                                       "curl_easy_setopt CURLOPT_HTTPHEADER failed: %s",
+                                       curl_easy_strerror(code));
+
         /* upload to this place */
         code = curl_easy_setopt(u->easy, CURLOPT_URL, u->url);
         if (code)
@@ -286,6 +401,10 @@ int start_upload(Uploader *u,
                                        "curl_easy_setopt CURLOPT_URL failed: %s",
                                        curl_easy_strerror(code));
 
+        u->input_callback = input_callback;
+        u->input_data = data;
+        u->server_accepts_zstd = false;
+        u->bytes_read = u->bytes_sent = 0;
         u->uploading = true;
 
         return 0;
@@ -389,8 +508,16 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
 
         *u = (Uploader) {
                 .input = -1,
+                .compression = arg_compression > 0 ? COMPRESSION_ZSTD : COMPRESSION_NONE,
+                .negotiate_compression = arg_compression < 0,
+                .batch_size = arg_batch_size,
+                .batch_latency_usec = arg_batch_latency_usec,
         };
 
+        if (u->compression != COMPRESSION_NONE && !zstd_available())
+                return log_error_errno(SYNTHETIC_ERRNO(EOPNOTSUPP),
+                                       "Compression of uploads was requested, but zstd support is not available.");
+
         host = STARTSWITH_SET(url, "http://", "https://");
         if (!host) {
                 host = url;
@@ -435,12 +562,15 @@ static void destroy_uploader(Uploader *u) {
         curl_slist_free_all(u->header);
         free(u->answer);
 
+        free(u->compression_buffer);
+
         free(u->last_cursor);
         free(u->current_cursor);
 
         free(u->url);
 
         u->input_event = sd_event_source_unref(u->input_event);
+        u->batch_event = sd_event_source_unref(u->batch_event);
 
         close_fd_input(u);
         close_journal_input(u);
@@ -484,6 +614,19 @@ static int perform_upload(Uploader *u) {
                 log_debug("Upload finished successfully with code %ld: %s",
                           status, strna(u->answer));
 
+        if (u->compression != COMPRESSION_NONE)
+                log_debug("Uploaded %s compressed to %s.",
+                          FORMAT_BYTES(u->bytes_read), FORMAT_BYTES(u->bytes_sent));
+
+        if (u->negotiate_compression && u->compression == COMPRESSION_NONE && u->server_accepts_zstd) {
+                if (zstd_available()) {
+                        log_debug("Server accepts zstd compressed uploads, compressing further uploads.");
+                        u->compression = COMPRESSION_ZSTD;
+                }
+
+                u->negotiate_compression = false;
+        }
+
         free_and_replace(u->last_cursor, u->current_cursor);
 
         return update_cursor_state(u);
@@ -496,6 +639,9 @@ static int parse_config(void) {
                 { "Upload",  "ServerCertificateFile",  config_parse_path_or_ignore, 0,                        &arg_cert                 },
                 { "Upload",  "TrustedCertificateFile", config_parse_path_or_ignore, 0,                        &arg_trust                },
                 { "Upload",  "NetworkTimeoutSec",      config_parse_sec,            0,                        &arg_network_timeout_usec },
+                { "Upload",  "Compression",            config_parse_tristate,       0,                        &arg_compression          },
+                { "Upload",  "BatchSize",              config_parse_uint64,         0,                        &arg_batch_size           },
+                { "Upload",  "BatchLatencySec",        config_parse_sec,            0,                        &arg_batch_latency_usec   },
                 {}
         };
 
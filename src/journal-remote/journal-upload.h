@@ -7,6 +7,7 @@
 #include "sd-event.h"
 #include "sd-journal.h"
 
+#include "compress.h"
 #include "time-util.h"
 
 typedef enum {
@@ -36,6 +37,23 @@ typedef struct Uploader {
         sd_event_source *input_event;
         uint64_t timeout;
 
+        size_t (*input_callback)(void *ptr, size_t size, size_t nmemb, void *userdata);
+        void *input_data;
+
+        /* compression of the request body */
+        Compression compression;
+        Compression header_compression;
+        bool negotiate_compression;
+        bool server_accepts_zstd;
+        void *compression_buffer;
+
+        /* batching */
+        uint64_t batch_size;
+        usec_t batch_latency_usec;
+        size_t entries_in_batch;
+        bool batch_full;
+        sd_event_source *batch_event;
+
         /* fd stuff */
         int input;
 
@@ -50,6 +68,7 @@ typedef struct Uploader {
         const char *state_file;
 
         size_t entries_sent;
+        uint64_t bytes_read, bytes_sent;
         char *last_cursor, *current_cursor;
         usec_t watchdog_timestamp;
         usec_t watchdog_usec;
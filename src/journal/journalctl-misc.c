@@ -166,6 +166,54 @@ int action_list_boots(void) {
         return 0;
 }
 
+static int list_field_counts(sd_journal *j) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        JournalUniqueCount *counts = NULL;
+        size_t n_counts = 0, prefix;
+        int r;
+
+        CLEANUP_ARRAY(counts, n_counts, journal_unique_count_array_free);
+
+        assert(j);
+
+        r = journal_get_unique_counts(j, arg_field, arg_lines >= 0 ? (size_t) arg_lines : SIZE_MAX, &counts, &n_counts);
+        if (r < 0)
+                return log_error_errno(r, "Failed to count unique data objects: %m");
+
+        table = table_new("entries", "value");
+        if (!table)
+                return log_oom();
+
+        if (arg_full)
+                table_set_width(table, 0);
+
+        /* The values are returned as "FIELD=value" */
+        prefix = strlen(arg_field) + 1;
+
+        FOREACH_ARRAY(c, counts, n_counts) {
+                _cleanup_free_ char *v = NULL;
+
+                assert(c->data.iov_len >= prefix);
+
+                v = strndup((const char*) c->data.iov_base + prefix, c->data.iov_len - prefix);
+                if (!v)
+                        return log_oom();
+
+                r = table_add_many(table,
+                                   TABLE_UINT64, c->n_entries,
+                                   TABLE_SET_ALIGN_PERCENT, 100,
+                                   TABLE_STRING, v);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        r = table_print_with_pager(table, arg_json_format_flags, arg_pager_flags, !arg_quiet);
+        if (r < 0)
+                return table_log_print_error(r);
+
+        return 0;
+}
+
 int action_list_fields(void) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         int r, n_shown = 0;
@@ -184,6 +232,9 @@ int action_list_fields(void) {
         if (r < 0)
                 return log_error_errno(r, "Failed to unset data size threshold: %m");
 
+        if (arg_field_counts)
+                return list_field_counts(j);
+
         r = sd_journal_query_unique(j, arg_field);
         if (r < 0)
                 return log_error_errno(r, "Failed to query unique data objects: %m");
@@ -73,6 +73,7 @@ char **arg_exclude_identifier = NULL;
 char **arg_system_units = NULL;
 char **arg_user_units = NULL;
 const char *arg_field = NULL;
+bool arg_field_counts = false;
 bool arg_catalog = false;
 bool arg_reverse = false;
 int arg_journal_type = 0;
@@ -266,6 +267,8 @@ static int help(void) {
                "     --version               Show package version\n"
                "  -N --fields                List all field names currently used\n"
                "  -F --field=FIELD           List all values that a specified field takes\n"
+               "     --counts                With -F, also show approximate number of entries\n"
+               "                               per value, most frequent first\n"
                "     --list-boots            Show terse information about recorded boots\n"
                "     --list-namespaces       Show list of journal namespaces\n"
                "     --disk-usage            Show total disk usage of all journal files\n"
@@ -339,6 +342,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_OUTPUT_FIELDS,
                 ARG_NAMESPACE,
                 ARG_LIST_NAMESPACES,
+                ARG_COUNTS,
         };
 
         static const struct option options[] = {
@@ -391,6 +395,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "user-unit",            required_argument, NULL, ARG_USER_UNIT            },
                 { "field",                required_argument, NULL, 'F'                      },
                 { "fields",               no_argument,       NULL, 'N'                      },
+                { "counts",               no_argument,       NULL, ARG_COUNTS               },
                 { "catalog",              no_argument,       NULL, 'x'                      },
                 { "list-catalog",         no_argument,       NULL, ARG_LIST_CATALOG         },
                 { "dump-catalog",         no_argument,       NULL, ARG_DUMP_CATALOG         },
@@ -836,6 +841,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_field = optarg;
                         break;
 
+                case ARG_COUNTS:
+                        arg_field_counts = true;
+                        break;
+
                 case 'N':
                         arg_action = ACTION_LIST_FIELD_NAMES;
                         break;
@@ -961,6 +970,10 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "--lines=+N is unsupported when --reverse or --follow is specified.");
 
+        if (arg_field_counts && arg_action != ACTION_LIST_FIELDS)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "--counts is only supported together with -F/--field=.");
+
         if (!IN_SET(arg_action, ACTION_SHOW, ACTION_DUMP_CATALOG, ACTION_LIST_CATALOG) && optind < argc)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Extraneous arguments starting with '%s'",
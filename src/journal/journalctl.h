@@ -77,6 +77,7 @@ extern char **arg_exclude_identifier;
 extern char **arg_system_units;
 extern char **arg_user_units;
 extern const char *arg_field;
+extern bool arg_field_counts;
 extern bool arg_catalog;
 extern bool arg_reverse;
 extern int arg_journal_type;
@@ -98,11 +98,13 @@ static int server_refresh_idle_timer(Server *s);
 static int server_determine_path_usage(
                 Server *s,
                 const char *path,
+                JournalVacuumCatalog *catalog,
                 uint64_t *ret_used,
                 uint64_t *ret_free) {
 
         _cleanup_closedir_ DIR *d = NULL;
         struct statvfs ss;
+        int r;
 
         assert(s);
         assert(path);
@@ -119,6 +121,15 @@ static int server_determine_path_usage(
                                                 "Failed to fstatvfs(%s): %m", path);
 
         *ret_free = ss.f_bsize * ss.f_bavail;
+
+        if (catalog) {
+                r = journal_vacuum_catalog_usage(catalog, ret_used);
+                if (r >= 0)
+                        return 0;
+
+                log_debug_errno(r, "Failed to determine usage of %s from vacuum catalog, scanning directory: %m", path);
+        }
+
         *ret_used = 0;
         FOREACH_DIRENT_ALL(de, d, break) {
                 struct stat st;
@@ -162,7 +173,7 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && usec_add(space->timestamp, RECHECK_SPACE_USEC) > ts)
                 return 0;
 
-        r = server_determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+        r = server_determine_path_usage(s, storage->path, storage->vacuum_catalog, &vfs_used, &vfs_avail);
         if (r < 0)
                 return r;
 
@@ -792,6 +803,55 @@ static void server_sync(Server *s, bool wait) {
         s->sync_scheduled = false;
 }
 
+static void server_storage_close_vacuum_catalog(JournalStorage *storage) {
+        assert(storage);
+
+        storage->vacuum_catalog_event_source = sd_event_source_disable_unref(storage->vacuum_catalog_event_source);
+        storage->vacuum_catalog = journal_vacuum_catalog_free(storage->vacuum_catalog);
+}
+
+static int dispatch_vacuum_catalog(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        JournalStorage *storage = ASSERT_PTR(userdata);
+        int r;
+
+        /* Drain the inotify queue regularly, so that it doesn't overflow between vacuuming runs. */
+
+        r = journal_vacuum_catalog_process(storage->vacuum_catalog);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to process changes to %s, dropping vacuum catalog: %m", storage->path);
+                server_storage_close_vacuum_catalog(storage);
+        }
+
+        return 0;
+}
+
+static int server_storage_open_vacuum_catalog(Server *s, JournalStorage *storage) {
+        _cleanup_(journal_vacuum_catalog_freep) JournalVacuumCatalog *c = NULL;
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        if (storage->vacuum_catalog)
+                return 0;
+
+        r = journal_vacuum_catalog_new(&c, storage->path, /* watch= */ true);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_io(s->event, &storage->vacuum_catalog_event_source,
+                            journal_vacuum_catalog_get_fd(c), EPOLLIN, dispatch_vacuum_catalog, storage);
+        if (r < 0)
+                return r;
+
+        /* Run after processing of log messages, which may rotate and hence trigger events of interest */
+        (void) sd_event_source_set_priority(storage->vacuum_catalog_event_source, SD_EVENT_PRIORITY_NORMAL+10);
+        (void) sd_event_source_set_description(storage->vacuum_catalog_event_source, "vacuum-catalog");
+
+        storage->vacuum_catalog = TAKE_PTR(c);
+        return 0;
+}
+
 static void server_do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
 
         int r;
@@ -799,14 +859,28 @@ static void server_do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         assert(s);
         assert(storage);
 
+        r = server_storage_open_vacuum_catalog(s, storage);
+        if (r < 0 && r != -ENOENT)
+                log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                            "Failed to set up vacuum catalog for %s, scanning directory instead: %m",
+                                            storage->path);
+
         (void) cache_space_refresh(s, storage);
 
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        if (storage->vacuum_catalog) {
+                r = journal_vacuum_catalog_vacuum(storage->vacuum_catalog, storage->space.limit,
+                                                  storage->metrics.n_max_files, s->max_retention_usec,
+                                                  &s->oldest_file_usec,
+                                                  JOURNAL_VACUUM_ASYNC | (verbose ? JOURNAL_VACUUM_VERBOSE : 0));
+                if (r == -ENOENT)
+                        server_storage_close_vacuum_catalog(storage);
+        } else
+                r = journal_directory_vacuum(storage->path, storage->space.limit,
+                                             storage->metrics.n_max_files, s->max_retention_usec,
+                                             &s->oldest_file_usec, verbose);
         if (r < 0 && r != -ENOENT)
                 log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
                                             "Failed to vacuum %s, ignoring: %m", storage->path);
@@ -1424,6 +1498,8 @@ finish:
 
         /* Remove the runtime directory if the all entries are successfully flushed to /var/. */
         if (r >= 0) {
+                server_storage_close_vacuum_catalog(&s->runtime_storage);
+
                 r = rm_rf(s->runtime_storage.path, REMOVE_ROOT);
                 if (r < 0)
                         log_debug_errno(r, "Failed to remove runtime journal directory %s, ignoring: %m", s->runtime_storage.path);
@@ -1482,6 +1558,9 @@ static int server_relinquish_var(Server *s) {
         ordered_hashmap_clear_with_destructor(s->user_journals, journal_file_offline_close);
         set_clear_with_destructor(s->deferred_closes, journal_file_offline_close);
 
+        /* Don't keep watching /var/ either */
+        server_storage_close_vacuum_catalog(&s->system_storage);
+
         server_refresh_idle_timer(s);
         return 0;
 }
@@ -2900,6 +2979,9 @@ Server* server_free(Server *s) {
 
         sd_varlink_server_unref(s->varlink_server);
 
+        server_storage_close_vacuum_catalog(&s->runtime_storage);
+        server_storage_close_vacuum_catalog(&s->system_storage);
+
         sd_event_source_unref(s->syslog_event_source);
         sd_event_source_unref(s->native_event_source);
         sd_event_source_unref(s->stdout_event_source);
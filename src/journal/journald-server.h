@@ -13,6 +13,7 @@ typedef struct Server Server;
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
 #include "journald-stream.h"
 #include "list.h"
@@ -59,6 +60,10 @@ typedef struct JournalStorage {
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        /* Archived files in 'path', maintained via inotify so that vacuuming needn't rescan the directory */
+        JournalVacuumCatalog *vacuum_catalog;
+        sd_event_source *vacuum_catalog_event_source;
 } JournalStorage;
 
 /* This structure will be kept in $RUNTIME_DIRECTORY/seqnum and is mapped by journald, and is used to
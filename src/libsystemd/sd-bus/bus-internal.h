@@ -103,6 +103,9 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* Introspection XML for the members of this vtable, generated on first use */
+        char *introspection;
+
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
@@ -191,6 +194,7 @@ struct sd_bus {
         int message_endian;
 
         bool can_fds;
+        bool can_memfd;
         bool bus_client;
         bool ucred_valid;
         bool is_server;
@@ -213,6 +217,7 @@ struct sd_bus {
         bool attach_timestamp;
         bool connected_signal;
         bool close_on_exit;
+        bool cache_properties;
 
         RuntimeScope runtime_scope;
 
@@ -242,6 +247,7 @@ struct sd_bus {
         Hashmap *nodes;
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
+        OrderedHashmap *property_cache;
 
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
@@ -261,7 +267,7 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
-        struct iovec auth_iovec[3];
+        struct iovec auth_iovec[4];
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
@@ -201,22 +201,12 @@ static int introspect_write_arguments(struct introspect *i, const char *signatur
         }
 }
 
-int introspect_write_interface(
-                struct introspect *i,
-                const char *interface_name,
-                const sd_bus_vtable *v) {
-
+static int introspect_write_members(struct introspect *i, const sd_bus_vtable *v) {
         const sd_bus_vtable *vtable = ASSERT_PTR(v);
         const char *names = "";
-        int r;
 
         assert(i);
         assert(i->m.f);
-        assert(interface_name);
-
-        r = set_interface_name(i, interface_name);
-        if (r < 0)
-                return r;
 
         for (; v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v)) {
 
@@ -269,6 +259,65 @@ int introspect_write_interface(
         return 0;
 }
 
+int introspect_write_interface(
+                struct introspect *i,
+                const char *interface_name,
+                const sd_bus_vtable *v) {
+
+        int r;
+
+        assert(i);
+        assert(i->m.f);
+        assert(interface_name);
+
+        r = set_interface_name(i, interface_name);
+        if (r < 0)
+                return r;
+
+        return introspect_write_members(i, v);
+}
+
+int introspect_write_interface_cached(
+                struct introspect *i,
+                const char *interface_name,
+                const sd_bus_vtable *v,
+                char **cache) {
+
+        int r;
+
+        assert(i);
+        assert(i->m.f);
+        assert(interface_name);
+        assert(cache);
+
+        /* The XML for the members of a vtable only depends on the vtable itself and on whether the bus is
+         * trusted, hence generate it once and reuse it for every object the vtable is registered for. */
+
+        if (!*cache) {
+                _cleanup_(introspect_done) struct introspect t = {
+                        .trusted = i->trusted,
+                };
+
+                if (!memstream_init(&t.m))
+                        return -ENOMEM;
+
+                r = introspect_write_members(&t, v);
+                if (r < 0)
+                        return r;
+
+                r = memstream_finalize(&t.m, cache, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        r = set_interface_name(i, interface_name);
+        if (r < 0)
+                return r;
+
+        fputs(*cache, i->m.f);
+        return 0;
+}
+
 int introspect_finish(struct introspect *i, char **ret) {
         assert(i);
         assert(i->m.f);
@@ -53,9 +53,15 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
-                (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
+        /* All value nodes are kept in a hash table. For the prefix matches we look up every prefix of the
+         * tested string that ends at a label boundary, see bus_match_run_prefixes(). */
+        return BUS_MATCH_IS_COMPARE(t);
+}
+
+static bool BUS_MATCH_IS_PREFIX(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_PATH_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -116,123 +122,154 @@ static bool bus_match_node_maybe_free(struct bus_match_node *node) {
         return true;
 }
 
-static bool value_node_test(
+static int bus_match_run_prefixes(
+                sd_bus *bus,
                 struct bus_match_node *node,
-                enum bus_match_node_type parent_type,
-                uint8_t value_u8,
-                const char *value_str,
-                char **value_strv,
+                const char *test_str,
                 sd_bus_message *m) {
 
+        _cleanup_free_ char *buf = NULL;
+        struct bus_match_node *found;
+        size_t n, last = SIZE_MAX;
+        char separator;
+        bool is_complex;
+        int r;
+
         assert(node);
-        assert(node->type == BUS_MATCH_VALUE);
+        assert(BUS_MATCH_IS_PREFIX(node->type));
+        assert(test_str);
 
-        /* Tests parameters against this value node, doing prefix
-         * magic and stuff. */
+        /* Instead of testing every value node against the string, look up all prefixes of the string that
+         * could match. For the simple patterns (path_namespace=, argNnamespace=) these are the prefixes
+         * followed by a separator and the ones ending in one, for the complex patterns (argNpath=) only the
+         * latter. See simple_pattern_check() and complex_pattern_check(). */
 
-        switch (parent_type) {
+        is_complex = node->type >= BUS_MATCH_ARG_PATH && node->type <= BUS_MATCH_ARG_PATH_LAST;
+        separator = node->type >= BUS_MATCH_ARG_NAMESPACE && node->type <= BUS_MATCH_ARG_NAMESPACE_LAST ? '.' : '/';
 
-        case BUS_MATCH_MESSAGE_TYPE:
-                return node->value.u8 == value_u8;
+        n = strlen(test_str);
 
-        case BUS_MATCH_SENDER:
-                if (streq_ptr(node->value.str, value_str))
-                        return true;
+        if (is_complex && n > 0 && test_str[n-1] == separator) {
+                /* If the tested string ends in a separator, it matches all patterns it is a prefix of,
+                 * too. That's not something we can look up, hence check all values manually. */
+                HASHMAP_FOREACH(found, node->compare.children) {
+                        if (!path_complex_pattern(found->value.str, test_str))
+                                continue;
 
-                if (m->creds.mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
-                        /* on kdbus we have the well known names list
-                         * in the credentials, let's make use of that
-                         * for an accurate match */
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
 
-                        STRV_FOREACH(i, m->creds.well_known_names)
-                                if (streq_ptr(node->value.str, *i))
-                                        return true;
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
 
-                } else {
+                return 0;
+        }
 
-                        /* If we don't have kdbus, we don't know the
-                         * well-known names of the senders. In that,
-                         * let's just hope that dbus-daemon doesn't
-                         * send us stuff we didn't want. */
+        buf = strdup(test_str);
+        if (!buf)
+                return -ENOMEM;
 
-                        if (node->value.str[0] != ':' && value_str && value_str[0] == ':')
-                                return true;
-                }
+        for (size_t i = 0; i < n; i++) {
+                if (test_str[i] != separator)
+                        continue;
 
-                return false;
+                /* The prefix right before the separator (simple patterns only), and the one including it */
+                for (size_t l = is_complex ? i + 1 : i; l <= i + 1 && l < n; l++) {
+                        if (l == last)
+                                continue;
 
-        case BUS_MATCH_DESTINATION:
-        case BUS_MATCH_INTERFACE:
-        case BUS_MATCH_MEMBER:
-        case BUS_MATCH_PATH:
-        case BUS_MATCH_ARG ... BUS_MATCH_ARG_LAST:
+                        last = l;
 
-                if (value_str)
-                        return streq_ptr(node->value.str, value_str);
+                        buf[l] = 0;
+                        found = hashmap_get(node->compare.children, buf);
+                        buf[l] = test_str[l];
 
-                return false;
+                        if (!found)
+                                continue;
 
-        case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST: {
-                STRV_FOREACH(i, value_strv)
-                        if (streq_ptr(node->value.str, *i))
-                                return true;
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
 
-                return false;
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
         }
 
-        case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
-                if (value_str)
-                        return namespace_simple_pattern(node->value.str, value_str);
+        /* And finally the whole string itself */
+        found = hashmap_get(node->compare.children, test_str);
+        if (found)
+                return bus_match_run(bus, found, m);
 
-                return false;
+        return 0;
+}
 
-        case BUS_MATCH_PATH_NAMESPACE:
-                return path_simple_pattern(node->value.str, value_str);
+static int bus_match_run_sender(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m) {
 
-        case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
-                if (value_str)
-                        return path_complex_pattern(node->value.str, value_str);
+        struct bus_match_node *found;
+        int r;
 
-                return false;
+        assert(node);
+        assert(node->type == BUS_MATCH_SENDER);
+        assert(m);
 
-        default:
-                assert_not_reached();
+        /* Matches on the unique name of the sender can be looked up directly */
+        if (m->sender) {
+                found = hashmap_get(node->compare.children, m->sender);
+                if (found) {
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
         }
-}
 
-static bool value_node_same(
-                struct bus_match_node *node,
-                enum bus_match_node_type parent_type,
-                uint8_t value_u8,
-                const char *value_str) {
+        if (m->creds.mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
+                /* If we know the well-known names of the sender, let's make use of that for an accurate
+                 * match */
 
-        /* Tests parameters against this value node, not doing prefix
-         * magic and stuff, i.e. this one actually compares the match
-         * itself. */
+                STRV_FOREACH(i, m->creds.well_known_names) {
+                        if (streq_ptr(*i, m->sender))
+                                continue;
 
-        assert(node);
-        assert(node->type == BUS_MATCH_VALUE);
+                        found = hashmap_get(node->compare.children, *i);
+                        if (!found)
+                                continue;
 
-        switch (parent_type) {
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
 
-        case BUS_MATCH_MESSAGE_TYPE:
-                return node->value.u8 == value_u8;
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
 
-        case BUS_MATCH_SENDER:
-        case BUS_MATCH_DESTINATION:
-        case BUS_MATCH_INTERFACE:
-        case BUS_MATCH_MEMBER:
-        case BUS_MATCH_PATH:
-        case BUS_MATCH_ARG ... BUS_MATCH_ARG_LAST:
-        case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST:
-        case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
-        case BUS_MATCH_PATH_NAMESPACE:
-        case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
-                return streq(node->value.str, value_str);
+        } else if (m->sender && m->sender[0] == ':') {
+                /* Otherwise we don't know which well-known names the sender owns. In that case, let's just
+                 * hope that dbus-daemon doesn't send us stuff we didn't want, and run all matches on
+                 * well-known names. */
 
-        default:
-                assert_not_reached();
+                HASHMAP_FOREACH(found, node->compare.children) {
+                        if (found->value.str[0] == ':')
+                                continue;
+
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
         }
+
+        return 0;
 }
 
 int bus_match_run(
@@ -334,8 +371,7 @@ int bus_match_run(
                 break;
 
         case BUS_MATCH_SENDER:
-                test_str = m->sender;
-                /* FIXME: resolve test_str from a well-known to a unique name first */
+                /* Might match on the unique name or on any of the well-known names of the sender */
                 break;
 
         case BUS_MATCH_DESTINATION:
@@ -375,7 +411,21 @@ int bus_match_run(
                 assert_not_reached();
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (node->type == BUS_MATCH_SENDER) {
+
+                r = bus_match_run_sender(bus, node, m);
+                if (r != 0)
+                        return r;
+
+        } else if (BUS_MATCH_IS_PREFIX(node->type)) {
+
+                if (test_str) {
+                        r = bus_match_run_prefixes(bus, node, test_str, m);
+                        if (r != 0)
+                                return r;
+                }
+
+        } else {
                 struct bus_match_node *found;
 
                 /* Lookup via hash table, nice! So let's jump directly. */
@@ -403,19 +453,7 @@ int bus_match_run(
                         if (r != 0)
                                 return r;
                 }
-        } else
-                /* No hash table, so let's iterate manually... */
-                for (struct bus_match_node *c = node->child; c; c = c->next) {
-                        if (!value_node_test(c, node->type, test_u8, test_str, test_strv, m))
-                                continue;
-
-                        r = bus_match_run(bus, c, m);
-                        if (r != 0)
-                                return r;
-
-                        if (bus && bus->match_callbacks_modified)
-                                return 0;
-                }
+        }
 
         if (bus && bus->match_callbacks_modified)
                 return 0;
@@ -449,9 +487,6 @@ static int bus_match_add_compare_value(
                         n = hashmap_get(c->compare.children, UINT_TO_PTR(value_u8));
                 else if (BUS_MATCH_CAN_HASH(t))
                         n = hashmap_get(c->compare.children, value_str);
-                else
-                        for (n = c->child; n && !value_node_same(n, t, value_u8, value_str); n = n->next)
-                                ;
 
                 if (n) {
                         *ret = n;
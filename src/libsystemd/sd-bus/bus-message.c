@@ -341,6 +341,7 @@ static int message_from_header(
         _cleanup_free_ sd_bus_message *m = NULL;
         struct bus_header *h;
         size_t a, label_sz = 0; /* avoid false maybe-uninitialized warning */
+        bool memfd_body;
 
         assert(bus);
         assert(buffer || message_size <= 0);
@@ -360,7 +361,9 @@ static int message_from_header(
         if (!IN_SET(h->endian, BUS_LITTLE_ENDIAN, BUS_BIG_ENDIAN))
                 return -EBADMSG;
 
-        /* Note that we are happy with unknown flags in the flags header! */
+        /* Note that we are happy with unknown flags in the flags header! But the memfd one only has a
+         * meaning if it was negotiated. */
+        memfd_body = bus->can_memfd && FLAGS_SET(h->flags, BUS_MESSAGE_BODY_MEMFD);
 
         a = ALIGN(sizeof(sd_bus_message));
 
@@ -384,8 +387,15 @@ static int message_from_header(
         m->body_size = BUS_MESSAGE_BSWAP32(m, h->body_size);
 
         assert(message_size >= sizeof(struct bus_header));
-        if (ALIGN8(m->fields_size) > message_size - sizeof(struct bus_header) ||
-            m->body_size != message_size - sizeof(struct bus_header) - ALIGN8(m->fields_size))
+        if (ALIGN8(m->fields_size) > message_size - sizeof(struct bus_header))
+                return -EBADMSG;
+
+        if (memfd_body) {
+                /* The body is not part of the buffer, but in the last of the fds */
+                if (m->body_size <= 0 || n_fds <= 0 ||
+                    message_size != sizeof(struct bus_header) + ALIGN8(m->fields_size))
+                        return -EBADMSG;
+        } else if (m->body_size != message_size - sizeof(struct bus_header) - ALIGN8(m->fields_size))
                 return -EBADMSG;
 
         m->fds = fds;
@@ -406,6 +416,47 @@ static int message_from_header(
         return 0;
 }
 
+static int message_map_memfd_body(sd_bus_message *m, int fd) {
+        uint64_t size;
+        void *p;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+
+        /* Only accept the memfd if the sender can't modify it under our feet anymore */
+        r = memfd_get_sealed(fd);
+        if (r <= 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0)
+                return r;
+        if (size < m->body_size)
+                return -EBADMSG;
+
+        p = mmap(NULL, m->body_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        m->n_body_parts = 1;
+        m->body = (struct bus_body_part) {
+                .data = p,
+                .mmap_begin = p,
+                .size = m->body_size,
+                .mapped = m->body_size,
+                .memfd = -EBADF,
+                .munmap_this = true,
+                .sealed = true,
+        };
+
+        /* The fd stays in the message, so that the UNIX_FDS header field remains valid. But if the
+         * message is forwarded, the body goes inline, since the next hop might not know about this. */
+        m->header->flags &= ~BUS_MESSAGE_BODY_MEMFD;
+
+        return 0;
+}
+
 int bus_message_from_malloc(
                 sd_bus *bus,
                 void *buffer,
@@ -428,18 +479,24 @@ int bus_message_from_malloc(
         if (r < 0)
                 return r;
 
-        sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
-        if (sz > 0) {
-                m->n_body_parts = 1;
-                m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
-                m->body.size = sz;
-                m->body.sealed = true;
-                m->body.memfd = -EBADF;
-        }
+        if (bus->can_memfd && FLAGS_SET(m->header->flags, BUS_MESSAGE_BODY_MEMFD)) {
+                r = message_map_memfd_body(m, fds[n_fds - 1]);
+                if (r < 0)
+                        return r;
+        } else {
+                sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
+                if (sz > 0) {
+                        m->n_body_parts = 1;
+                        m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
+                        m->body.size = sz;
+                        m->body.sealed = true;
+                        m->body.memfd = -EBADF;
+                }
 
-        m->n_iovec = 1;
-        m->iovec = m->iovec_fixed;
-        m->iovec[0] = IOVEC_MAKE(buffer, length);
+                m->n_iovec = 1;
+                m->iovec = m->iovec_fixed;
+                m->iovec[0] = IOVEC_MAKE(buffer, length);
+        }
 
         r = message_parse_fields(m);
         if (r < 0)
@@ -2379,6 +2436,68 @@ static int bus_message_close_header(sd_bus_message *m) {
         return 0;
 }
 
+static bool message_body_use_memfd(sd_bus_message *m) {
+        assert(m);
+
+        if (!m->bus || !m->bus->can_memfd || m->bus->use_memfd == 0)
+                return false;
+
+        if (m->body_size <= 0 || m->n_fds >= BUS_FDS_MAX)
+                return false;
+
+        /* Below the threshold copying through the socket is cheaper than setting up the memfd */
+        return m->body_size >= MEMFD_MIN_SIZE || m->bus->use_memfd < 0;
+}
+
+static int message_body_to_memfd(sd_bus_message *m) {
+        _cleanup_close_ int fd = -EBADF;
+        struct bus_body_part *part;
+        uint8_t *p, *q;
+        unsigned i;
+        int *f, r;
+
+        assert(m);
+
+        fd = memfd_new_and_map("sd-bus-body", m->body_size, (void**) &p);
+        if (fd < 0)
+                return fd;
+
+        q = p;
+        MESSAGE_FOREACH_PART(part, i, m) {
+                /* The memfd is zero-initialized already */
+                if (!part->is_zero) {
+                        r = bus_body_part_map(part);
+                        if (r < 0) {
+                                assert_se(munmap(p, m->body_size) >= 0);
+                                return r;
+                        }
+
+                        memcpy(q, part->data, part->size);
+                }
+
+                q += part->size;
+        }
+
+        /* The write seal can only be applied once the writable mapping is gone */
+        assert_se(munmap(p, m->body_size) >= 0);
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        f = reallocarray(m->fds, m->n_fds + 1, sizeof(int));
+        if (!f)
+                return -ENOMEM;
+
+        m->fds = f;
+        m->fds[m->n_fds++] = TAKE_FD(fd);
+        m->free_fds = true;
+
+        m->header->flags |= BUS_MESSAGE_BODY_MEMFD;
+
+        return 0;
+}
+
 _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t timeout_usec) {
         struct bus_body_part *part;
         size_t a;
@@ -2413,6 +2532,14 @@ _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t ti
                         return r;
         }
 
+        /* If the peer agreed to it, pass large bodies as memfd instead of pushing them through the
+         * socket. This is merely an optimization, hence if it fails we just send the body inline. */
+        if (message_body_use_memfd(m)) {
+                r = message_body_to_memfd(m);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to move message body into memfd, sending it inline: %m");
+        }
+
         if (m->n_fds > 0) {
                 r = message_append_field_uint32(m, BUS_MESSAGE_HEADER_UNIX_FDS, m->n_fds);
                 if (r < 0)
@@ -4248,6 +4375,67 @@ static int message_parse_fields(sd_bus_message *m) {
         return 0;
 }
 
+int bus_message_peek_unix_fds(sd_bus *bus, void *buffer, size_t length, size_t *ret) {
+        struct bus_header *h = buffer;
+        sd_bus_message m;
+        int r;
+
+        assert(bus);
+        assert(buffer || length <= 0);
+        assert(ret);
+
+        /* Determines how many file descriptors a serialized message expects to be passed along with it,
+         * without validating anything but the header fields. This is used when reading from a socket,
+         * where file descriptors received in one go might belong to more than one message. The body is
+         * not looked at, it might not even be part of the buffer if it is passed as memfd. The field
+         * parsers only need the header and the size of the fields array, hence a stub message will do. */
+
+        if (length < sizeof(struct bus_header))
+                return -EBADMSG;
+
+        if (!IN_SET(h->endian, BUS_LITTLE_ENDIAN, BUS_BIG_ENDIAN))
+                return -EBADMSG;
+
+        m = (sd_bus_message) {
+                .header = h,
+        };
+
+        m.fields_size = BUS_MESSAGE_BSWAP32(&m, h->fields_size);
+        if (m.fields_size > length - sizeof(struct bus_header))
+                return -EBADMSG;
+
+        for (size_t ri = 0; ri < m.fields_size; ) {
+                const char *signature;
+                uint8_t *u8;
+
+                r = message_peek_fields(&m, &ri, 8, 1, (void**) &u8);
+                if (r < 0)
+                        return r;
+
+                r = message_peek_field_signature(&m, &ri, 0, &signature);
+                if (r < 0)
+                        return r;
+
+                if (*u8 == BUS_MESSAGE_HEADER_UNIX_FDS && streq(signature, "u")) {
+                        uint32_t unix_fds;
+
+                        r = message_peek_field_uint32(&m, &ri, SIZE_MAX, &unix_fds);
+                        if (r < 0)
+                                return r;
+
+                        *ret = unix_fds;
+                        return 0;
+                }
+
+                r = message_skip_fields(&m, &ri, UINT32_MAX, &signature);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = 0;
+        return 0;
+}
+
 _public_ int sd_bus_message_set_destination(sd_bus_message *m, const char *destination) {
         assert_return(m, -EINVAL);
         assert_return(destination, -EINVAL);
@@ -154,6 +154,13 @@ static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
                 ALIGN8(m->fields_size);
 }
 
+/* The number of bytes that go over the socket, i.e. without the body if it is passed as memfd */
+static inline size_t BUS_MESSAGE_WIRE_SIZE(sd_bus_message *m) {
+        return FLAGS_SET(m->header->flags, BUS_MESSAGE_BODY_MEMFD) ?
+                BUS_MESSAGE_BODY_BEGIN(m) :
+                BUS_MESSAGE_SIZE(m);
+}
+
 static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
         return (uint8_t*) m->header + sizeof(struct bus_header);
 }
@@ -168,6 +175,7 @@ int bus_message_from_malloc(
                 size_t n_fds,
                 const char *label,
                 sd_bus_message **ret);
+int bus_message_peek_unix_fds(sd_bus *bus, void *buffer, size_t length, size_t *ret);
 
 int bus_message_get_arg(sd_bus_message *m, unsigned i, const char **str);
 int bus_message_get_arg_strv(sd_bus_message *m, unsigned i, char ***strv);
@@ -671,6 +671,7 @@ static int property_get_set_callbacks_run(
                         return bus_maybe_reply_error(m, r, &error);
 
                 r = invoke_property_set(bus, slot, c->vtable, m->path, c->interface, c->member, m, u, &error);
+                bus_property_cache_invalidate(bus, m->path, c->interface);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
@@ -744,12 +745,136 @@ static int vtable_append_one_property(
         return 0;
 }
 
+enum property_filter {
+        PROPERTY_ALL,
+        PROPERTY_CACHEABLE,
+        PROPERTY_UNCACHEABLE,
+};
+
+struct property_cache_entry {
+        char *path;
+        char *interface;
+        sd_bus_message *message;
+};
+
+static struct property_cache_entry* property_cache_entry_free(struct property_cache_entry *e) {
+        if (!e)
+                return NULL;
+
+        if (e->message)
+                bus_message_unref_queued(e->message, e->message->bus);
+
+        free(e->path);
+        free(e->interface);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct property_cache_entry*, property_cache_entry_free);
+
+static void property_cache_entry_hash_func(const struct property_cache_entry *e, struct siphash *state) {
+        assert(e);
+
+        string_hash_func(e->path, state);
+        string_hash_func(e->interface, state);
+}
+
+static int property_cache_entry_compare_func(const struct property_cache_entry *x, const struct property_cache_entry *y) {
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->path, y->path);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->interface, y->interface);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(
+                property_cache_hash_ops,
+                struct property_cache_entry,
+                property_cache_entry_hash_func,
+                property_cache_entry_compare_func,
+                property_cache_entry_free);
+
+void bus_property_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->property_cache = ordered_hashmap_free(bus->property_cache);
+}
+
+void bus_property_cache_invalidate(sd_bus *bus, const char *path, const char *interface) {
+        struct property_cache_entry *e;
+
+        assert(bus);
+        assert(path);
+
+        if (interface) {
+                e = ordered_hashmap_remove(bus->property_cache, &(struct property_cache_entry) {
+                                .path = (char*) path,
+                                .interface = (char*) interface,
+                        });
+                property_cache_entry_free(e);
+                return;
+        }
+
+        ORDERED_HASHMAP_FOREACH(e, bus->property_cache)
+                if (streq(e->path, path))
+                        property_cache_entry_free(ordered_hashmap_remove(bus->property_cache, e));
+}
+
+static int property_cache_put(sd_bus *bus, const char *path, const char *interface, sd_bus_message *m) {
+        _cleanup_(property_cache_entry_freep) struct property_cache_entry *e = NULL;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(interface);
+        assert(m);
+
+        e = new0(struct property_cache_entry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->path = strdup(path);
+        e->interface = strdup(interface);
+        if (!e->path || !e->interface)
+                return -ENOMEM;
+
+        if (ordered_hashmap_size(bus->property_cache) >= PROPERTY_CACHE_MAX)
+                property_cache_entry_free(ordered_hashmap_steal_first(bus->property_cache));
+
+        r = ordered_hashmap_ensure_put(&bus->property_cache, &property_cache_hash_ops, e, e);
+        if (r < 0)
+                return r;
+
+        /* Take a queued reference only, since a regular one would pin the bus */
+        e->message = bus_message_ref_queued(m, bus);
+        TAKE_PTR(e);
+
+        return 0;
+}
+
+static bool vtable_property_cacheable(struct node_vtable *c, const sd_bus_vtable *v) {
+        assert(c);
+        assert(v);
+
+        /* Only properties we are told about when they change may be served from the cache. */
+
+        if (FLAGS_SET(c->vtable->flags, SD_BUS_VTABLE_SENSITIVE))
+                return false;
+
+        return v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION);
+}
+
 static int vtable_append_all_properties(
                 sd_bus *bus,
                 sd_bus_message *reply,
                 const char *path,
                 struct node_vtable *c,
                 void *userdata,
+                enum property_filter filter,
                 sd_bus_error *error) {
 
         const sd_bus_vtable *v;
@@ -783,6 +908,10 @@ static int vtable_append_all_properties(
                     FLAGS_SET(v->flags, SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
                         continue;
 
+                if (filter != PROPERTY_ALL &&
+                    vtable_property_cacheable(c, v) != (filter == PROPERTY_CACHEABLE))
+                        continue;
+
                 r = vtable_append_one_property(bus, reply, path, c, v, userdata, error);
                 if (r < 0)
                         return r;
@@ -801,8 +930,9 @@ static int property_get_all_callbacks_run(
                 const char *iface,
                 bool *found_object) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        bool found_interface;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL, *cached = NULL;
+        struct property_cache_entry *e = NULL;
+        bool found_interface, found_vtable = false, use_cache;
         int r;
 
         assert(bus);
@@ -817,6 +947,28 @@ static int property_get_all_callbacks_run(
         if (r < 0)
                 return r;
 
+        /* If enabled, the values of all properties that tell us about changes are taken from a cached
+         * message, and only the others are queried each time. On a cache miss we first collect the
+         * cacheable ones in a separate message, which is then stored and copied into the reply. */
+        use_cache = bus->cache_properties && iface;
+        if (use_cache) {
+                e = ordered_hashmap_get(bus->property_cache, &(struct property_cache_entry) {
+                                .path = (char*) m->path,
+                                .interface = (char*) iface,
+                        });
+                if (e)
+                        cached = sd_bus_message_ref(e->message);
+                else {
+                        r = sd_bus_message_new_method_return(m, &cached);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_open_container(cached, 'a', "{sv}");
+                        if (r < 0)
+                                return r;
+                }
+        }
+
         found_interface = !iface || STR_IN_SET(iface,
                                                "org.freedesktop.DBus.Properties",
                                                "org.freedesktop.DBus.Peer",
@@ -841,9 +993,17 @@ static int property_get_all_callbacks_run(
 
                 if (iface && !streq(c->interface, iface))
                         continue;
-                found_interface = true;
+                found_interface = found_vtable = true;
 
-                r = vtable_append_all_properties(bus, reply, m->path, c, u, &error);
+                if (use_cache && !e) {
+                        r = vtable_append_all_properties(bus, cached, m->path, c, u, PROPERTY_CACHEABLE, &error);
+                        if (r < 0)
+                                return bus_maybe_reply_error(m, r, &error);
+                        if (bus->nodes_modified)
+                                return 0;
+                }
+
+                r = vtable_append_all_properties(bus, reply, m->path, c, u, use_cache ? PROPERTY_UNCACHEABLE : PROPERTY_ALL, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
                 if (bus->nodes_modified)
@@ -864,6 +1024,37 @@ static int property_get_all_callbacks_run(
                 return 1;
         }
 
+        /* Only remember replies for interfaces that are actually implemented by the object. For others,
+         * such as the standard interfaces, the cached message is empty anyway. */
+        if (use_cache && found_vtable) {
+                if (!e) {
+                        r = sd_bus_message_close_container(cached);
+                        if (r < 0)
+                                return r;
+
+                        /* This message is never sent, it only needs to be sealed so that we can read from it */
+                        r = sd_bus_message_seal(cached, UINT32_MAX, 0);
+                        if (r < 0)
+                                return r;
+
+                        r = property_cache_put(bus, m->path, iface, cached);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_rewind(cached, true);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_enter_container(cached, 'a', "{sv}");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_copy(reply, cached, true);
+                if (r < 0)
+                        return r;
+        }
+
         r = sd_bus_message_close_container(reply);
         if (r < 0)
                 return r;
@@ -970,7 +1161,7 @@ int introspect_path(
                 if (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
                         continue;
 
-                r = introspect_write_interface(&intro, c->interface, c->vtable);
+                r = introspect_write_interface_cached(&intro, c->interface, c->vtable, &c->introspection);
                 if (r < 0)
                         return r;
         }
@@ -1147,7 +1338,7 @@ static int object_manager_serialize_path(
                                 return r;
                 }
 
-                r = vtable_append_all_properties(bus, reply, path, i, u, error);
+                r = vtable_append_all_properties(bus, reply, path, i, u, PROPERTY_ALL, error);
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -1974,6 +2165,7 @@ static int add_object_vtable_internal(
         s->node_vtable.node = n;
         LIST_INSERT_AFTER(vtables, n->vtables, existing, &s->node_vtable);
         bus->nodes_modified = true;
+        bus_property_cache_flush(bus);
 
         if (slot)
                 *slot = s;
@@ -2292,6 +2484,8 @@ _public_ int sd_bus_emit_properties_changed_strv(
         if (names && names[0] == NULL)
                 return 0;
 
+        bus_property_cache_invalidate(bus, path, interface);
+
         BUS_DONT_DESTROY(bus);
 
         pl = strlen(path);
@@ -2418,7 +2612,7 @@ static int object_added_append_all_prefix(
                         previous_interface = c->interface;
                 }
 
-                r = vtable_append_all_properties(bus, m, path, c, u, &error);
+                r = vtable_append_all_properties(bus, m, path, c, u, PROPERTY_ALL, &error);
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2528,6 +2722,9 @@ _public_ int sd_bus_emit_object_added(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+        /* The object may have been re-created under the same path */
+        bus_property_cache_invalidate(bus, path, NULL);
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -2708,6 +2905,8 @@ _public_ int sd_bus_emit_object_removed(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+        bus_property_cache_invalidate(bus, path, NULL);
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -2800,7 +2999,7 @@ static int interfaces_added_append_one_prefix(
                         found_interface = true;
                 }
 
-                r = vtable_append_all_properties(bus, m, path, c, u, &error);
+                r = vtable_append_all_properties(bus, m, path, c, u, PROPERTY_ALL, &error);
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2870,6 +3069,9 @@ _public_ int sd_bus_emit_interfaces_added_strv(sd_bus *bus, const char *path, ch
         if (strv_isempty(interfaces))
                 return 0;
 
+        STRV_FOREACH(i, interfaces)
+                bus_property_cache_invalidate(bus, path, *i);
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -2958,6 +3160,9 @@ _public_ int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path,
         if (strv_isempty(interfaces))
                 return 0;
 
+        STRV_FOREACH(i, interfaces)
+                bus_property_cache_invalidate(bus, path, *i);
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -9,6 +9,13 @@ bool bus_vtable_has_names(const sd_bus_vtable *vtable);
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
 
+/* Upper bound for the number of cached GetAll() replies. The paths are chosen by the peers, hence don't let them
+ * grow the cache without limit: once full, the oldest entry is dropped for each new one. */
+#define PROPERTY_CACHE_MAX 4096U
+
+void bus_property_cache_flush(sd_bus *bus);
+void bus_property_cache_invalidate(sd_bus *bus, const char *path, const char *interface);
+
 int introspect_path(
                 sd_bus *bus,
                 const char *path,
@@ -40,6 +40,10 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED               = 1 << 0,
         BUS_MESSAGE_NO_AUTO_START                   = 1 << 1,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 1 << 2,
+
+        /* Non-standard extension, only used if negotiated with NEGOTIATE_MEMFD_BODY during authentication:
+         * the body is not sent inline, but in a sealed memfd passed as the last file descriptor. */
+        BUS_MESSAGE_BODY_MEMFD                      = 1 << 7,
 };
 
 /* Header fields */
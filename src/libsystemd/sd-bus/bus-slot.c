@@ -150,10 +150,12 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
                 }
 
                 slot->node_vtable.interface = mfree(slot->node_vtable.interface);
+                slot->node_vtable.introspection = mfree(slot->node_vtable.introspection);
 
                 if (slot->node_vtable.node) {
                         LIST_REMOVE(vtables, slot->node_vtable.node->vtables, &slot->node_vtable);
                         slot->bus->nodes_modified = true;
+                        bus_property_cache_flush(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_vtable.node);
                 }
@@ -27,6 +27,7 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
@@ -89,6 +90,10 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
         if (r < 0)
                 goto fail;
 
+        /* If the body is passed as memfd, only the header goes over the socket */
+        if (FLAGS_SET(m->header->flags, BUS_MESSAGE_BODY_MEMFD))
+                return 0;
+
         MESSAGE_FOREACH_PART(part, i, m)  {
                 r = bus_body_part_map(part);
                 if (r < 0)
@@ -126,29 +131,23 @@ bool bus_socket_auth_needs_write(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *l, *lines[4] = {};
+        char *l, *lines[5] = {};
+        bool want_memfd;
         sd_id128_t peer;
-        size_t i, n;
+        size_t i, n, n_expected;
         int r;
 
         assert(b);
 
         /*
-         * We expect up to three response lines:
+         * We expect up to four response lines:
          *   "DATA\r\n"                 (optional)
          *   "OK <server-id>\r\n"
          *   "AGREE_UNIX_FD\r\n"        (optional)
+         *   "AGREE_MEMFD_BODY\r\n"     (optional)
          */
 
-        n = 0;
-        lines[n] = b->rbuffer;
-        for (i = 0; i < 3; ++i) {
-                l = memmem_safe(lines[n], b->rbuffer_size - (lines[n] - (char*) b->rbuffer), "\r\n", 2);
-                if (l)
-                        lines[++n] = l + 2;
-                else
-                        break;
-        }
+        want_memfd = b->accept_fd && b->use_memfd != 0;
 
         /*
          * If we sent a non-empty initial response, then we just expect an OK
@@ -157,9 +156,23 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
          * challenge, reply with our own DATA, and expect an OK reply. We do
          * this for EXTERNAL.
          * If FD negotiation was requested, we additionally expect
-         * an AGREE_UNIX_FD response in all cases.
+         * an AGREE_UNIX_FD response in all cases, and the same for
+         * AGREE_MEMFD_BODY. Servers that don't know the latter reply
+         * with ERROR, which is fine too.
          */
-        if (n < (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd)
+        n_expected = (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd + want_memfd;
+
+        n = 0;
+        lines[n] = b->rbuffer;
+        for (i = 0; i < n_expected; ++i) {
+                l = memmem_safe(lines[n], b->rbuffer_size - (lines[n] - (char*) b->rbuffer), "\r\n", 2);
+                if (l)
+                        lines[++n] = l + 2;
+                else
+                        break;
+        }
+
+        if (n < n_expected)
                 return 0; /* wait for more data */
 
         i = 0;
@@ -220,6 +233,12 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 b->can_fds = memory_startswith(l, lines[i] - l, "AGREE_UNIX_FD");
         }
 
+        /* And the fourth one */
+        if (want_memfd) {
+                l = lines[i++];
+                b->can_memfd = b->can_fds && memory_startswith(l, lines[i] - l, "AGREE_MEMFD_BODY");
+        }
+
         assert(i == n);
 
         b->rbuffer_size -= (lines[i] - (char*) b->rbuffer);
@@ -470,6 +489,15 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD_BODY")) {
+                        /* Our own extension: bodies of large messages may be passed as sealed memfd. This
+                         * builds on fd passing, hence must be negotiated after it. */
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || b->use_memfd == 0)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD_BODY\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -714,6 +742,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+        static const char sasl_negotiate_memfd_body[] = {
+                "NEGOTIATE_MEMFD_BODY\r\n"
+        };
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -726,9 +757,13 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         else
                 b->auth_iovec[i++] = IOVEC_MAKE((char*) sasl_auth_external, sizeof(sasl_auth_external) - 1);
 
-        if (b->accept_fd)
+        if (b->accept_fd) {
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+                if (b->use_memfd != 0)
+                        b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_memfd_body);
+        }
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -1181,76 +1216,132 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
-        struct iovec *iov;
+/* The maximum number of queued messages we try to write with a single syscall */
+#define WRITE_BATCH_MESSAGES_MAX 64U
+
+/* How much we try to read from the socket at least in one go */
+#define READ_AHEAD_MIN (64U*1024U)
+
+int bus_socket_write_messages(
+                sd_bus *bus,
+                sd_bus_message * const *messages,
+                size_t n_messages,
+                size_t *idx,
+                size_t *ret_n_written) {
+
+        size_t n_batch = 0, n_iov = 0, n_written = 0, offset;
+        struct iovec *iov, *p;
+        sd_bus_message *first;
         ssize_t k;
-        size_t n;
         unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        /* Writes out as much as possible of the specified messages, starting at byte offset *idx of the
+         * first one, in a single writev()/sendmsg() call. Returns 0 if nothing could be written, and > 0
+         * otherwise, in which case *idx is updated to the offset into the first message not fully written,
+         * and the number of messages fully written is returned in *ret_n_written. */
+
+        first = messages[0];
+
+        if (*idx >= BUS_MESSAGE_WIRE_SIZE(first))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        FOREACH_ARRAY(i, messages, MIN(n_messages, WRITE_BATCH_MESSAGES_MAX)) {
+                sd_bus_message *m = *i;
+
+                /* File descriptors are attached to the first byte written by a sendmsg() call, hence a
+                 * message carrying fds has to start a new batch. */
+                if (m != first && m->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(m);
+                if (r < 0) {
+                        if (m == first)
+                                return r;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = newa(struct iovec, n);
-        memcpy_safe(iov, m->iovec, n);
+                        break; /* Let's send what we have, the error will be seen once this is the first one */
+                }
+
+                if (m != first && n_iov + m->n_iovec > IOV_MAX)
+                        break;
+
+                n_iov += m->n_iovec;
+                n_batch++;
+        }
+
+        iov = p = newa(struct iovec, n_iov);
+        FOREACH_ARRAY(i, messages, n_batch)
+                p = mempcpy_safe(p, (*i)->iovec, (*i)->n_iovec * sizeof(struct iovec));
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iov);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iov,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if (first->n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
 
-                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * m->n_fds);
+                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * first->n_fds);
                         mh.msg_control = alloca0(mh.msg_controllen);
                         control = CMSG_FIRSTHDR(&mh);
-                        control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        control->cmsg_len = CMSG_LEN(sizeof(int) * first->n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy(CMSG_DATA(control), first->fds, sizeof(int) * first->n_fds);
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iov);
                 }
         }
 
         if (k < 0)
                 return ERRNO_IS_TRANSIENT(errno) ? 0 : -errno;
 
-        *idx += (size_t) k;
+        offset = *idx + (size_t) k;
+        FOREACH_ARRAY(i, messages, n_batch) {
+                if (offset < BUS_MESSAGE_WIRE_SIZE(*i))
+                        break;
+
+                offset -= BUS_MESSAGE_WIRE_SIZE(*i);
+                n_written++;
+        }
+
+        *idx = offset;
+        if (ret_n_written)
+                *ret_n_written = n_written;
+
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+static int bus_socket_read_message_need(sd_bus *bus, size_t offset, size_t *need) {
+        const uint8_t *p;
         uint32_t a, b;
-        uint8_t e;
         uint64_t sum;
 
         assert(bus);
+        assert(bus->rbuffer_size >= offset);
         assert(need);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        /* Determines the size of the message starting at the specified offset in the read buffer. Note
+         * that since messages are not padded at the end, the offset is not necessarily aligned. */
+
+        if (bus->rbuffer_size - offset < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -1272,16 +1363,14 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
+        p = (const uint8_t*) bus->rbuffer + offset;
 
-        e = ((const uint8_t*) bus->rbuffer)[0];
-        if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
-        } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
+        if (p[0] == BUS_LITTLE_ENDIAN) {
+                a = unaligned_read_le32(p + 4);
+                b = unaligned_read_le32(p + 12);
+        } else if (p[0] == BUS_BIG_ENDIAN) {
+                a = unaligned_read_be32(p + 4);
+                b = unaligned_read_be32(p + 12);
         } else
                 return -EBADMSG;
 
@@ -1289,58 +1378,146 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
 
+        /* If the body is passed as memfd, we only read the header from the socket */
+        if (bus->can_memfd && FLAGS_SET(p[2], BUS_MESSAGE_BODY_MEMFD))
+                sum -= a;
+
         *need = (size_t) sum;
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
-        sd_bus_message *t = NULL;
-        void *b;
+static int bus_socket_make_message(sd_bus *bus, void *buffer, size_t size) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *t = NULL;
+        _cleanup_free_ void *b = buffer;
+        _cleanup_free_ int *fds = NULL;
+        size_t n_fds = 0;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
+        assert(buffer);
+        assert(bus->rqueue_size < BUS_RQUEUE_MAX);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_rqueue_make_room(bus);
-        if (r < 0)
-                return r;
+        /* Takes possession of the buffer. Received file descriptors are queued up in the order they
+         * arrived, since a single read might pick up fds for more than one message. Each message consumes
+         * as many of them as its header declares. If we can't tell how many that are, we can't tell which
+         * fds belong to the messages following it either, hence the connection is given up on. If the
+         * header declares more than we got, the message takes all queued fds with it, and is then dropped
+         * below. */
+        if (bus->n_fds > 0) {
+                r = bus_message_peek_unix_fds(bus, b, size, &n_fds);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to determine number of file descriptors of message from connection %s: %m",
+                                               strna(bus->description));
+                if (n_fds > bus->n_fds)
+                        n_fds = bus->n_fds;
+
+                if (n_fds == bus->n_fds) {
+                        fds = TAKE_PTR(bus->fds);
+                        bus->n_fds = 0;
+                } else if (n_fds > 0) {
+                        fds = newdup(int, bus->fds, n_fds);
+                        if (!fds)
+                                return -ENOMEM;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
-                if (!b)
-                        return -ENOMEM;
-        } else
-                b = NULL;
+                        memmove(bus->fds, bus->fds + n_fds, sizeof(int) * (bus->n_fds - n_fds));
+                        bus->n_fds -= n_fds;
+                }
+        }
 
         r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
+                                    b, size,
+                                    fds, n_fds,
                                     NULL,
                                     &t);
+        if (r < 0)
+                close_many(fds, n_fds);
         if (r == -EBADMSG) {
                 log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
-                free(bus->rbuffer); /* We want to drop current rbuffer and proceed with whatever remains in b */
-        } else if (r < 0) {
-                free(b);
-                return r;
+                return 1;
         }
+        if (r < 0)
+                return r;
 
-        /* rbuffer ownership was either transferred to t, or we got EBADMSG and dropped it. */
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
+        /* The buffer and the fds are owned by the message now */
+        TAKE_PTR(b);
+        TAKE_PTR(fds);
+
+        t->read_counter = ++bus->read_counter;
+        bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
+
+        return 1;
+}
+
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Turns all complete messages in the read buffer into message objects, and then moves whatever is
+         * left over to the front of the buffer, so that we only have to do that once per read. */
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        for (;;) {
+                size_t need;
+                void *b;
+
+                r = bus_socket_read_message_need(bus, offset, &need);
+                if (r < 0)
+                        return r;
+
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                r = bus_rqueue_make_room(bus);
+                if (r == -ENOBUFS && ret > 0)
+                        break; /* Leave the rest in the buffer until the queue has been processed */
+                if (r < 0)
+                        return r;
+
+                if (offset == 0 && bus->rbuffer_size == need) {
+                        /* The message is all we have buffered, hence let's pass the buffer on, minus the
+                         * space we reserved for reading ahead. */
+                        b = realloc(bus->rbuffer, need) ?: bus->rbuffer;
+                        bus->rbuffer = NULL;
+                        bus->rbuffer_size = 0;
+                } else {
+                        b = memdup((const uint8_t*) bus->rbuffer + offset, need);
+                        if (!b)
+                                return -ENOMEM;
+
+                        offset += need;
+                }
+
+                r = bus_socket_make_message(bus, b, need);
+                if (r < 0)
+                        return r;
 
-        if (t) {
-                t->read_counter = ++bus->read_counter;
-                bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
-                sd_bus_message_unref(t);
+                ret = 1;
         }
 
-        return 1;
+        if (offset > 0) {
+                bus->rbuffer_size -= offset;
+                memmove(bus->rbuffer, (const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size);
+        }
+
+        if (bus->rbuffer_size == 0) {
+                /* Don't keep the read-ahead space around while the connection is idle */
+                bus->rbuffer = mfree(bus->rbuffer);
+
+                /* File descriptors are always received together with the first byte of the message they
+                 * belong to. If no message claimed them and there's nothing else buffered, the peer sent
+                 * us fds it didn't declare. */
+                if (bus->n_fds > 0) {
+                        log_debug("Received %zu undeclared file descriptors from connection %s, closing.",
+                                  bus->n_fds, strna(bus->description));
+                        close_many(bus->fds, bus->n_fds);
+                        bus->fds = mfree(bus->fds);
+                        bus->n_fds = 0;
+                }
+        }
+
+        return ret;
 }
 
 int bus_socket_read_message(sd_bus *bus) {
@@ -1356,12 +1533,16 @@ int bus_socket_read_message(sd_bus *bus) {
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
+
+        /* Read more than we strictly need for the current message, so that a burst of small messages can
+         * be picked up with a single syscall, instead of at least two per message. */
+        need = MAX(need, READ_AHEAD_MIN);
 
         b = realloc(bus->rbuffer, need);
         if (!b)
@@ -1437,13 +1618,10 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
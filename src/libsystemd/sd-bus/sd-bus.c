@@ -228,6 +228,7 @@ static sd_bus* bus_free(sd_bus *b) {
 
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
+        bus_property_cache_flush(b);
 
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
@@ -356,6 +357,16 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_negotiate_memfd(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus->use_memfd = !!b;
+        return 0;
+}
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -2042,31 +2053,40 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, UINT32_MAX, 0);
 }
 
+static void bus_log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s"
+                  " cookie=%" PRIu64 " reply_cookie=%" PRIu64
+                  " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        size_t n_written;
         int r;
 
         assert(bus);
         assert(m);
 
-        r = bus_socket_write_message(bus, m, idx);
+        r = bus_socket_write_messages(bus, &m, 1, idx, &n_written);
         if (r <= 0)
                 return r;
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s"
-                          " cookie=%" PRIu64 " reply_cookie=%" PRIu64
-                          " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+        if (n_written > 0) {
+                bus_log_sent_message(m);
+                *idx = BUS_MESSAGE_WIRE_SIZE(m);
+        }
 
         return r;
 }
@@ -2078,31 +2098,30 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t n_written;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Write out as many queued messages as possible in one go, which matters when lots of
+                 * messages got queued up, e.g. PropertiesChanged signal storms during boot. */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex, &n_written);
                 if (r < 0)
                         return r;
-                else if (r == 0)
+                if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        bus_message_unref_queued(bus->wqueue[0], bus);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
-
-                        ret = 1;
+                if (n_written == 0)
+                        /* Only partially written, try again */
+                        continue;
+
+                /* Drop the fully written entries from the queue. */
+                FOREACH_ARRAY(m, bus->wqueue, n_written) {
+                        bus_log_sent_message(*m);
+                        bus_message_unref_queued(*m, bus);
                 }
+
+                bus->wqueue_size -= n_written;
+                memmove(bus->wqueue, bus->wqueue + n_written, sizeof(sd_bus_message*) * bus->wqueue_size);
+
+                ret = 1;
         }
 
         return ret;
@@ -2216,7 +2235,7 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                 } else if (r < 0)
                         return r;
 
-                if (idx < BUS_MESSAGE_SIZE(m))  {
+                if (idx < BUS_MESSAGE_WIRE_SIZE(m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -2332,7 +2351,8 @@ _public_ int sd_bus_call_async(
         if (!callback && !slot && !m->sealed)
                 m->header->flags |= BUS_MESSAGE_NO_REPLY_EXPECTED;
 
-        r = ordered_hashmap_ensure_allocated(&bus->reply_callbacks, &uint64_hash_ops);
+        /* The cookies are ours, the peer's replies are only ever looked up */
+        r = ordered_hashmap_ensure_allocated(&bus->reply_callbacks, &uint64_hash_ops_trusted);
         if (r < 0)
                 return r;
 
@@ -4448,6 +4468,25 @@ _public_ int sd_bus_get_close_on_exit(sd_bus *bus) {
         return bus->close_on_exit;
 }
 
+_public_ int sd_bus_set_property_cache(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus->cache_properties = b;
+        if (!b)
+                bus_property_cache_flush(bus);
+
+        return 0;
+}
+
+_public_ int sd_bus_get_property_cache(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->cache_properties;
+}
+
 _public_ int sd_bus_enqueue_for_read(sd_bus *bus, sd_bus_message *m) {
         int r;
 
@@ -16,8 +16,10 @@
 #include "time-util.h"
 
 #define MAX_SIZE (2*1024*1024)
+#define MAX_SIZE_CHART (64*1024*1024)
 
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
+static bool arg_memfd = false;
 
 typedef enum Type {
         TYPE_LEGACY,
@@ -159,6 +161,9 @@ static void client_chart(Type type, const char *address, const char *server_name
         if (type == TYPE_DIRECT) {
                 r = sd_bus_set_fd(b, fd, fd);
                 assert_se(r >= 0);
+
+                r = sd_bus_negotiate_memfd(b, arg_memfd);
+                assert_se(r >= 0);
         } else {
                 r = sd_bus_set_address(b, address);
                 assert_se(r >= 0);
@@ -178,11 +183,11 @@ static void client_chart(Type type, const char *address, const char *server_name
                 printf("SIZE\tLEGACY\n");
                 break;
         case TYPE_DIRECT:
-                printf("SIZE\tDIRECT\n");
+                printf("SIZE\tDIRECT%s\n", arg_memfd ? "+MEMFD" : "");
                 break;
         }
 
-        for (csize = 1; csize <= MAX_SIZE; csize *= 2) {
+        for (csize = 1; csize <= MAX_SIZE_CHART; csize *= 2) {
                 usec_t t;
                 unsigned n_memfd;
 
@@ -206,10 +211,82 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+static void client_storm(Type type, const char *address, const char *server_name, int fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
+        uint64_t n_total = 0;
+        sd_bus *b;
+        int r;
+
+        /* Emits signals as fast as possible, similar to PID 1 sending out PropertiesChanged signals for lots of
+         * units at once. This quickly fills the socket buffer, so that most signals end up in the write queue,
+         * and measures how fast that is drained. */
+
+        r = sd_bus_new(&b);
+        assert_se(r >= 0);
+
+        if (type == TYPE_DIRECT) {
+                r = sd_bus_set_fd(b, fd, fd);
+                assert_se(r >= 0);
+
+                r = sd_bus_negotiate_memfd(b, arg_memfd);
+                assert_se(r >= 0);
+        } else {
+                r = sd_bus_set_address(b, address);
+                assert_se(r >= 0);
+
+                r = sd_bus_set_bus_client(b, true);
+                assert_se(r >= 0);
+        }
+
+        r = sd_bus_start(b);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
+        assert_se(r >= 0);
+
+        printf("BATCH	SIGNALS/s\n");
+
+        for (unsigned batch = 1; batch <= 16384; batch *= 4) {
+                unsigned n_signals = 0;
+                usec_t t, d;
+
+                t = now(CLOCK_MONOTONIC);
+                do {
+                        for (unsigned i = 0; i < batch; i++) {
+                                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                                assert_se(sd_bus_message_new_signal(b, &m, "/", "benchmark.server", "Storm") >= 0);
+                                if (server_name)
+                                        assert_se(sd_bus_message_set_destination(m, server_name) >= 0);
+                                assert_se(sd_bus_message_append(m, "su", "ActiveState", i) >= 0);
+
+                                assert_se(sd_bus_send(b, m, NULL) >= 0);
+                        }
+
+                        /* Wait until the server processed everything, so that we measure the full round */
+                        assert_se(sd_bus_flush(b) >= 0);
+                        assert_se(sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL) >= 0);
+
+                        n_signals += batch;
+                        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+                } while (d < arg_loop_usec);
+
+                printf("%u\t%" PRIu64 "\n", batch, (uint64_t) n_signals * USEC_PER_SEC / d);
+                n_total += n_signals;
+        }
+
+        assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
+        assert_se(sd_bus_message_append(x, "t", n_total) >= 0);
+        assert_se(sd_bus_send(b, x, NULL) >= 0);
+
+        sd_bus_unref(b);
+}
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_STORM,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = EBADF_PAIR;
@@ -228,12 +305,18 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "storm")) {
+                        mode = MODE_STORM;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
                 } else if (streq(argv[i], "direct")) {
                         type = TYPE_DIRECT;
                         continue;
+                } else if (streq(argv[i], "memfd")) {
+                        arg_memfd = true;
+                        continue;
                 }
 
                 assert_se(parse_sec(argv[i], &arg_loop_usec) >= 0);
@@ -262,6 +345,9 @@ int main(int argc, char *argv[]) {
 
                 r = sd_bus_set_server(b, true, SD_ID128_NULL);
                 assert_se(r >= 0);
+
+                r = sd_bus_negotiate_memfd(b, arg_memfd);
+                assert_se(r >= 0);
         } else {
                 r = sd_bus_set_address(b, address);
                 assert_se(r >= 0);
@@ -303,6 +389,10 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                case MODE_STORM:
+                        client_storm(type, address, server_name, pair[1]);
+                        break;
                 }
 
                 _exit(EXIT_SUCCESS);
@@ -316,6 +406,8 @@ int main(int argc, char *argv[]) {
 
         if (mode == MODE_BISECT)
                 printf("Copying/memfd are equally fast at %zu bytes\n", result);
+        else if (mode == MODE_STORM)
+                printf("Client sent %zu signals\n", result);
 
         assert_se(waitpid(pid, NULL, 0) == pid);
 
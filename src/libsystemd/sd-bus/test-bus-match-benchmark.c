@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-match.h"
+#include "bus-message.h"
+#include "bus-slot.h"
+#include "fd-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_MATCHES 10000U
+
+static unsigned n_hits = 0;
+
+static int filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_hits++;
+        return 0;
+}
+
+static void match_add(sd_bus_slot *s, struct bus_match_node *root, const char *match) {
+        struct bus_match_component *components;
+        size_t n_components;
+
+        ASSERT_OK(bus_match_parse(match, &components, &n_components));
+        CLEANUP_ARRAY(components, n_components, bus_match_parse_free);
+
+        s->match_callback.callback = filter;
+        ASSERT_OK(bus_match_add(root, components, n_components, &s->match_callback));
+}
+
+static void run_benchmark(sd_bus *bus, struct bus_match_node *root, const char *path, const char *arg0, unsigned n_expected) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned n_iterations = slow_tests_enabled() ? 100000 : 10000;
+        usec_t t;
+
+        ASSERT_OK(sd_bus_message_new_signal(bus, &m, path, "org.example.Benchmark", "Changed"));
+        ASSERT_OK(sd_bus_message_append(m, "s", arg0));
+        ASSERT_OK(sd_bus_message_seal(m, 1, 0));
+
+        n_hits = 0;
+        ASSERT_EQ(bus_match_run(NULL, root, m), 0);
+        ASSERT_EQ(n_hits, n_expected);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                ASSERT_EQ(bus_match_run(NULL, root, m), 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("path=%s arg0=%s: %u matching, %.0f messages/s against %u matches",
+                 path, arg0, n_expected, (double) n_iterations * USEC_PER_SEC / MAX(t, (usec_t) 1), N_MATCHES);
+}
+
+TEST(match_benchmark) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+
+        _cleanup_(bus_match_free) struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        /* We only need a bus object to create messages with, it doesn't have to be connected */
+        ASSERT_OK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair));
+        ASSERT_OK(sd_bus_new(&bus));
+        ASSERT_OK(sd_bus_set_fd(bus, pair[0], pair[0]));
+        TAKE_FD(pair[0]);
+        ASSERT_OK(sd_bus_start(bus));
+
+        ASSERT_NOT_NULL(slots = new0(sd_bus_slot, N_MATCHES));
+
+        /* A mix of the match types typically used by bus clients tracking many objects or peers */
+        for (unsigned i = 0; i < N_MATCHES; i++) {
+                _cleanup_free_ char *match = NULL;
+
+                switch (i % 4) {
+
+                case 0:
+                        ASSERT_OK(asprintf(&match, "type='signal',path_namespace='/org/example/object%u'", i));
+                        break;
+
+                case 1:
+                        ASSERT_OK(asprintf(&match, "type='signal',arg0namespace='org.example.name%u'", i));
+                        break;
+
+                case 2:
+                        ASSERT_OK(asprintf(&match, "type='signal',arg0path='/org/example/object%u/'", i));
+                        break;
+
+                case 3:
+                        ASSERT_OK(asprintf(&match, "type='signal',interface='org.example.Benchmark',path='/org/example/object%u'", i));
+                        break;
+                }
+
+                match_add(slots + i, &root, match);
+        }
+
+        /* No match at all */
+        run_benchmark(bus, &root, "/org/example/other", "org.example.other", 0);
+
+        /* path_namespace= on a parent of the path, arg0namespace= on a parent of the argument */
+        run_benchmark(bus, &root, "/org/example/object4/child", "org.example.name5.child", 2);
+
+        /* path_namespace=, path= and arg0path= matches, the latter both ways */
+        run_benchmark(bus, &root, "/org/example/object8", "/org/example/object6/foo", 2);
+        run_benchmark(bus, &root, "/org/example/object7", "/org/example/object6/", 2);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
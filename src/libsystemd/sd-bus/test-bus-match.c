@@ -6,6 +6,7 @@
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "strv.h"
 #include "tests.h"
 
 static bool mask[32];
@@ -73,7 +74,7 @@ int main(int argc, char *argv[]) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
-        sd_bus_slot slots[19] = {};
+        sd_bus_slot slots[23] = {};
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -134,6 +135,36 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        /* Matches on the sender */
+        assert_se(match_add(slots, &root, "sender='org.foo'", 19) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.1'", 20) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.2'", 21) >= 0);
+        assert_se(match_add(slots, &root, "sender='org.bar',member='waldo'", 22) >= 0);
+
+        /* Without knowing the well-known names of the sender, all matches on well-known names apply to
+         * messages from unique names */
+        m->sender = (char*) ":1.1";
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 19, 20, 22 }, 3));
+
+        /* If we know them, only those do */
+        m->creds.well_known_names = STRV_MAKE("org.foo");
+        m->creds.mask |= SD_BUS_CREDS_WELL_KNOWN_NAMES;
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 19, 20 }, 2));
+        m->creds.well_known_names = NULL;
+        m->creds.mask &= ~SD_BUS_CREDS_WELL_KNOWN_NAMES;
+
+        /* Messages without sender don't match any of them */
+        m->sender = NULL;
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains(NULL, 0));
+
+        bus_match_free(&root);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "memory-util.h"
+#include "tests.h"
+
+#define BODY_SIZE (MEMFD_MIN_SIZE * 2)
+
+static void check_array(sd_bus_message *m, uint8_t c) {
+        const uint8_t *p;
+        size_t sz;
+
+        ASSERT_OK(sd_bus_message_read_array(m, 'y', (const void**) &p, &sz));
+        ASSERT_EQ(sz, (size_t) BODY_SIZE);
+        ASSERT_TRUE(memeqbyte(c, p, sz));
+}
+
+static int method_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        size_t *n_fds = ASSERT_PTR(userdata);
+        uint8_t *p;
+        int fd;
+
+        /* The memfd stays in the message in addition to the one we sent explicitly */
+        *n_fds = m->n_fds;
+
+        ASSERT_OK(sd_bus_message_read(m, "h", &fd));
+        ASSERT_OK_ERRNO(fcntl(fd, F_GETFD));
+        check_array(m, 'a');
+
+        ASSERT_OK(sd_bus_message_new_method_return(m, &reply));
+        ASSERT_OK(sd_bus_message_append_array_space(reply, 'y', BODY_SIZE, (void**) &p));
+        memset(p, 'b', BODY_SIZE);
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus_message **ret = ASSERT_PTR(userdata);
+
+        *ret = sd_bus_message_ref(m);
+        return 0;
+}
+
+static void process(sd_bus *client, sd_bus *server) {
+        int r, k;
+
+        r = sd_bus_process(client, NULL);
+        ASSERT_OK(r);
+        k = sd_bus_process(server, NULL);
+        ASSERT_OK(k);
+
+        if (r == 0 && k == 0)
+                ASSERT_OK(sd_bus_wait(client, 100 * USEC_PER_MSEC));
+}
+
+static void transfer(bool client_memfd, bool server_memfd) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        size_t n_fds = 0;
+        sd_id128_t id;
+        uint8_t *p;
+
+        ASSERT_OK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair));
+        ASSERT_OK(sd_id128_randomize(&id));
+
+        ASSERT_OK(sd_bus_new(&server));
+        ASSERT_OK(sd_bus_set_fd(server, pair[0], pair[0]));
+        TAKE_FD(pair[0]);
+        ASSERT_OK(sd_bus_set_server(server, true, id));
+        ASSERT_OK(sd_bus_negotiate_memfd(server, server_memfd));
+        ASSERT_OK(sd_bus_add_object(server, NULL, "/", method_handler, &n_fds));
+        ASSERT_OK(sd_bus_start(server));
+
+        ASSERT_OK(sd_bus_new(&client));
+        ASSERT_OK(sd_bus_set_fd(client, pair[1], pair[1]));
+        TAKE_FD(pair[1]);
+        ASSERT_OK(sd_bus_negotiate_memfd(client, client_memfd));
+        ASSERT_OK(sd_bus_start(client));
+
+        /* Attaching an fd to a message requires the authentication to be complete, and nobody else would
+         * drive the server side for us */
+        while (sd_bus_is_ready(client) <= 0)
+                process(client, server);
+
+        ASSERT_OK(sd_bus_message_new_method_call(client, &m, NULL, "/", "org.example.Memfd", "Transfer"));
+        ASSERT_OK(sd_bus_message_append(m, "h", STDERR_FILENO));
+        ASSERT_OK(sd_bus_message_append_array_space(m, 'y', BODY_SIZE, (void**) &p));
+        memset(p, 'a', BODY_SIZE);
+        ASSERT_OK(sd_bus_call_async(client, NULL, m, reply_handler, &reply, 0));
+
+        while (!reply)
+                process(client, server);
+
+        ASSERT_EQ(client->can_memfd, client_memfd && server_memfd);
+        ASSERT_EQ(server->can_memfd, client_memfd && server_memfd);
+        ASSERT_EQ(n_fds, client_memfd && server_memfd ? 2u : 1u);
+
+        ASSERT_EQ(sd_bus_message_is_method_error(reply, NULL), 0);
+        ASSERT_EQ(reply->n_fds, client_memfd && server_memfd ? 1u : 0u);
+        check_array(reply, 'b');
+}
+
+TEST(memfd_body) {
+        transfer(true, true);
+}
+
+TEST(memfd_body_fallback) {
+        /* If either side didn't opt in, everything is sent through the socket */
+        transfer(true, false);
+        transfer(false, true);
+        transfer(false, false);
+}
+
+TEST(memfd_body_many) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        unsigned n_received = 0;
+        sd_id128_t id;
+
+        ASSERT_OK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair));
+        ASSERT_OK(sd_id128_randomize(&id));
+
+        ASSERT_OK(sd_bus_new(&server));
+        ASSERT_OK(sd_bus_set_fd(server, pair[0], pair[0]));
+        TAKE_FD(pair[0]);
+        ASSERT_OK(sd_bus_set_server(server, true, id));
+        ASSERT_OK(sd_bus_negotiate_memfd(server, true));
+        ASSERT_OK(sd_bus_start(server));
+
+        ASSERT_OK(sd_bus_new(&client));
+        ASSERT_OK(sd_bus_set_fd(client, pair[1], pair[1]));
+        TAKE_FD(pair[1]);
+        ASSERT_OK(sd_bus_negotiate_memfd(client, true));
+        ASSERT_OK(sd_bus_start(client));
+
+        while (sd_bus_is_ready(client) <= 0 || sd_bus_is_ready(server) <= 0)
+                process(client, server);
+
+        ASSERT_TRUE(client->can_memfd);
+
+        /* Only the header goes over the socket, the number of fds must be determined from it alone */
+        {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                size_t n_fds = 0;
+                uint8_t *p;
+
+                ASSERT_OK(sd_bus_message_new_signal(client, &m, "/", "org.example.Memfd", "Peek"));
+                ASSERT_OK(sd_bus_message_append(m, "h", STDERR_FILENO));
+                ASSERT_OK(sd_bus_message_append_array_space(m, 'y', BODY_SIZE, (void**) &p));
+                memset(p, 'a', BODY_SIZE);
+                ASSERT_OK(sd_bus_message_seal(m, 4711, 0));
+
+                ASSERT_TRUE(FLAGS_SET(m->header->flags, BUS_MESSAGE_BODY_MEMFD));
+                ASSERT_OK(bus_message_peek_unix_fds(server, m->header, BUS_MESSAGE_BODY_BEGIN(m), &n_fds));
+                ASSERT_EQ(n_fds, 2u);
+        }
+
+        /* Send a couple of messages in one go, so that the server reads the headers of several of them,
+         * together with their fds, at once. Each message carries an explicit fd plus the one of its body,
+         * and has to get exactly those two. */
+        for (unsigned i = 0; i < 8; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                uint8_t *p;
+
+                ASSERT_OK(sd_bus_message_new_signal(client, &m, "/", "org.example.Memfd", "Many"));
+                ASSERT_OK(sd_bus_message_append(m, "h", STDERR_FILENO));
+                ASSERT_OK(sd_bus_message_append_array_space(m, 'y', BODY_SIZE, (void**) &p));
+                memset(p, 'a' + i, BODY_SIZE);
+                ASSERT_OK(sd_bus_send(client, m, NULL));
+        }
+
+        ASSERT_OK(sd_bus_flush(client));
+
+        while (n_received < 8) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                int fd;
+
+                ASSERT_OK(sd_bus_process(server, &m));
+                if (!m) {
+                        ASSERT_OK(sd_bus_wait(server, 100 * USEC_PER_MSEC));
+                        continue;
+                }
+
+                ASSERT_TRUE(sd_bus_message_is_signal(m, "org.example.Memfd", "Many"));
+                ASSERT_EQ(m->n_fds, 2u);
+                ASSERT_OK(sd_bus_message_read(m, "h", &fd));
+                ASSERT_OK_ERRNO(fcntl(fd, F_GETFD));
+                check_array(m, 'a' + n_received);
+
+                n_received++;
+        }
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
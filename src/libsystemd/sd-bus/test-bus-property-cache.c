@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "bus-objects.h"
+#include "fd-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+struct context {
+        uint32_t value;
+        unsigned n_get_cached;
+        unsigned n_get_volatile;
+};
+
+static int get_cached(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = ASSERT_PTR(userdata);
+
+        c->n_get_cached++;
+        return sd_bus_message_append(reply, "u", c->value);
+}
+
+static int get_volatile(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = ASSERT_PTR(userdata);
+
+        c->n_get_volatile++;
+        return sd_bus_message_append(reply, "u", c->n_get_volatile);
+}
+
+static int get_const(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "s", "foo");
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Cached", "u", get_cached, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Volatile", "u", get_volatile, 0, 0),
+        SD_BUS_PROPERTY("Const", "s", get_const, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+static int reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus_message **ret = ASSERT_PTR(userdata);
+
+        *ret = sd_bus_message_ref(m);
+        return 0;
+}
+
+static sd_bus_message* call_get_all(sd_bus *client, sd_bus *server, const char *path, const char *interface) {
+        sd_bus_message *reply = NULL;
+
+        ASSERT_OK(sd_bus_call_method_async(client, NULL, NULL, path, "org.freedesktop.DBus.Properties", "GetAll",
+                                           reply_handler, &reply, "s", interface));
+
+        while (!reply) {
+                int r, k;
+
+                r = sd_bus_process(client, NULL);
+                ASSERT_OK(r);
+                k = sd_bus_process(server, NULL);
+                ASSERT_OK(k);
+
+                if (r == 0 && k == 0)
+                        ASSERT_OK(sd_bus_wait(client, 100 * USEC_PER_MSEC));
+        }
+
+        return reply;
+}
+
+static void get_all(sd_bus *client, sd_bus *server, uint32_t *ret_cached, uint32_t *ret_volatile) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        unsigned n_found = 0;
+
+        reply = call_get_all(client, server, "/foo", "org.example.Cache");
+        ASSERT_EQ(sd_bus_message_is_method_error(reply, NULL), 0);
+        ASSERT_OK(sd_bus_message_enter_container(reply, 'a', "{sv}"));
+
+        for (;;) {
+                const char *name;
+                int r;
+
+                r = sd_bus_message_enter_container(reply, 'e', "sv");
+                ASSERT_OK(r);
+                if (r == 0)
+                        break;
+
+                ASSERT_OK(sd_bus_message_read(reply, "s", &name));
+
+                if (streq(name, "Cached"))
+                        ASSERT_OK(sd_bus_message_read(reply, "v", "u", ret_cached));
+                else if (streq(name, "Volatile"))
+                        ASSERT_OK(sd_bus_message_read(reply, "v", "u", ret_volatile));
+                else {
+                        ASSERT_STREQ(name, "Const");
+                        ASSERT_OK(sd_bus_message_skip(reply, "v"));
+                }
+
+                ASSERT_OK(sd_bus_message_exit_container(reply));
+                n_found++;
+        }
+
+        ASSERT_EQ(n_found, 3u);
+}
+
+static void connect_pair(sd_bus **ret_client, sd_bus **ret_server) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        sd_id128_t id;
+
+        ASSERT_OK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair));
+        ASSERT_OK(sd_id128_randomize(&id));
+
+        ASSERT_OK(sd_bus_new(&server));
+        ASSERT_OK(sd_bus_set_fd(server, pair[0], pair[0]));
+        TAKE_FD(pair[0]);
+        ASSERT_OK(sd_bus_set_server(server, true, id));
+        ASSERT_OK(sd_bus_start(server));
+
+        ASSERT_OK(sd_bus_new(&client));
+        ASSERT_OK(sd_bus_set_fd(client, pair[1], pair[1]));
+        TAKE_FD(pair[1]);
+        ASSERT_OK(sd_bus_start(client));
+
+        *ret_client = TAKE_PTR(client);
+        *ret_server = TAKE_PTR(server);
+}
+
+TEST(property_cache) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        struct context c = {
+                .value = 4711,
+        };
+        uint32_t cached, volatile_value;
+
+        connect_pair(&client, &server);
+        ASSERT_OK(sd_bus_add_object_vtable(server, NULL, "/foo", "org.example.Cache", vtable, &c));
+        ASSERT_EQ(sd_bus_get_property_cache(server), 0);
+        ASSERT_OK(sd_bus_set_property_cache(server, true));
+        ASSERT_EQ(sd_bus_get_property_cache(server), 1);
+
+        /* First call fills the cache */
+        get_all(client, server, &cached, &volatile_value);
+        ASSERT_EQ(cached, 4711u);
+        ASSERT_EQ(volatile_value, 1u);
+        ASSERT_EQ(c.n_get_cached, 1u);
+
+        /* Second call is served from it, except for the property that doesn't notify about changes */
+        get_all(client, server, &cached, &volatile_value);
+        ASSERT_EQ(cached, 4711u);
+        ASSERT_EQ(volatile_value, 2u);
+        ASSERT_EQ(c.n_get_cached, 1u);
+
+        /* A change that is not announced is not picked up … */
+        c.value = 815;
+        get_all(client, server, &cached, &volatile_value);
+        ASSERT_EQ(cached, 4711u);
+        ASSERT_EQ(c.n_get_cached, 1u);
+
+        /* … but one that is announced is. Note that the signal itself carries the new value, hence the
+         * getter is called once for that, too. */
+        ASSERT_OK(sd_bus_emit_properties_changed(server, "/foo", "org.example.Cache", "Cached", NULL));
+        ASSERT_EQ(c.n_get_cached, 2u);
+        get_all(client, server, &cached, &volatile_value);
+        ASSERT_EQ(cached, 815u);
+        ASSERT_EQ(volatile_value, 4u);
+        ASSERT_EQ(c.n_get_cached, 3u);
+
+        /* Turning the cache off drops it */
+        ASSERT_OK(sd_bus_set_property_cache(server, false));
+        get_all(client, server, &cached, &volatile_value);
+        get_all(client, server, &cached, &volatile_value);
+        ASSERT_EQ(c.n_get_cached, 5u);
+        ASSERT_EQ(volatile_value, 6u);
+}
+
+TEST(property_cache_bounded) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        struct context c = {};
+
+        connect_pair(&client, &server);
+        ASSERT_OK(sd_bus_add_fallback_vtable(server, NULL, "/bar", "org.example.Cache", vtable, NULL, &c));
+        ASSERT_OK(sd_bus_set_property_cache(server, true));
+
+        /* Interfaces the object doesn't implement itself are not cached */
+        sd_bus_message_unref(call_get_all(client, server, "/bar/x", "org.freedesktop.DBus.Properties"));
+        sd_bus_message_unref(call_get_all(client, server, "/bar/x", "org.example.Unknown"));
+        ASSERT_EQ(ordered_hashmap_size(server->property_cache), 0u);
+
+        /* The fallback makes up objects for any path below it, but the cache doesn't grow beyond its limit,
+         * and the most recent entries are kept */
+        for (unsigned i = 0; i < PROPERTY_CACHE_MAX + 10; i++) {
+                _cleanup_free_ char *path = NULL;
+
+                ASSERT_OK(asprintf(&path, "/bar/%u", i));
+                sd_bus_message_unref(call_get_all(client, server, path, "org.example.Cache"));
+        }
+
+        ASSERT_EQ(ordered_hashmap_size(server->property_cache), PROPERTY_CACHE_MAX);
+        ASSERT_EQ(c.n_get_cached, PROPERTY_CACHE_MAX + 10);
+
+        c.n_get_cached = 0;
+        sd_bus_message_unref(call_get_all(client, server, "/bar/4100", "org.example.Cache"));
+        ASSERT_EQ(c.n_get_cached, 0u);
+        sd_bus_message_unref(call_get_all(client, server, "/bar/0", "org.example.Cache"));
+        ASSERT_EQ(c.n_get_cached, 1u);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "fd-util.h"
+#include "tests.h"
+
+static bool message_wants_fd(uint32_t i) {
+        return i % 7 == 0;
+}
+
+static void test_storm(uint32_t n_messages, size_t payload_size) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL, *server = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        _cleanup_close_ int null_fd = -EBADF;
+        uint64_t n_queued = 0;
+        uint32_t n_received = 0;
+        sd_id128_t id;
+
+        ASSERT_OK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair));
+        ASSERT_OK(sd_id128_randomize(&id));
+
+        ASSERT_OK(sd_bus_new(&server));
+        ASSERT_OK(sd_bus_set_fd(server, pair[0], pair[0]));
+        TAKE_FD(pair[0]);
+        ASSERT_OK(sd_bus_set_server(server, true, id));
+        ASSERT_OK(sd_bus_negotiate_fds(server, true));
+        ASSERT_OK(sd_bus_start(server));
+
+        ASSERT_OK(sd_bus_new(&client));
+        ASSERT_OK(sd_bus_set_fd(client, pair[1], pair[1]));
+        TAKE_FD(pair[1]);
+        ASSERT_OK(sd_bus_negotiate_fds(client, true));
+        ASSERT_OK(sd_bus_start(client));
+
+        /* Authenticate both sides from a single thread */
+        while (sd_bus_is_ready(client) <= 0 || sd_bus_is_ready(server) <= 0) {
+                ASSERT_OK(sd_bus_process(client, NULL));
+                ASSERT_OK(sd_bus_process(server, NULL));
+        }
+
+        null_fd = open("/dev/null", O_RDONLY|O_CLOEXEC);
+        ASSERT_OK_ERRNO(null_fd);
+
+        /* Queue up more than fits into the socket buffer, so that most messages end up in the write queue
+         * and are written out in batches. Every now and then a message carries an fd, which must arrive
+         * attached to exactly that message. */
+        for (uint32_t i = 0; i < n_messages; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                uint8_t *p;
+
+                ASSERT_OK(sd_bus_message_new_signal(client, &m, "/", "test.WriteQueue", message_wants_fd(i) ? "StormFd" : "Storm"));
+                ASSERT_OK(sd_bus_message_append(m, "u", i));
+                ASSERT_OK(sd_bus_message_append_array_space(m, 'y', payload_size, (void**) &p));
+                memset(p, (int) (i & 0xff), payload_size);
+                if (message_wants_fd(i))
+                        ASSERT_OK(sd_bus_message_append(m, "h", null_fd));
+
+                ASSERT_OK(sd_bus_send(client, m, NULL));
+        }
+
+        ASSERT_OK(sd_bus_get_n_queued_write(client, &n_queued));
+        log_info("%" PRIu64 " of %" PRIu32 " messages ended up in the write queue.", n_queued, n_messages);
+
+        while (n_received < n_messages) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                const uint8_t *p;
+                uint32_t seq;
+                size_t sz;
+                int r, k;
+
+                r = sd_bus_process(client, NULL);
+                ASSERT_OK(r);
+
+                k = sd_bus_process(server, &m);
+                ASSERT_OK(k);
+
+                if (r == 0 && k == 0) {
+                        ASSERT_OK(sd_bus_wait(server, 100 * USEC_PER_MSEC));
+                        continue;
+                }
+                if (!m)
+                        continue;
+
+                ASSERT_OK(sd_bus_message_read(m, "u", &seq));
+                ASSERT_EQ(seq, n_received);
+                ASSERT_TRUE(sd_bus_message_is_signal(m, "test.WriteQueue", message_wants_fd(seq) ? "StormFd" : "Storm"));
+
+                ASSERT_OK(sd_bus_message_read_array(m, 'y', (const void**) &p, &sz));
+                ASSERT_EQ(sz, payload_size);
+                ASSERT_EQ(p[0], (uint8_t) (seq & 0xff));
+                ASSERT_EQ(p[sz - 1], (uint8_t) (seq & 0xff));
+
+                if (message_wants_fd(seq)) {
+                        int fd;
+
+                        ASSERT_OK(sd_bus_message_read(m, "h", &fd));
+                        ASSERT_OK_ERRNO(fcntl(fd, F_GETFD));
+                }
+
+                ASSERT_EQ(sd_bus_message_at_end(m, true), 1);
+
+                n_received++;
+        }
+
+        ASSERT_OK(sd_bus_get_n_queued_write(client, &n_queued));
+        ASSERT_EQ(n_queued, UINT64_C(0));
+}
+
+TEST(write_queue) {
+        test_storm(512, 16U * 1024U);
+}
+
+TEST(read_ahead) {
+        /* Lots of small messages, so that many of them are picked up with a single read, including the
+         * ones carrying fds, which then have to be matched up with the right message. */
+        test_storm(16 * 1024, 64);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -100,7 +100,9 @@ int device_add_property_aux(sd_device *device, const char *key, const char *valu
                 _cleanup_free_ char *new_key = NULL, *new_value = NULL, *old_key = NULL;
                 int r;
 
-                r = ordered_hashmap_ensure_allocated(properties, &string_hash_ops_free_free);
+                /* Properties come from the kernel, udev rules and the udev database, none of which
+                 * unprivileged users can write to */
+                r = ordered_hashmap_ensure_allocated(properties, &string_hash_ops_trusted_free_free);
                 if (r < 0)
                         return r;
 
@@ -74,6 +74,13 @@ struct sd_event_source {
         sd_event_destroy_t destroy_callback;
         sd_event_handler_t ratelimit_expire_callback;
 
+        /* Per source statistics, only maintained if enabled via sd_event_set_statistics() */
+        usec_t pending_since;
+        uint64_t n_dispatched;
+        usec_t dispatch_usec;
+        usec_t dispatch_max_usec;
+        usec_t pending_usec;
+
         LIST_FIELDS(sd_event_source, sources);
 
         RateLimit rate_limit;
@@ -89,8 +96,11 @@ struct sd_event_source {
                         int fd;
                         uint32_t events;
                         uint32_t revents;
+                        uint32_t registered_events; /* the mask we last passed to epoll_ctl() */
                         bool registered:1;
                         bool owned:1;
+                        bool unregister_pending:1; /* still in the epoll, but queued for removal */
+                        LIST_FIELDS(sd_event_source, unregister_list);
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "sd-event.h"
 
@@ -38,3 +39,5 @@ int event_add_time_change(sd_event *e, sd_event_source **ret, sd_event_io_handle
 int event_add_child_pidref(sd_event *e, sd_event_source **s, const PidRef *pid, int options, sd_event_child_handler_t callback, void *userdata);
 
 dual_timestamp* event_dual_timestamp_now(sd_event *e, dual_timestamp *ts);
+
+void event_dump_statistics(sd_event *e, FILE *f, const char *prefix);
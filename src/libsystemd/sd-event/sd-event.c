@@ -15,6 +15,7 @@
 #include "alloc-util.h"
 #include "env-util.h"
 #include "event-source.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glyph-util.h"
@@ -36,6 +37,7 @@
 #include "set.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -148,6 +150,9 @@ struct sd_event {
         /* A list of memory pressure event sources that still need their subscription string written */
         LIST_HEAD(sd_event_source, memory_pressure_write_list);
 
+        /* A list of IO event sources that were taken offline, but whose fd is still in the epoll */
+        LIST_HEAD(sd_event_source, io_unregister_list);
+
         uint64_t origin_id;
 
         uint64_t iteration;
@@ -158,6 +163,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool statistics:1;
 
         int exit_code;
 
@@ -437,6 +443,11 @@ _public_ int sd_event_new(sd_event** ret) {
                 e->profile_delays = true;
         }
 
+        if (secure_getenv("SD_EVENT_PROFILE_SOURCES")) {
+                log_debug("Event source profiling enabled. Dispatch statistics will be collected for each event source.");
+                e->statistics = true;
+        }
+
         *ret = e;
         return 0;
 
@@ -494,6 +505,11 @@ static void source_io_unregister(sd_event_source *s) {
         if (!s->io.registered)
                 return;
 
+        if (s->io.unregister_pending) {
+                LIST_REMOVE(io.unregister_list, s->event->io_unregister_list, s);
+                s->io.unregister_pending = false;
+        }
+
         if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->io.fd, NULL) < 0)
                 log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                 strna(s->description), event_source_type_to_string(s->type));
@@ -501,6 +517,30 @@ static void source_io_unregister(sd_event_source *s) {
         s->io.registered = false;
 }
 
+static void source_io_unregister_lazy(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        /* Daemons with many connections tend to turn IO sources off and on again within the same loop
+         * iteration (e.g. while a reply is being processed). Instead of paying for an EPOLL_CTL_DEL
+         * followed by an EPOLL_CTL_ADD in that case, let's leave the fd in the epoll until the next
+         * sd_event_prepare()/sd_event_wait(), and only remove it then if the source is still offline. We
+         * only do this if we own the fd: otherwise the caller might close it (and the fd number might get
+         * reused) before we get around to removing it, which the epoll would not notice if the file
+         * description has been duplicated elsewhere. */
+
+        if (!s->io.owned || event_origin_changed(s->event)) {
+                source_io_unregister(s);
+                return;
+        }
+
+        if (!s->io.registered || s->io.unregister_pending)
+                return;
+
+        LIST_PREPEND(io.unregister_list, s->event->io_unregister_list, s);
+        s->io.unregister_pending = true;
+}
+
 static int source_io_register(
                 sd_event_source *s,
                 int enabled,
@@ -515,16 +555,35 @@ static int source_io_register(
                 .data.ptr = s,
         };
 
+        if (s->io.unregister_pending) {
+                LIST_REMOVE(io.unregister_list, s->event->io_unregister_list, s);
+                s->io.unregister_pending = false;
+
+                /* The fd never left the epoll, hence if the mask didn't change there's nothing to do.
+                 * Except if the registration was one-shot or edge-triggered: it might have fired already
+                 * and needs to be rearmed. */
+                if (ev.events == s->io.registered_events && !(ev.events & (EPOLLONESHOT|EPOLLET)))
+                        return 0;
+        }
+
         if (epoll_ctl(s->event->epoll_fd,
                       s->io.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
                       s->io.fd, &ev) < 0)
                 return -errno;
 
         s->io.registered = true;
+        s->io.registered_events = ev.events;
 
         return 0;
 }
 
+static void event_flush_io_unregister_list(sd_event *e) {
+        assert(e);
+
+        while (e->io_unregister_list)
+                source_io_unregister(e->io_unregister_list);
+}
+
 static void source_child_pidfd_unregister(sd_event_source *s) {
         assert(s);
         assert(s->type == SOURCE_CHILD);
@@ -1148,6 +1207,9 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                if (s->event->statistics)
+                        s->pending_since = now(CLOCK_MONOTONIC);
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -2665,6 +2727,10 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
         if (s->io.fd == fd)
                 return 0;
 
+        /* A registration we only kept around lazily refers to the old fd, drop it now */
+        if (s->io.unregister_pending)
+                source_io_unregister(s);
+
         saved_fd = s->io.fd;
         s->io.fd = fd;
 
@@ -2921,7 +2987,7 @@ static int event_source_offline(
         switch (s->type) {
 
         case SOURCE_IO:
-                source_io_unregister(s);
+                source_io_unregister_lazy(s);
                 break;
 
         case SOURCE_SIGNAL:
@@ -3126,6 +3192,10 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         assert_return(s->event->state != SD_EVENT_FINISHED, -ESTALE);
         assert_return(!event_origin_changed(s->event), -ECHILD);
 
+        /* Nothing to reorder if the time doesn't change */
+        if (s->time.next == usec && !s->pending)
+                return 0;
+
         r = source_set_pending(s, false);
         if (r < 0)
                 return r;
@@ -3619,6 +3689,13 @@ static int event_arm_timer(
         if (d->next == t)
                 return 0;
 
+        /* If the timer is already armed for an earlier point in time, leave it be: timeouts are usually
+         * pushed into the future over and over again (think per-connection idle timeouts that are reset
+         * on every message), and reprogramming the timerfd each time would cost a syscall per loop
+         * iteration. Instead we'll wake up a bit early, find nothing to dispatch, and rearm then. */
+        if (d->next != USEC_INFINITY && t > d->next)
+                return 0;
+
         assert_se(d->fd >= 0);
 
         if (t == 0) {
@@ -4155,9 +4232,26 @@ static int source_memory_pressure_initiate_dispatch(sd_event_source *s) {
         return 0; /* go on, dispatch to user callback */
 }
 
+static void source_account_dispatch(sd_event_source *s, usec_t begin) {
+        usec_t end, d;
+
+        assert(s);
+
+        end = now(CLOCK_MONOTONIC);
+        d = usec_sub_unsigned(end, begin);
+
+        s->n_dispatched++;
+        s->dispatch_usec = usec_add(s->dispatch_usec, d);
+        s->dispatch_max_usec = MAX(s->dispatch_max_usec, d);
+
+        /* Defer sources and friends stay pending across dispatches, count their next wait from here */
+        s->pending_since = s->pending ? end : 0;
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
         sd_event *saved_event;
+        usec_t begin = 0;
         int r = 0;
 
         assert(s);
@@ -4219,6 +4313,13 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        if (saved_event->statistics) {
+                begin = now(CLOCK_MONOTONIC);
+
+                if (s->pending_since > 0)
+                        s->pending_usec = usec_add(s->pending_usec, usec_sub_unsigned(begin, s->pending_since));
+        }
+
         s->dispatching = true;
 
         switch (s->type) {
@@ -4311,6 +4412,9 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        if (begin > 0)
+                source_account_dispatch(s, begin);
+
 finish:
         if (r < 0) {
                 log_debug_errno(r, "Event source %s (type %s) returned error, %s: %m",
@@ -4539,6 +4643,7 @@ _public_ int sd_event_prepare(sd_event *e) {
                 return r;
 
         event_close_inode_data_fds(e);
+        event_flush_io_unregister_list(e);
 
         if (event_next_pending(e) || e->need_process_child || e->buffered_inotify_data_list)
                 goto pending;
@@ -4700,6 +4805,9 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                                 assert(d);
 
                                 r = flush_timer(e, d->fd, e->event_queue[i].events, &d->next);
+
+                                /* The timer might have been armed too early on purpose, see event_arm_timer() */
+                                d->needs_rearm = true;
                                 break;
                         }
 
@@ -4739,6 +4847,9 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
                 return 1;
         }
 
+        /* Sources might have been taken offline between sd_event_prepare() and now */
+        event_flush_io_unregister_list(e);
+
         for (int64_t threshold = INT64_MAX; ; threshold--) {
                 int64_t epoll_min_priority, child_min_priority;
 
@@ -5306,6 +5417,90 @@ _public_ int sd_event_set_signal_exit(sd_event *e, int b) {
         return change;
 }
 
+_public_ int sd_event_set_statistics(sd_event *e, int b) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        e->statistics = b;
+        return e->statistics;
+}
+
+_public_ int sd_event_get_statistics(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        return e->statistics;
+}
+
+_public_ int sd_event_source_get_statistics(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_dispatch_usec,
+                uint64_t *ret_dispatch_max_usec,
+                uint64_t *ret_pending_usec) {
+
+        assert_return(s, -EINVAL);
+        assert_return(!event_origin_changed(s->event), -ECHILD);
+
+        if (!s->event->statistics)
+                return -ENODATA;
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->n_dispatched;
+        if (ret_dispatch_usec)
+                *ret_dispatch_usec = s->dispatch_usec;
+        if (ret_dispatch_max_usec)
+                *ret_dispatch_max_usec = s->dispatch_max_usec;
+        if (ret_pending_usec)
+                *ret_pending_usec = s->pending_usec;
+
+        return 0;
+}
+
+static int event_source_statistics_compare(sd_event_source * const *a, sd_event_source * const *b) {
+        /* Most expensive ones first */
+        return CMP((*b)->dispatch_usec, (*a)->dispatch_usec);
+}
+
+void event_dump_statistics(sd_event *e, FILE *f, const char *prefix) {
+        _cleanup_free_ sd_event_source **sources = NULL;
+        size_t n = 0;
+
+        assert(e);
+        assert(f);
+
+        if (!e->statistics)
+                return;
+
+        LIST_FOREACH(sources, s, e->sources) {
+                if (s->n_dispatched == 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(sources, n + 1))
+                        return (void) log_oom_debug();
+
+                sources[n++] = s;
+        }
+
+        typesafe_qsort(sources, n, event_source_statistics_compare);
+
+        FOREACH_ARRAY(i, sources, n) {
+                sd_event_source *s = *i;
+
+                fprintf(f, "%sEvent Source %s (%s): dispatched %" PRIu64 " times, took %s (max %s), pending for %s\n",
+                        strempty(prefix),
+                        strna(s->description),
+                        event_source_type_to_string(s->type),
+                        s->n_dispatched,
+                        FORMAT_TIMESPAN(s->dispatch_usec, 1),
+                        FORMAT_TIMESPAN(s->dispatch_max_usec, 1),
+                        FORMAT_TIMESPAN(s->pending_usec, 1));
+        }
+}
+
 _public_ int sd_event_source_set_memory_pressure_type(sd_event_source *s, const char *ty) {
         _cleanup_free_ char *b = NULL;
         _cleanup_free_ void *w = NULL;
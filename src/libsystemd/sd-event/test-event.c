@@ -1,8 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/eventfd.h>
 #if HAVE_PIDFD_OPEN
 #include <sys/pidfd.h>
 #endif
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -19,11 +21,13 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "random-util.h"
+#include "rlimit-util.h"
 #include "rm-rf.h"
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "tests.h"
+#include "time-util.h"
 #include "tmpfile-util.h"
 
 static int prepare_handler(sd_event_source *s, void *userdata) {
@@ -864,6 +868,217 @@ TEST(sd_event_source_set_io_fd) {
         TAKE_FD(pfd_b[0]);
 }
 
+static int io_count_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *c = ASSERT_PTR(userdata);
+
+        assert_se(revents == EPOLLIN);
+
+        (*c)++;
+        return 0;
+}
+
+TEST(io_offline_online) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        unsigned c = 0;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        fd = eventfd(1, EFD_CLOEXEC|EFD_NONBLOCK);
+        assert_se(fd >= 0);
+
+        /* The eventfd stays readable, so the source fires on every iteration while enabled */
+        assert_se(sd_event_add_io(e, &s, fd, EPOLLIN, io_count_callback, &c) >= 0);
+        assert_se(sd_event_source_set_io_fd_own(s, true) >= 0);
+        TAKE_FD(fd);
+
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 1);
+
+        /* Taking the source offline must suppress further dispatches, even if the fd lingers in the epoll */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(c == 1);
+
+        /* Toggling within the same iteration must leave the source working */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 2);
+
+        /* A one-shot source fires once, and needs to be rearmed even if the mask is unchanged */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 3);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 4);
+
+        /* Replacing the fd of an offline source must not keep the old one registered */
+        fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        assert_se(fd >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_io_fd(s, fd) >= 0);
+        TAKE_FD(fd);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(c == 4);
+}
+
+typedef struct BenchmarkContext {
+        sd_event_source **sources;
+        size_t n_sources;
+        size_t next;
+        unsigned n_dispatched;
+} BenchmarkContext;
+
+static int benchmark_io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        BenchmarkContext *ctx = ASSERT_PTR(userdata);
+
+        /* Hand the "token" over to the next source, like a busy daemon switching between connections */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        ctx->next = (ctx->next + 1) % ctx->n_sources;
+        assert_se(sd_event_source_set_enabled(ctx->sources[ctx->next], SD_EVENT_ON) >= 0);
+
+        ctx->n_dispatched++;
+        return 0;
+}
+
+TEST(io_benchmark) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        BenchmarkContext ctx = {};
+        struct rlimit rl;
+        size_t n_iterations;
+        usec_t t;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        (void) rlimit_nofile_bump(-1);
+        assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+
+        ctx.n_sources = slow_tests_enabled() ? 10000 : 1000;
+        if (rl.rlim_cur < ctx.n_sources + 64)
+                ctx.n_sources = rl.rlim_cur > 128 ? rl.rlim_cur - 64 : 64;
+        n_iterations = ctx.n_sources * 10;
+
+        ctx.sources = new0(sd_event_source*, ctx.n_sources);
+        assert_se(ctx.sources);
+
+        FOREACH_ARRAY(i, ctx.sources, ctx.n_sources) {
+                _cleanup_close_ int fd = -EBADF;
+
+                fd = eventfd(1, EFD_CLOEXEC|EFD_NONBLOCK);
+                assert_se(fd >= 0);
+
+                assert_se(sd_event_add_io(e, i, fd, EPOLLIN, benchmark_io_callback, &ctx) >= 0);
+                assert_se(sd_event_source_set_io_fd_own(*i, true) >= 0);
+                TAKE_FD(fd);
+
+                assert_se(sd_event_source_set_enabled(*i, i == ctx.sources ? SD_EVENT_ON : SD_EVENT_OFF) >= 0);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n_iterations; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        assert_se(ctx.n_dispatched == n_iterations);
+
+        log_info("%zu IO sources: %zu iterations in %s, %.0f iterations/s",
+                 ctx.n_sources, n_iterations, FORMAT_TIMESPAN(t, USEC_PER_MSEC),
+                 (double) n_iterations * USEC_PER_SEC / MAX(t, 1u));
+
+        FOREACH_ARRAY(i, ctx.sources, ctx.n_sources)
+                sd_event_source_unref(*i);
+        free(ctx.sources);
+}
+
+static int time_fail_callback(sd_event_source *s, uint64_t usec, void *userdata) {
+        assert_not_reached();
+}
+
+TEST(time_rearm_benchmark) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ sd_event_source **sources = NULL;
+        size_t n_sources, n_rearms;
+        usec_t t, start;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        n_sources = slow_tests_enabled() ? 10000 : 1000;
+        n_rearms = 100000;
+
+        sources = new0(sd_event_source*, n_sources);
+        assert_se(sources);
+
+        FOREACH_ARRAY(i, sources, n_sources)
+                assert_se(sd_event_add_time_relative(e, i, CLOCK_MONOTONIC, USEC_PER_HOUR, 0, time_fail_callback, NULL) >= 0);
+
+        /* Push the timeouts into the future over and over again, like a server with many connections
+         * would do with its per-connection idle timeouts, and run one loop iteration per source re-armed,
+         * which makes the earliest deadline move on every iteration. */
+        start = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n_rearms; i++) {
+                assert_se(sd_event_source_set_time_relative(sources[i % n_sources], USEC_PER_HOUR) >= 0);
+                assert_se(sd_event_run(e, 0) == 0);
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+
+        log_info("%zu timer sources: %zu re-arms in %s, %.0f re-arms/s",
+                 n_sources, n_rearms, FORMAT_TIMESPAN(t, USEC_PER_MSEC),
+                 (double) n_rearms * USEC_PER_SEC / MAX(t, 1u));
+
+        FOREACH_ARRAY(i, sources, n_sources)
+                sd_event_source_unref(*i);
+}
+
+static int statistics_defer_callback(sd_event_source *s, void *userdata) {
+        unsigned *c = ASSERT_PTR(userdata);
+
+        /* Take a bit of time, so that there's something to account */
+        usleep_safe(USEC_PER_MSEC);
+
+        if (++(*c) >= 3)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        return 0;
+}
+
+TEST(statistics) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        uint64_t n, total, max, pending;
+        unsigned c = 0;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_add_defer(e, &s, statistics_defer_callback, &c) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_get_statistics(s, &n, NULL, NULL, NULL) == -ENODATA);
+
+        assert_se(sd_event_set_statistics(e, true) > 0);
+        assert_se(sd_event_get_statistics(e) > 0);
+
+        for (unsigned i = 0; i < 5; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(c == 3);
+
+        assert_se(sd_event_source_get_statistics(s, &n, &total, &max, &pending) >= 0);
+        assert_se(n == 3);
+        assert_se(max >= USEC_PER_MSEC);
+        assert_se(total >= 3 * USEC_PER_MSEC);
+        assert_se(total >= max);
+
+        log_info("Dispatched %" PRIu64 " times, took %s (max %s), pending for %s",
+                 n, FORMAT_TIMESPAN(total, 1), FORMAT_TIMESPAN(max, 1), FORMAT_TIMESPAN(pending, 1));
+
+        assert_se(sd_event_set_statistics(e, false) == 0);
+        assert_se(sd_event_source_get_statistics(s, &n, NULL, NULL, NULL) == -ENODATA);
+}
+
 static int hup_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         unsigned *c = userdata;
 
@@ -108,12 +108,14 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_values_seen; /* payloads already returned, so that we needn't look for them in other files */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
         uint64_t fields_offset;
         uint64_t fields_hash_table_index;
         char *fields_buffer;
+        Set *fields_seen; /* field names already returned, so that we needn't look for them in other files */
 
         int flags;
 
@@ -143,6 +145,14 @@ int journal_get_directories(sd_journal *j, char ***ret);
 int journal_add_match_pair(sd_journal *j, const char *field, const char *value);
 int journal_add_matchf(sd_journal *j, const char *format, ...) _printf_(2, 3);
 
+typedef struct JournalUniqueCount {
+        struct iovec data;    /* "FIELD=value" */
+        uint64_t n_entries;
+} JournalUniqueCount;
+
+void journal_unique_count_array_free(JournalUniqueCount *a, size_t n);
+int journal_get_unique_counts(sd_journal *j, const char *field, size_t n_max, JournalUniqueCount **ret, size_t *ret_n);
+
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
 
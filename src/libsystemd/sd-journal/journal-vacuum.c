@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -8,13 +11,19 @@
 
 #include "alloc-util.h"
 #include "dirent-util.h"
+#include "errno-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
+#include "inotify-util.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-internal.h"
 #include "journal-vacuum.h"
+#include "prioq.h"
+#include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
 #include "time-util.h"
@@ -29,8 +38,34 @@ typedef struct vacuum_info {
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        unsigned prioq_idx;
 } vacuum_info;
 
+typedef enum VacuumFileType {
+        VACUUM_FILE_IGNORE,   /* not a journal file, never touched */
+        VACUUM_FILE_ACTIVE,   /* online file, or a name we can't parse, counted but never vacuumed */
+        VACUUM_FILE_EMPTY,    /* archived file without entries, always vacuumed */
+        VACUUM_FILE_ARCHIVED, /* archived file, vacuumed oldest first */
+} VacuumFileType;
+
+struct JournalVacuumCatalog {
+        char *directory;
+        int dir_fd;
+        int inotify_fd;
+
+        /* Archived files by name, and the same sorted so that the next file to vacuum is on top */
+        Hashmap *archived;
+        Prioq *queue;
+        uint64_t archived_usage;
+
+        /* Active files grow all the time, hence we only track their names and stat them when needed */
+        Set *active;
+        Set *empty;
+
+        bool dirty;
+};
+
 static int vacuum_info_compare(const vacuum_info *a, const vacuum_info *b) {
         int r;
 
@@ -48,16 +83,23 @@ static int vacuum_info_compare(const vacuum_info *a, const vacuum_info *b) {
         return strcmp(a->filename, b->filename);
 }
 
-static void vacuum_info_array_free(vacuum_info *list, size_t n) {
-        if (!list)
-                return;
+static int vacuum_info_prioq_compare(const void *a, const void *b) {
+        return vacuum_info_compare(a, b);
+}
 
-        FOREACH_ARRAY(i, list, n)
-                free(i->filename);
+static vacuum_info* vacuum_info_free(vacuum_info *i) {
+        if (!i)
+                return NULL;
 
-        free(list);
+        free(i->filename);
+        return mfree(i);
 }
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(vacuum_info*, vacuum_info_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(vacuum_info_hash_ops, char, string_hash_func, string_compare_func,
+                                              vacuum_info, vacuum_info_free);
+
 static void patch_realtime(
                 int fd,
                 const char *fn,
@@ -125,206 +167,615 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
-                const char *directory,
-                uint64_t max_use,
-                uint64_t n_max_files,
-                usec_t max_retention_usec,
-                usec_t *oldest_usec,
-                bool verbose) {
+static VacuumFileType vacuum_file_classify(int dir_fd, const char *name, vacuum_info *ret) {
+        unsigned long long seqnum = 0, realtime;
+        sd_id128_t seqnum_id;
+        bool have_seqnum;
+        uint64_t size;
+        struct stat st;
+        size_t q;
+        int r;
 
-        uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, i;
-        _cleanup_closedir_ DIR *d = NULL;
-        vacuum_info *list = NULL;
-        usec_t retention_limit = 0;
+        /* Determines how the specified directory entry is to be treated by vacuuming. For archived files
+         * the information we order them by is filled into 'ret' (with 'filename' left unset), for active
+         * files just the usage. Returns a negative errno if the file can't be looked at. */
+
+        assert(dir_fd >= 0);
+        assert(name);
+        assert(ret);
+
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return VACUUM_FILE_IGNORE;
+
+        size = 512UL * (uint64_t) st.st_blocks;
+
+        *ret = (vacuum_info) {
+                .usage = size,
+                .prioq_idx = PRIOQ_IDX_NULL,
+        };
+
+        q = strlen(name);
+
+        if (endswith(name, ".journal")) {
+                _cleanup_free_ char *id = NULL;
+
+                /* Vacuum archived files. Active files are
+                 * left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        return VACUUM_FILE_ACTIVE;
+
+                if (name[q-8-16-1] != '-' ||
+                    name[q-8-16-1-16-1] != '-' ||
+                    name[q-8-16-1-16-1-32-1] != '@')
+                        return VACUUM_FILE_ACTIVE;
+
+                id = strndup(name + q-8-16-1-16-1-32, 32);
+                if (!id)
+                        return -ENOMEM;
+
+                if (sd_id128_from_string(id, &seqnum_id) < 0)
+                        return VACUUM_FILE_ACTIVE;
+
+                if (sscanf(name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        return VACUUM_FILE_ACTIVE;
+
+                have_seqnum = true;
+
+        } else if (endswith(name, ".journal~")) {
+                unsigned long long tmp;
+
+                /* seqnum_id won't be initialised before use below, so set to 0 */
+                seqnum_id = SD_ID128_NULL;
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        return VACUUM_FILE_ACTIVE;
+
+                if (name[q-1-8-16-1] != '-' ||
+                    name[q-1-8-16-1-16-1] != '@')
+                        return VACUUM_FILE_ACTIVE;
+
+                if (sscanf(name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        return VACUUM_FILE_ACTIVE;
+
+                have_seqnum = false;
+        } else {
+                /* We do not vacuum unknown files! */
+                log_debug("Not vacuuming unknown file %s.", name);
+                return VACUUM_FILE_IGNORE;
+        }
+
+        r = journal_file_empty(dir_fd, name);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                return VACUUM_FILE_EMPTY;
+
+        patch_realtime(dir_fd, name, &st, &realtime);
+
+        ret->seqnum = seqnum;
+        ret->realtime = realtime;
+        ret->seqnum_id = seqnum_id;
+        ret->have_seqnum = have_seqnum;
+
+        return VACUUM_FILE_ARCHIVED;
+}
+
+static void catalog_forget(JournalVacuumCatalog *c, const char *name) {
+        vacuum_info *i;
+
+        assert(c);
+        assert(name);
+
+        i = hashmap_remove(c->archived, name);
+        if (i) {
+                prioq_remove(c->queue, i, &i->prioq_idx);
+                c->archived_usage = LESS_BY(c->archived_usage, i->usage);
+                vacuum_info_free(i);
+        }
+
+        free(set_remove(c->active, name));
+        free(set_remove(c->empty, name));
+}
+
+static int catalog_update(JournalVacuumCatalog *c, const char *name) {
+        _cleanup_(vacuum_info_freep) vacuum_info *i = NULL;
+        vacuum_info info;
         int r;
 
-        CLEANUP_ARRAY(list, n_list, vacuum_info_array_free);
+        assert(c);
+        assert(name);
 
-        assert(directory);
+        catalog_forget(c, name);
 
-        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+        r = vacuum_file_classify(c->dir_fd, name, &info);
+        if (r == -ENOENT)
+                return 0;
+        if (r == -ENOMEM)
+                return r;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to inspect %s/%s while vacuuming, ignoring: %m", c->directory, name);
                 return 0;
+        }
 
-        if (max_retention_usec > 0)
-                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+        switch (r) {
+
+        case VACUUM_FILE_IGNORE:
+                return 0;
+
+        case VACUUM_FILE_ACTIVE:
+                return set_put_strdup(&c->active, name);
+
+        case VACUUM_FILE_EMPTY:
+                return set_put_strdup(&c->empty, name);
+
+        case VACUUM_FILE_ARCHIVED:
+                i = newdup(vacuum_info, &info, 1);
+                if (!i)
+                        return -ENOMEM;
+
+                i->filename = strdup(name);
+                if (!i->filename)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_put(&c->archived, &vacuum_info_hash_ops, i->filename, i);
+                if (r < 0)
+                        return r;
+
+                r = prioq_ensure_put(&c->queue, vacuum_info_prioq_compare, i, &i->prioq_idx);
+                if (r < 0) {
+                        hashmap_remove(c->archived, i->filename);
+                        return r;
+                }
 
-        d = opendir(directory);
+                c->archived_usage += TAKE_PTR(i)->usage;
+                return 0;
+
+        default:
+                assert_not_reached();
+        }
+}
+
+static int catalog_rescan(JournalVacuumCatalog *c) {
+        _cleanup_closedir_ DIR *d = NULL;
+        vacuum_info *i;
+        int r;
+
+        assert(c);
+
+        while ((i = prioq_pop(c->queue)))
+                i->prioq_idx = PRIOQ_IDX_NULL;
+        c->archived = hashmap_free(c->archived);
+        c->archived_usage = 0;
+        c->active = set_free(c->active);
+        c->empty = set_free(c->empty);
+
+        d = xopendirat(c->dir_fd, ".", O_NOFOLLOW);
         if (!d)
                 return -errno;
 
         FOREACH_DIRENT_ALL(de, d, return -errno) {
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
-                struct stat st;
-                size_t q;
+                r = catalog_update(c, de->d_name);
+                if (r < 0)
+                        return r;
+        }
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
-                        continue;
-                }
+        c->dirty = false;
+        return 0;
+}
 
-                if (!S_ISREG(st.st_mode))
-                        continue;
+int journal_vacuum_catalog_new(JournalVacuumCatalog **ret, const char *directory, bool watch) {
+        _cleanup_(journal_vacuum_catalog_freep) JournalVacuumCatalog *c = NULL;
+        int r;
 
-                size = 512UL * (uint64_t) st.st_blocks;
+        assert(ret);
+        assert(directory);
 
-                q = strlen(de->d_name);
+        c = new(JournalVacuumCatalog, 1);
+        if (!c)
+                return -ENOMEM;
 
-                if (endswith(de->d_name, ".journal")) {
+        *c = (JournalVacuumCatalog) {
+                .dir_fd = -EBADF,
+                .inotify_fd = -EBADF,
+                .dirty = true,
+        };
 
-                        /* Vacuum archived files. Active files are
-                         * left around */
+        c->directory = strdup(directory);
+        if (!c->directory)
+                return -ENOMEM;
 
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
-                                sum += size;
-                                continue;
-                        }
+        c->dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (c->dir_fd < 0)
+                return -errno;
 
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                sum += size;
-                                continue;
-                        }
+        if (watch) {
+                c->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                if (c->inotify_fd < 0)
+                        return -errno;
 
-                        p = strdup(de->d_name);
-                        if (!p)
-                                return -ENOMEM;
+                /* IN_CLOSE_WRITE is needed as freshly archived files are still offlined (and trimmed) after
+                 * they have been renamed. */
+                r = inotify_add_watch_fd(c->inotify_fd, c->dir_fd,
+                                         IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_CLOSE_WRITE|
+                                         IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR);
+                if (r < 0)
+                        return r;
+        }
 
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
-                                sum += size;
-                                continue;
-                        }
+        r = catalog_rescan(c);
+        if (r < 0)
+                return r;
 
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
-                                sum += size;
-                                continue;
-                        }
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+JournalVacuumCatalog* journal_vacuum_catalog_free(JournalVacuumCatalog *c) {
+        if (!c)
+                return NULL;
+
+        prioq_free(c->queue);
+        hashmap_free(c->archived);
+        set_free(c->active);
+        set_free(c->empty);
+
+        safe_close(c->inotify_fd);
+        safe_close(c->dir_fd);
+        free(c->directory);
+
+        return mfree(c);
+}
 
-                        have_seqnum = true;
+int journal_vacuum_catalog_get_fd(JournalVacuumCatalog *c) {
+        assert(c);
 
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
+        return c->inotify_fd;
+}
+
+int journal_vacuum_catalog_process(JournalVacuumCatalog *c) {
+        int r;
+
+        assert(c);
+
+        /* Applies all pending directory changes to the catalog. Returns -ENOENT if the directory went away,
+         * in which case the catalog is useless and should be freed. */
+
+        if (c->inotify_fd < 0)
+                return 0;
 
-                        /* seqnum_id won't be initialised before use below, so set to 0 */
-                        seqnum_id = SD_ID128_NULL;
+        for (;;) {
+                union inotify_event_buffer buffer;
+                ssize_t l;
 
-                        /* Vacuum corrupted files */
+                l = read(c->inotify_fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (ERRNO_IS_TRANSIENT(errno))
+                                return 0;
 
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                sum += size;
+                        return -errno;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        if (e->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_UNMOUNT|IN_IGNORED))
+                                return -ENOENT;
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                log_debug("Inotify queue overrun for %s, rescanning on next vacuum.", c->directory);
+                                c->dirty = true;
                                 continue;
                         }
 
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
-                                sum += size;
+                        if (c->dirty || e->len == 0 || (e->mask & IN_ISDIR))
                                 continue;
+
+                        if (e->mask & (IN_DELETE|IN_MOVED_FROM))
+                                catalog_forget(c, e->name);
+                        else {
+                                r = catalog_update(c, e->name);
+                                if (r < 0) {
+                                        log_debug_errno(r, "Failed to update vacuum catalog of %s, rescanning on next vacuum: %m",
+                                                        c->directory);
+                                        c->dirty = true;
+                                }
                         }
+                }
+        }
+}
 
-                        p = strdup(de->d_name);
-                        if (!p)
-                                return -ENOMEM;
+static int catalog_refresh(JournalVacuumCatalog *c) {
+        int r;
 
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                sum += size;
-                                continue;
-                        }
+        assert(c);
 
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
-                }
+        r = journal_vacuum_catalog_process(c);
+        if (r < 0)
+                return r;
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+        if (!c->dirty)
+                return 0;
+
+        return catalog_rescan(c);
+}
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+static uint64_t catalog_set_usage(JournalVacuumCatalog *c, Set *s) {
+        uint64_t sum = 0;
+        const char *name;
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, FORMAT_BYTES(size));
+        assert(c);
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
-                                                            "Failed to delete empty archived journal %s/%s: %m",
-                                                            directory, p);
+        SET_FOREACH(name, s) {
+                struct stat st;
 
+                if (fstatat(c->dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                        log_debug_errno(errno, "Failed to stat file %s/%s while vacuuming, ignoring: %m", c->directory, name);
                         continue;
                 }
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+                sum += 512UL * (uint64_t) st.st_blocks;
+        }
 
-                if (!GREEDY_REALLOC(list, n_list + 1))
-                        return -ENOMEM;
+        return sum;
+}
+
+int journal_vacuum_catalog_usage(JournalVacuumCatalog *c, uint64_t *ret) {
+        int r;
+
+        assert(c);
+        assert(ret);
+
+        r = catalog_refresh(c);
+        if (r < 0)
+                return r;
+
+        *ret = c->archived_usage + catalog_set_usage(c, c->active) + catalog_set_usage(c, c->empty);
+        return 0;
+}
+
+typedef struct VacuumUnlinkJob {
+        char *directory;
+        int dir_fd;
+        vacuum_info **items;
+        size_t n_items;
+        bool verbose;
+} VacuumUnlinkJob;
+
+static VacuumUnlinkJob* vacuum_unlink_job_free(VacuumUnlinkJob *j) {
+        if (!j)
+                return NULL;
+
+        FOREACH_ARRAY(i, j->items, j->n_items)
+                vacuum_info_free(*i);
+        free(j->items);
+
+        safe_close(j->dir_fd);
+        free(j->directory);
+
+        return mfree(j);
+}
 
-                list[n_list++] = (vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
+DEFINE_TRIVIAL_CLEANUP_FUNC(VacuumUnlinkJob*, vacuum_unlink_job_free);
 
-                sum += size;
+static void vacuum_unlink_job_run(VacuumUnlinkJob *j) {
+        int r;
+
+        assert(j);
+
+        FOREACH_ARRAY(i, j->items, j->n_items) {
+                r = unlinkat_deallocate(j->dir_fd, (*i)->filename, 0);
+                if (r >= 0)
+                        log_full(j->verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).",
+                                 j->directory, (*i)->filename, FORMAT_BYTES((*i)->usage));
+                else if (r != -ENOENT)
+                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                                    "Failed to delete archived journal %s/%s: %m",
+                                                    j->directory, (*i)->filename);
         }
+}
+
+static void* vacuum_unlink_thread(void *p) {
+        _cleanup_(vacuum_unlink_job_freep) VacuumUnlinkJob *j = p;
+
+        (void) pthread_setname_np(pthread_self(), "journal-vacuum");
 
-        typesafe_qsort(list, n_list, vacuum_info_compare);
+        vacuum_unlink_job_run(j);
 
-        for (i = 0; i < n_list; i++) {
+        return NULL;
+}
+
+static int vacuum_unlink_job_start(VacuumUnlinkJob *j) {
+        sigset_t ss, saved_ss;
+        pthread_t t;
+        int r, k;
+
+        assert(j);
+
+        /* Deallocating large files may take a while on some file systems, hence do it in a thread of its
+         * own. The thread takes ownership of the job. */
+
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&t, NULL, vacuum_unlink_thread, j);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        assert_se(pthread_detach(t) == 0);
+
+        if (k > 0)
+                log_debug_errno(k, "Failed to restore signal mask, ignoring: %m");
+
+        return 0;
+}
+
+int journal_vacuum_catalog_vacuum(
+                JournalVacuumCatalog *c,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                JournalVacuumFlags flags) {
+
+        _cleanup_(vacuum_unlink_job_freep) VacuumUnlinkJob *job = NULL;
+        bool verbose = FLAGS_SET(flags, JOURNAL_VACUUM_VERBOSE);
+        uint64_t sum, freed = 0, n_active_files;
+        usec_t retention_limit = 0;
+        vacuum_info *i;
+        char *name;
+        int r;
+
+        assert(c);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        r = catalog_refresh(c);
+        if (r < 0)
+                return r;
+
+        if (max_retention_usec > 0)
+                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+
+        /* Always vacuum empty non-online files. These are small, no need to bother with a thread. */
+        while ((name = set_steal_first(c->empty))) {
+                _cleanup_free_ char *p = name;
+                uint64_t size = 0;
+                struct stat st;
+
+                if (fstatat(c->dir_fd, p, &st, AT_SYMLINK_NOFOLLOW) >= 0)
+                        size = 512UL * (uint64_t) st.st_blocks;
+
+                r = unlinkat_deallocate(c->dir_fd, p, 0);
+                if (r >= 0) {
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG,
+                                 "Deleted empty archived journal %s/%s (%s).", c->directory, p, FORMAT_BYTES(size));
+
+                        freed += size;
+                } else if (r != -ENOENT)
+                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                                    "Failed to delete empty archived journal %s/%s: %m",
+                                                    c->directory, p);
+        }
+
+        n_active_files = set_size(c->active);
+        sum = c->archived_usage + catalog_set_usage(c, c->active);
+
+        while ((i = prioq_peek(c->queue))) {
+                _cleanup_(vacuum_info_freep) vacuum_info *taken = NULL;
                 uint64_t left;
 
-                left = n_active_files + n_list - i;
+                left = n_active_files + prioq_size(c->queue);
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
+                if ((max_retention_usec <= 0 || i->realtime >= retention_limit) &&
                     (max_use <= 0 || sum <= max_use) &&
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).",
-                                 directory, list[i].filename, FORMAT_BYTES(list[i].usage));
-                        freed += list[i].usage;
+                /* Drop it from the catalog right-away, the inotify event for the removal is ignored later
+                 * on as the file is unknown by then. */
+                taken = hashmap_remove(c->archived, i->filename);
+                assert(taken == i);
+                assert_se(prioq_pop(c->queue) == i);
+                i->prioq_idx = PRIOQ_IDX_NULL;
+                c->archived_usage = LESS_BY(c->archived_usage, i->usage);
+
+                freed += i->usage;
+
+                if (FLAGS_SET(flags, JOURNAL_VACUUM_ASYNC)) {
+                        sum = LESS_BY(sum, i->usage);
+
+                        if (!job) {
+                                job = new(VacuumUnlinkJob, 1);
+                                if (!job)
+                                        return -ENOMEM;
+
+                                *job = (VacuumUnlinkJob) {
+                                        .dir_fd = fcntl(c->dir_fd, F_DUPFD_CLOEXEC, 3),
+                                        .directory = strdup(c->directory),
+                                        .verbose = verbose,
+                                };
+                                if (job->dir_fd < 0)
+                                        return -errno;
+                                if (!job->directory)
+                                        return -ENOMEM;
+                        }
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+                        if (!GREEDY_REALLOC(job->items, job->n_items + 1))
+                                return -ENOMEM;
 
-                } else if (r != -ENOENT)
+                        job->items[job->n_items++] = TAKE_PTR(taken);
+                        continue;
+                }
+
+                r = unlinkat_deallocate(c->dir_fd, i->filename, 0);
+                if (r >= 0)
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).",
+                                 c->directory, i->filename, FORMAT_BYTES(i->usage));
+                else if (r != -ENOENT) {
                         log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
                                                     "Failed to delete archived journal %s/%s: %m",
-                                                    directory, list[i].filename);
+                                                    c->directory, i->filename);
+
+                        /* The file is still there, but not in the catalog anymore. Its usage still counts
+                         * towards the limit, so that we go on with the next one. */
+                        freed -= i->usage;
+                        c->dirty = true;
+                        continue;
+                }
+
+                sum = LESS_BY(sum, i->usage);
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        i = prioq_peek(c->queue);
+        if (oldest_usec && i && (*oldest_usec == 0 || i->realtime < *oldest_usec))
+                *oldest_usec = i->realtime;
 
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.",
-                 FORMAT_BYTES(freed), directory);
+        if (job) {
+                r = vacuum_unlink_job_start(job);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to start vacuuming thread, deleting synchronously: %m");
+                        vacuum_unlink_job_run(job);
+                } else
+                        TAKE_PTR(job);
+        }
+
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, %s %s of archived journals from %s.",
+                 FLAGS_SET(flags, JOURNAL_VACUUM_ASYNC) ? "freeing" : "freed", FORMAT_BYTES(freed), c->directory);
 
         return 0;
 }
+
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        _cleanup_(journal_vacuum_catalog_freep) JournalVacuumCatalog *c = NULL;
+        int r;
+
+        assert(directory);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        r = journal_vacuum_catalog_new(&c, directory, /* watch= */ false);
+        if (r < 0)
+                return r;
+
+        return journal_vacuum_catalog_vacuum(c, max_use, n_max_files, max_retention_usec, oldest_usec,
+                                             verbose ? JOURNAL_VACUUM_VERBOSE : 0);
+}
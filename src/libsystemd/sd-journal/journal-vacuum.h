@@ -4,6 +4,26 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
+/* A catalog of the journal files in a directory, for callers that vacuum the same directory over and over
+ * again. If watching is enabled, it is kept up-to-date via inotify instead of rescanning the directory on
+ * each vacuuming. */
+typedef struct JournalVacuumCatalog JournalVacuumCatalog;
+
+typedef enum JournalVacuumFlags {
+        JOURNAL_VACUUM_VERBOSE = 1 << 0,
+        JOURNAL_VACUUM_ASYNC   = 1 << 1, /* deallocate removed files in a background thread */
+} JournalVacuumFlags;
+
+int journal_vacuum_catalog_new(JournalVacuumCatalog **ret, const char *directory, bool watch);
+JournalVacuumCatalog* journal_vacuum_catalog_free(JournalVacuumCatalog *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumCatalog*, journal_vacuum_catalog_free);
+
+int journal_vacuum_catalog_get_fd(JournalVacuumCatalog *c);
+int journal_vacuum_catalog_process(JournalVacuumCatalog *c);
+int journal_vacuum_catalog_usage(JournalVacuumCatalog *c, uint64_t *ret);
+int journal_vacuum_catalog_vacuum(JournalVacuumCatalog *c, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, JournalVacuumFlags flags);
@@ -27,11 +27,13 @@
 #include "id128-util.h"
 #include "inotify-util.h"
 #include "io-util.h"
+#include "iovec-util.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-internal.h"
 #include "list.h"
 #include "lookup3.h"
+#include "memory-util.h"
 #include "nulstr-util.h"
 #include "origin-id.h"
 #include "path-util.h"
@@ -2500,7 +2502,9 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->prefix);
         free(j->namespace);
         free(j->unique_field);
+        set_free(j->unique_values_seen);
         free(j->fields_buffer);
+        set_free(j->fields_seen);
         free(j);
 }
 
@@ -3268,10 +3272,38 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        set_clear(j->unique_values_seen);
 
         return 0;
 }
 
+static void unique_value_hash_func(const struct iovec *v, struct siphash *state) {
+        siphash24_compress_safe(v->iov_base, v->iov_len, state);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(unique_value_hash_ops, struct iovec, unique_value_hash_func, iovec_memcmp, free);
+
+static int unique_value_put(Set **s, const void *data, size_t size) {
+        struct iovec *v;
+
+        assert(s);
+        assert(data || size == 0);
+
+        /* Returns 0 if we have seen this payload before, > 0 otherwise. The iovec and the copy of the
+         * payload are allocated as one. */
+
+        if (set_contains(*s, &IOVEC_MAKE((void*) data, size)))
+                return 0;
+
+        v = malloc(sizeof(struct iovec) + size);
+        if (!v)
+                return -ENOMEM;
+
+        *v = IOVEC_MAKE(memcpy_safe(v + 1, data, size), size);
+
+        return set_ensure_consume(s, &unique_value_hash_ops, v);
+}
+
 _public_ int sd_journal_enumerate_unique(
                 sd_journal *j,
                 const void **ret_data,
@@ -3297,11 +3329,9 @@ _public_ int sd_journal_enumerate_unique(
         }
 
         for (;;) {
-                JournalFile *of;
                 Object *o;
                 void *odata;
                 size_t ol;
-                bool found;
                 int r;
 
                 /* Proceed to next data object in the field's linked list */
@@ -3332,11 +3362,6 @@ _public_ int sd_journal_enumerate_unique(
                 if (r < 0)
                         return r;
 
-                /* Let's pin the data object, so we can look at it at the same time as one on another file. */
-                r = journal_file_pin_object(j->unique_file, o);
-                if (r < 0)
-                        return r;
-
                 r = journal_file_data_payload(j->unique_file, o, j->unique_offset, NULL, 0,
                                               j->data_threshold, &odata, &ol);
                 if (r < 0)
@@ -3356,33 +3381,13 @@ _public_ int sd_journal_enumerate_unique(
                                                j->unique_offset,
                                                j->unique_field);
 
-                /* OK, now let's see if we already returned this data object by checking if it exists in the
-                 * earlier traversed files. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files) {
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        /* We can reuse the hash from our current file only on old-style journal files
-                         * without keyed hashes. On new-style files we have to calculate the hash anew, to
-                         * take the per-file hash seed into consideration. */
-                        if (!JOURNAL_HEADER_KEYED_HASH(j->unique_file->header) && !JOURNAL_HEADER_KEYED_HASH(of->header))
-                                r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        else
-                                r = journal_file_find_data_object(of, odata, ol, NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
+                /* OK, now let's see if we already returned this data object. Data objects are unique within
+                 * a file, hence we only need to remember payloads from earlier files. Doing so is much cheaper
+                 * than looking each payload up in all earlier files, which gets expensive with many files. */
+                r = unique_value_put(&j->unique_values_seen, odata, ol);
+                if (r < 0)
+                        return r;
+                if (r == 0)
                         continue;
 
                 *ret_data = odata;
@@ -3413,6 +3418,141 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        set_clear(j->unique_values_seen);
+}
+
+typedef struct UniqueCounter {
+        struct iovec data; /* must be first, used as hash key */
+        uint64_t n_entries;
+} UniqueCounter;
+
+static int unique_counter_compare(UniqueCounter * const *a, UniqueCounter * const *b) {
+        int r;
+
+        /* Most frequent first */
+        r = CMP((*b)->n_entries, (*a)->n_entries);
+        if (r != 0)
+                return r;
+
+        return iovec_memcmp(&(*a)->data, &(*b)->data);
+}
+
+void journal_unique_count_array_free(JournalUniqueCount *a, size_t n) {
+        FOREACH_ARRAY(i, a, n)
+                free(i->data.iov_base);
+
+        free(a);
+}
+
+int journal_get_unique_counts(
+                sd_journal *j,
+                const char *field,
+                size_t n_max,
+                JournalUniqueCount **ret,
+                size_t *ret_n) {
+
+        _cleanup_set_free_ Set *counters = NULL;
+        _cleanup_free_ UniqueCounter **sorted = NULL;
+        JournalUniqueCount *counts = NULL;
+        size_t k, n = 0, n_counts = 0;
+        UniqueCounter *c;
+        JournalFile *f;
+        int r;
+
+        CLEANUP_ARRAY(counts, n_counts, journal_unique_count_array_free);
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Determines the values of the specified field together with the number of entries referencing
+         * them, most frequent first. This is cheap, as the per-file counters in the data objects are used,
+         * but approximate: matches are not taken into account, and neither are the number of entries that
+         * show up in multiple files. */
+
+        if (!field_is_valid(field))
+                return -EINVAL;
+
+        k = strlen(field);
+
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
+                uint64_t p;
+                Object *o;
+
+                r = journal_file_find_field_object(f, field, k, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                for (p = le64toh(o->field.head_data_offset); p != 0;) {
+                        uint64_t n_entries;
+                        void *data;
+                        size_t l;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        /* Read these first, getting the payload might move the mmap window */
+                        n_entries = le64toh(o->data.n_entries);
+                        p = le64toh(o->data.next_field_offset);
+
+                        r = journal_file_data_payload(f, o, 0, NULL, 0, j->data_threshold, &data, &l);
+                        if (JOURNAL_ERRNO_IS_UNAVAILABLE_FIELD(r))
+                                continue;
+                        if (r < 0)
+                                return r;
+
+                        c = set_get(counters, &IOVEC_MAKE(data, l));
+                        if (!c) {
+                                c = malloc(sizeof(UniqueCounter) + l);
+                                if (!c)
+                                        return -ENOMEM;
+
+                                *c = (UniqueCounter) {
+                                        .data = IOVEC_MAKE(memcpy_safe(c + 1, data, l), l),
+                                };
+
+                                r = set_ensure_consume(&counters, &unique_value_hash_ops, c);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        c->n_entries = saturate_add(c->n_entries, n_entries, UINT64_MAX);
+                }
+        }
+
+        sorted = new(UniqueCounter*, set_size(counters));
+        if (!sorted)
+                return -ENOMEM;
+
+        SET_FOREACH(c, counters)
+                sorted[n++] = c;
+
+        typesafe_qsort(sorted, n, unique_counter_compare);
+
+        n = MIN(n, n_max);
+
+        counts = new(JournalUniqueCount, n);
+        if (!counts)
+                return -ENOMEM;
+
+        FOREACH_ARRAY(i, sorted, n) {
+                struct iovec v;
+
+                if (!iovec_memdup(&(*i)->data, &v))
+                        return -ENOMEM;
+
+                counts[n_counts++] = (JournalUniqueCount) {
+                        .data = v,
+                        .n_entries = (*i)->n_entries,
+                };
+        }
+
+        *ret = TAKE_PTR(counts);
+        *ret_n = TAKE_GENERIC(n_counts, size_t, 0);
+        return 0;
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -3435,11 +3575,10 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
         }
 
         for (;;) {
-                JournalFile *f, *of;
+                JournalFile *f;
                 uint64_t m;
                 Object *o;
                 size_t sz;
-                bool found;
 
                 f = j->fields_file;
 
@@ -3510,45 +3649,27 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
 
                 sz = le64toh(o->object.size) - offsetof(Object, field.payload);
 
-                /* Let's see if we already returned this field name before. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files) {
-                        if (of == f)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        if (!JOURNAL_HEADER_KEYED_HASH(f->header) && !JOURNAL_HEADER_KEYED_HASH(of->header))
-                                r = journal_file_find_field_object_with_hash(of, o->field.payload, sz,
-                                                                             le64toh(o->field.hash), NULL, NULL);
-                        else
-                                r = journal_file_find_field_object(of, o->field.payload, sz, NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
-                        continue;
-
                 /* Check if this is really a valid string containing no NUL byte */
                 if (memchr(o->field.payload, 0, sz))
                         return -EBADMSG;
 
-                if (j->data_threshold > 0 && sz > j->data_threshold)
-                        sz = j->data_threshold;
-
                 if (!GREEDY_REALLOC(j->fields_buffer, sz + 1))
                         return -ENOMEM;
 
                 memcpy(j->fields_buffer, o->field.payload, sz);
                 j->fields_buffer[sz] = 0;
 
+                /* Let's see if we already returned this field name before. We remember the names rather than
+                 * looking them up in all files iterated before, as that gets expensive with many files. */
+                r = set_put_strdup(&j->fields_seen, j->fields_buffer);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                if (j->data_threshold > 0 && sz > j->data_threshold)
+                        j->fields_buffer[j->data_threshold] = 0;
+
                 if (!field_is_valid(j->fields_buffer))
                         return -EBADMSG;
 
@@ -3565,6 +3686,7 @@ _public_ void sd_journal_restart_fields(sd_journal *j) {
         j->fields_hash_table_index = 0;
         j->fields_offset = 0;
         j->fields_file_lost = false;
+        set_clear(j->fields_seen);
 }
 
 _public_ int sd_journal_reliable_fd(sd_journal *j) {
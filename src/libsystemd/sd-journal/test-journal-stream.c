@@ -66,8 +66,10 @@ static void run_test(void) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         char *z;
         const void *data;
-        size_t l;
+        size_t l, n_counts;
         dual_timestamp previous_ts = DUAL_TIMESTAMP_NULL;
+        JournalUniqueCount *counts;
+        unsigned n_unique;
 
         m = mmap_cache_new();
         assert_se(m != NULL);
@@ -168,9 +170,49 @@ static void run_test(void) {
 
         verify_contents(j, 0);
 
+        /* Entries in two.journal are also in one.journal, each value must still be reported once */
         assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+        n_unique = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
                 printf("%.*s\n", (int) l, (const char*) data);
+                n_unique++;
+        }
+        assert_se(n_unique == N_ENTRIES);
+
+        assert_se(journal_get_unique_counts(j, "MAGIC", SIZE_MAX, &counts, &n_counts) >= 0);
+        assert_se(n_counts == 2);
+        assert_se(iovec_memcmp(&counts[0].data, &IOVEC_MAKE_STRING("MAGIC=waldo")) == 0);
+        assert_se(iovec_memcmp(&counts[1].data, &IOVEC_MAKE_STRING("MAGIC=quux")) == 0);
+        assert_se(counts[0].n_entries > counts[1].n_entries);
+        /* The per-file counters count entries in both one.journal and two.journal twice */
+        n_unique = 0;
+        for (i = 0; i < N_ENTRIES; i++)
+                n_unique += 1 + (i % 10 != 0 && i % 3 == 0);
+        assert_se(counts[0].n_entries + counts[1].n_entries == n_unique);
+        journal_unique_count_array_free(counts, n_counts);
+
+        assert_se(journal_get_unique_counts(j, "MAGIC", 1, &counts, &n_counts) >= 0);
+        assert_se(n_counts == 1);
+        assert_se(iovec_memcmp(&counts[0].data, &IOVEC_MAKE_STRING("MAGIC=waldo")) == 0);
+        journal_unique_count_array_free(counts, n_counts);
+
+        /* All three files carry both fields, each must be reported once, also when enumerating again */
+        for (unsigned k = 0; k < 2; k++) {
+                unsigned n_number = 0, n_magic = 0;
+                const char *field;
+
+                SD_JOURNAL_FOREACH_FIELD(j, field) {
+                        if (streq(field, "NUMBER"))
+                                n_number++;
+                        else if (streq(field, "MAGIC"))
+                                n_magic++;
+                        else
+                                assert_not_reached();
+                }
+
+                assert_se(n_number == 1);
+                assert_se(n_magic == 1);
+        }
 
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 }
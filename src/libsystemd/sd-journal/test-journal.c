@@ -4,6 +4,8 @@
 #include <unistd.h>
 
 #include "chattr-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
 #include "iovec-util.h"
 #include "journal-authenticate.h"
 #include "journal-file-util.h"
@@ -174,6 +176,72 @@ TEST(empty) {
         test_empty_one();
 }
 
+static unsigned count_archived(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        unsigned n = 0;
+
+        assert_se(d = opendir("."));
+
+        FOREACH_DIRENT(de, d, assert_not_reached())
+                if (startswith(de->d_name, "test@"))
+                        n++;
+
+        return n;
+}
+
+static void append_and_rotate(JournalFile **f, MMapCache *m) {
+        static const char test[] = "TEST1=1";
+        struct iovec iovec = IOVEC_MAKE_STRING(test);
+        dual_timestamp ts;
+
+        assert_se(dual_timestamp_now(&ts));
+        assert_se(journal_file_append_entry(*f, &ts, NULL, &iovec, 1, NULL, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_rotate(f, m, 0, UINT64_MAX, NULL) >= 0);
+}
+
+TEST(vacuum_catalog) {
+        _cleanup_(journal_vacuum_catalog_freep) JournalVacuumCatalog *c = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        char t[] = "/var/tmp/journal-XXXXXX";
+        JournalFile *f;
+        uint64_t usage;
+
+        assert_se(m = mmap_cache_new());
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-EBADF, "test.journal", O_RDWR|O_CREAT, 0, 0666, UINT64_MAX, NULL, m, NULL, &f) == 0);
+
+        append_and_rotate(&f, m);
+        append_and_rotate(&f, m);
+        assert_se(count_archived() == 2);
+
+        assert_se(journal_vacuum_catalog_new(&c, ".", /* watch= */ true) >= 0);
+        assert_se(journal_vacuum_catalog_usage(c, &usage) >= 0);
+        assert_se(usage > 0);
+
+        /* One active and two archived files, the oldest archived one has to go */
+        assert_se(journal_vacuum_catalog_vacuum(c, 0, 2, 0, NULL, JOURNAL_VACUUM_VERBOSE) >= 0);
+        assert_se(count_archived() == 1);
+
+        /* The newly archived file must be picked up via inotify, and is the one to keep now */
+        append_and_rotate(&f, m);
+        assert_se(count_archived() == 2);
+        assert_se(journal_vacuum_catalog_vacuum(c, 0, 2, 0, NULL, JOURNAL_VACUUM_VERBOSE) >= 0);
+        assert_se(count_archived() == 1);
+
+        /* Nothing left to do */
+        assert_se(journal_vacuum_catalog_vacuum(c, 0, 2, 0, NULL, JOURNAL_VACUUM_VERBOSE) >= 0);
+        assert_se(count_archived() == 1);
+
+        (void) journal_file_offline_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 #if HAVE_COMPRESSION
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
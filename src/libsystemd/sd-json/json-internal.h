@@ -4,9 +4,22 @@
 
 #include "sd-json.h"
 
-/* This header should include all prototypes only the JSON parser itself and
- * its tests need access to. Normal code consuming the JSON parser should not
- * interface with this. */
+/* This header should include all prototypes only the JSON parser itself, the
+ * Varlink transport and their tests need access to. Normal code consuming the
+ * JSON parser should not interface with this. */
+
+/* Refuse putting together variants with a larger depth than 2K by default (as a protection against overflowing stacks
+ * if code processes JSON objects recursively. Note that we store the depth in an uint16_t, hence make sure this
+ * remains under 2^16.
+ *
+ * The value first was 16k, but it was discovered to be too high on llvm/x86-64. See also:
+ * https://github.com/systemd/systemd/issues/10738
+ *
+ * The value then was 4k, but it was discovered to be too high on s390x/aarch64. See also:
+ * https://github.com/systemd/systemd/issues/14396 */
+
+#define DEPTH_MAX (2U*1024U)
+assert_cc(DEPTH_MAX <= UINT16_MAX);
 
 typedef union JsonValue  {
         /* Encodes a simple value. This structure is generally 8 bytes wide (as double is 64-bit). */
@@ -74,3 +87,26 @@ enum { /* JSON tokens */
 };
 
 int json_tokenize(const char **p, char **ret_string, JsonValue *ret_value, unsigned *ret_line, unsigned *ret_column, void **state, unsigned *line, unsigned *column);
+
+/* The CBOR (RFC 8949) major types. Only the subset of CBOR that maps onto the JSON data model is generated
+ * and accepted: integers, text strings, arrays, maps with text string keys, floats, false, true and null,
+ * each with definite length only. */
+enum {
+        CBOR_MAJOR_UNSIGNED,
+        CBOR_MAJOR_NEGATIVE,
+        CBOR_MAJOR_BYTES,
+        CBOR_MAJOR_STRING,
+        CBOR_MAJOR_ARRAY,
+        CBOR_MAJOR_MAP,
+        CBOR_MAJOR_TAG,
+        CBOR_MAJOR_SIMPLE,
+};
+
+/* The largest encoded head of a CBOR data item: the initial byte plus a 64-bit argument */
+#define CBOR_HEAD_MAX 9U
+
+size_t json_cbor_format_head(uint8_t *buf, unsigned major, uint64_t value);
+int json_cbor_parse_head(const uint8_t *p, size_t size, unsigned *ret_major, uint64_t *ret_value);
+
+int json_variant_format_cbor(sd_json_variant *v, uint8_t **ret, size_t *ret_size);
+int json_parse_cbor(const uint8_t *p, size_t size, sd_json_parse_flags_t flags, sd_json_variant **ret);
@@ -140,6 +140,7 @@ enum {
         _JSON_BUILD_STRING_SET,
         _JSON_BUILD_STRING_UNDERSCORIFY,
         _JSON_BUILD_DUAL_TIMESTAMP,
+        _JSON_BUILD_OBJECT_SORTED_BEGIN,
 
         _JSON_BUILD_PAIR_UNSIGNED_NON_ZERO,
         _JSON_BUILD_PAIR_FINITE_USEC,
@@ -168,6 +169,7 @@ enum {
 #define JSON_BUILD_STRING_SET(s) _JSON_BUILD_STRING_SET, (Set *) { s }
 #define JSON_BUILD_STRING_UNDERSCORIFY(s) _JSON_BUILD_STRING_UNDERSCORIFY, (const char *) { s }
 #define JSON_BUILD_DUAL_TIMESTAMP(t) _JSON_BUILD_DUAL_TIMESTAMP, (dual_timestamp*) { t }
+#define JSON_BUILD_OBJECT_SORTED(...) _JSON_BUILD_OBJECT_SORTED_BEGIN, __VA_ARGS__, _SD_JSON_BUILD_OBJECT_END
 
 #define JSON_BUILD_PAIR_UNSIGNED_NON_ZERO(name, u) _JSON_BUILD_PAIR_UNSIGNED_NON_ZERO, (const char*) { name }, (uint64_t) { u }
 #define JSON_BUILD_PAIR_FINITE_USEC(name, u) _JSON_BUILD_PAIR_FINITE_USEC, (const char*) { name }, (usec_t) { u }
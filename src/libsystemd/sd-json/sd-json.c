@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -11,6 +12,7 @@
 
 #include "alloc-util.h"
 #include "ansi-color.h"
+#include "bitfield.h"
 #include "errno-util.h"
 #include "escape.h"
 #include "ether-addr-util.h"
@@ -23,31 +25,32 @@
 #include "iovec-util.h"
 #include "json-internal.h"
 #include "json-util.h"
+#include "logarithm.h"
 #include "macro.h"
 #include "math-util.h"
 #include "memory-util.h"
 #include "memstream-util.h"
 #include "path-util.h"
+#include "random-util.h"
 #include "set.h"
+#include "siphash24.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
-/* Refuse putting together variants with a larger depth than 2K by default (as a protection against overflowing stacks
- * if code processes JSON objects recursively. Note that we store the depth in an uint16_t, hence make sure this
- * remains under 2^16.
- *
- * The value first was 16k, but it was discovered to be too high on llvm/x86-64. See also:
- * https://github.com/systemd/systemd/issues/10738
- *
- * The value then was 4k, but it was discovered to be too high on s390x/aarch64. See also:
- * https://github.com/systemd/systemd/issues/14396 */
-
-#define DEPTH_MAX (2U*1024U)
-assert_cc(DEPTH_MAX <= UINT16_MAX);
+/* The vectorized scanner reads whole aligned blocks, possibly beyond the end of the string. That's safe, but
+ * the sanitizers can't know, hence use the plain loop there. */
+#if defined(__SSE2__) && !HAS_FEATURE_ADDRESS_SANITIZER && !HAS_FEATURE_MEMORY_SANITIZER
+#  include <emmintrin.h>
+#  define JSON_SCAN_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !HAS_FEATURE_ADDRESS_SANITIZER && !HAS_FEATURE_MEMORY_SANITIZER
+#  include <arm_neon.h>
+#  define JSON_SCAN_NEON 1
+#endif
 
 typedef struct JsonSource {
         /* When we parse from a file or similar, encodes the filename, to indicate the source of a json variant */
@@ -107,6 +110,14 @@ struct sd_json_variant {
         /* If in addition to this object all objects referenced by it are also ordered strictly by name */
         bool normalized:1;
 
+        /* If true, this variant was allocated from a JsonArena (see below), together with all variants it
+         * references. */
+        bool in_arena:1;
+
+        /* If true, this is a large object, and the elements are followed by a pointer to its hash index, see
+         * json_variant_object_index() below. */
+        bool has_index:1;
+
         union {
                 /* For simple types we store the value in-line. */
                 JsonValue value;
@@ -138,6 +149,44 @@ assert_cc(sizeof(sd_json_variant) == 40U);
 assert_cc(INLINE_STRING_MAX == 7U);
 #endif
 
+/* When parsing with SD_JSON_PARSE_ARENA, all variants of the resulting tree are allocated from a series of
+ * blocks, which are freed in one go. Each variant allocated from the arena is embedded into the 'anchor'
+ * variant of the first block, which hence carries the reference counter of the whole tree. Members of the
+ * tree don't take references on each other, and are never freed individually.
+ *
+ * Variants of the default size only carry scalars and short strings, which are copied into the arrays and
+ * objects they are placed in, see json_variant_set(). They are only needed while parsing, hence are taken
+ * from separate 'scratch' blocks, which are released once parsing is complete. */
+typedef struct JsonArena JsonArena;
+
+struct JsonArena {
+        /* Only used in the first block */
+        sd_json_variant anchor;
+        JsonArena *blocks;        /* the block currently allocated from, then the older ones via 'next' */
+        JsonArena *scratch;       /* ditto, for the scratch blocks */
+        sd_json_variant *unused;  /* variants from the scratch blocks that can be reused */
+
+        JsonArena *next;
+        size_t size, used;
+        _alignas_(sd_json_variant) uint8_t data[];
+};
+
+#define JSON_ARENA_SIZE_MIN 512U
+#define JSON_ARENA_SIZE_MAX (64U*1024U)
+
+/* Objects with at least this many fields are looked up by key via a hash index, which is built on the first
+ * lookup. Below that a linear search (or bisection, if the object is sorted) is just as quick. */
+#define JSON_OBJECT_INDEX_MIN 16U
+
+typedef struct JsonObjectIndex {
+        size_t n_buckets;      /* always a power of two */
+        size_t buckets[];      /* index of the key in the object + 1, 0 for an empty bucket */
+} JsonObjectIndex;
+
+/* The keys of the objects we index usually come from untrusted input, hence hash them with a secret key,
+ * like the hashmaps do, so that nobody can make us put them all into the same bucket. */
+static uint8_t object_index_hash_key[HASH_KEY_SIZE];
+
 static JsonSource* json_source_new(const char *name) {
         JsonSource *s;
 
@@ -212,6 +261,168 @@ static bool json_variant_is_regular(const sd_json_variant *v) {
         return (((uintptr_t) v) & 1) == 0;
 }
 
+static JsonArena* json_arena_block_new(size_t size) {
+        JsonArena *a;
+
+        a = malloc(offsetof(JsonArena, data) + size);
+        if (!a)
+                return NULL;
+
+        *a = (JsonArena) {
+                .size = size,
+        };
+
+        return a;
+}
+
+static JsonArena* json_arena_new(size_t input_size) {
+        JsonArena *a;
+
+        /* Size the first block after the JSON text, a parsed tree usually takes up several times its size */
+        a = json_arena_block_new(CLAMP(input_size * 6, JSON_ARENA_SIZE_MIN, JSON_ARENA_SIZE_MAX));
+        if (!a)
+                return NULL;
+
+        a->anchor = (sd_json_variant) {
+                .n_ref = 1,
+                .type = SD_JSON_VARIANT_NULL,
+                .in_arena = true,
+        };
+        a->blocks = a;
+
+        return a;
+}
+
+static void json_arena_free_blocks(JsonArena *b, bool sensitive) {
+        while (b) {
+                JsonArena *next = b->next;
+
+                if (sensitive)
+                        explicit_bzero_safe(b->data, b->used);
+
+                free(b);
+                b = next;
+        }
+}
+
+static void json_arena_trim(JsonArena *a) {
+        assert(a);
+
+        /* Releases the scratch blocks, once parsing is complete */
+
+        json_arena_free_blocks(a->scratch, a->anchor.sensitive);
+        a->scratch = NULL;
+        a->unused = NULL;
+}
+
+static void json_arena_free(JsonArena *a) {
+        assert(a);
+
+        json_arena_trim(a);
+        json_arena_free_blocks(a->blocks, a->anchor.sensitive);
+}
+
+static void* json_arena_block_alloc(JsonArena **blocks, size_t size) {
+        JsonArena *b;
+        void *p;
+
+        assert(blocks);
+
+        b = *blocks;
+        if (!b || size > b->size - b->used) {
+                JsonArena *n;
+
+                /* Grow exponentially at first, then stick to a size that is still quickly allocated */
+                n = json_arena_block_new(MAX(size, b ? MIN(b->size * 2, JSON_ARENA_SIZE_MAX) : JSON_ARENA_SIZE_MIN));
+                if (!n)
+                        return NULL;
+
+                n->next = b;
+                *blocks = b = n;
+        }
+
+        p = b->data + b->used;
+        b->used += size;
+
+        return p;
+}
+
+static void* json_arena_alloc(JsonArena *a, size_t size) {
+        void *p;
+
+        assert(a);
+
+        size = ALIGN_TO(size, alignof(sd_json_variant));
+        if (size == SIZE_MAX)
+                return NULL;
+
+        if (size != sizeof(sd_json_variant))
+                return json_arena_block_alloc(&a->blocks, size);
+
+        if (a->unused) {
+                p = a->unused;
+                a->unused = a->unused->reference;
+                return p;
+        }
+
+        return json_arena_block_alloc(&a->scratch, size);
+}
+
+static void json_arena_recycle(JsonArena *a, sd_json_variant *v) {
+        assert(a);
+        assert(v);
+        assert(v->in_arena);
+        assert(v->is_embedded);
+        assert(!v->is_reference);
+
+        /* Puts a variant from a scratch block that is no longer referenced from anywhere on the list of
+         * variants to reuse. The reference the caller held on it is dropped. */
+
+        sd_json_variant_unref(v);
+
+        v->reference = a->unused;
+        a->unused = v;
+}
+
+static sd_json_variant* json_variant_arena_anchor(sd_json_variant *v) {
+        assert(v);
+        assert(v->in_arena);
+
+        while (v->is_embedded)
+                v = v->parent;
+
+        return v;
+}
+
+static JsonObjectIndex** json_variant_object_index_slot(sd_json_variant *v) {
+        assert(v);
+        assert(v->type == SD_JSON_VARIANT_OBJECT);
+        assert(v->has_index);
+
+        return (JsonObjectIndex**) (v + 1 + v->n_elements);
+}
+
+static uint32_t json_field_hash(const char *name) {
+        uint32_t h = UINT32_C(2166136261);
+
+        /* FNV-1a. The dispatch index only contains the field names from our own dispatch tables, and those
+         * are short, hence a cheap hash is all we need. Attackers can at worst make a lookup probe all
+         * entries of the table, i.e. do what the linear search does anyway. */
+
+        for (const char *c = name; *c; c++)
+                h = (h ^ (uint8_t) *c) * UINT32_C(16777619);
+
+        return h;
+}
+
+static void object_index_hash_key_initialize(void) {
+        random_bytes(object_index_hash_key, sizeof(object_index_hash_key));
+}
+
+static uint64_t json_object_index_hash(const char *name) {
+        return siphash24_string(name, object_index_hash_key);
+}
+
 static sd_json_variant *json_variant_dereference(sd_json_variant *v) {
 
         /* Recursively dereference variants that are references to other variants */
@@ -298,24 +509,51 @@ static sd_json_variant *json_variant_conservative_formalize(sd_json_variant *v)
         return json_variant_formalize(v);
 }
 
-static int json_variant_new(sd_json_variant **ret, sd_json_variant_type_t type, size_t space) {
+static sd_json_variant* json_variant_alloc(JsonArena *arena, sd_json_variant_type_t type, size_t size) {
+        sd_json_variant *v;
+
+        assert(size >= sizeof(sd_json_variant));
+
+        if (arena) {
+                v = json_arena_alloc(arena, size);
+                if (!v)
+                        return NULL;
+
+                *v = (sd_json_variant) {
+                        .is_embedded = true,
+                        .parent = sd_json_variant_ref(&arena->anchor),
+                        .type = type,
+                        .in_arena = true,
+                };
+        } else {
+                v = malloc(size);
+                if (!v)
+                        return NULL;
+
+                *v = (sd_json_variant) {
+                        .n_ref = 1,
+                        .type = type,
+                };
+        }
+
+        return v;
+}
+
+static int json_variant_new(JsonArena *arena, sd_json_variant **ret, sd_json_variant_type_t type, size_t space) {
         sd_json_variant *v;
 
         assert_return(ret, -EINVAL);
 
-        v = malloc0(MAX(sizeof(sd_json_variant),
-                        offsetof(sd_json_variant, value) + space));
+        v = json_variant_alloc(arena, type, MAX(sizeof(sd_json_variant),
+                                                offsetof(sd_json_variant, value) + space));
         if (!v)
                 return -ENOMEM;
 
-        v->n_ref = 1;
-        v->type = type;
-
         *ret = v;
         return 0;
 }
 
-_public_ int sd_json_variant_new_integer(sd_json_variant **ret, int64_t i) {
+static int json_variant_new_integer(JsonArena *arena, sd_json_variant **ret, int64_t i) {
         sd_json_variant *v;
         int r;
 
@@ -326,7 +564,7 @@ _public_ int sd_json_variant_new_integer(sd_json_variant **ret, int64_t i) {
                 return 0;
         }
 
-        r = json_variant_new(&v, SD_JSON_VARIANT_INTEGER, sizeof(i));
+        r = json_variant_new(arena, &v, SD_JSON_VARIANT_INTEGER, sizeof(i));
         if (r < 0)
                 return r;
 
@@ -336,7 +574,11 @@ _public_ int sd_json_variant_new_integer(sd_json_variant **ret, int64_t i) {
         return 0;
 }
 
-_public_ int sd_json_variant_new_unsigned(sd_json_variant **ret, uint64_t u) {
+_public_ int sd_json_variant_new_integer(sd_json_variant **ret, int64_t i) {
+        return json_variant_new_integer(/* arena= */ NULL, ret, i);
+}
+
+static int json_variant_new_unsigned(JsonArena *arena, sd_json_variant **ret, uint64_t u) {
         sd_json_variant *v;
         int r;
 
@@ -346,7 +588,7 @@ _public_ int sd_json_variant_new_unsigned(sd_json_variant **ret, uint64_t u) {
                 return 0;
         }
 
-        r = json_variant_new(&v, SD_JSON_VARIANT_UNSIGNED, sizeof(u));
+        r = json_variant_new(arena, &v, SD_JSON_VARIANT_UNSIGNED, sizeof(u));
         if (r < 0)
                 return r;
 
@@ -356,7 +598,11 @@ _public_ int sd_json_variant_new_unsigned(sd_json_variant **ret, uint64_t u) {
         return 0;
 }
 
-_public_ int sd_json_variant_new_real(sd_json_variant **ret, double d) {
+_public_ int sd_json_variant_new_unsigned(sd_json_variant **ret, uint64_t u) {
+        return json_variant_new_unsigned(/* arena= */ NULL, ret, u);
+}
+
+static int json_variant_new_real(JsonArena *arena, sd_json_variant **ret, double d) {
         sd_json_variant *v;
         int r;
 
@@ -375,7 +621,7 @@ _public_ int sd_json_variant_new_real(sd_json_variant **ret, double d) {
                 return 0;
         }
 
-        r = json_variant_new(&v, SD_JSON_VARIANT_REAL, sizeof(d));
+        r = json_variant_new(arena, &v, SD_JSON_VARIANT_REAL, sizeof(d));
         if (r < 0)
                 return r;
 
@@ -385,6 +631,10 @@ _public_ int sd_json_variant_new_real(sd_json_variant **ret, double d) {
         return 0;
 }
 
+_public_ int sd_json_variant_new_real(sd_json_variant **ret, double d) {
+        return json_variant_new_real(/* arena= */ NULL, ret, d);
+}
+
 _public_ int sd_json_variant_new_boolean(sd_json_variant **ret, int b) {
         assert_return(ret, -EINVAL);
 
@@ -403,7 +653,7 @@ _public_ int sd_json_variant_new_null(sd_json_variant **ret) {
         return 0;
 }
 
-_public_ int sd_json_variant_new_stringn(sd_json_variant **ret, const char *s, size_t n) {
+static int json_variant_new_stringn(JsonArena *arena, sd_json_variant **ret, const char *s, size_t n) {
         sd_json_variant *v;
         int r;
 
@@ -424,7 +674,7 @@ _public_ int sd_json_variant_new_stringn(sd_json_variant **ret, const char *s, s
         if (!utf8_is_valid_n(s, n)) /* JSON strings must be valid UTF-8 */
                 return -EUCLEAN;
 
-        r = json_variant_new(&v, SD_JSON_VARIANT_STRING, n + 1);
+        r = json_variant_new(arena, &v, SD_JSON_VARIANT_STRING, n + 1);
         if (r < 0)
                 return r;
 
@@ -435,6 +685,10 @@ _public_ int sd_json_variant_new_stringn(sd_json_variant **ret, const char *s, s
         return 0;
 }
 
+_public_ int sd_json_variant_new_stringn(sd_json_variant **ret, const char *s, size_t n) {
+        return json_variant_new_stringn(/* arena= */ NULL, ret, s, n);
+}
+
 _public_ int sd_json_variant_new_string(sd_json_variant **ret, const char *s) {
         return sd_json_variant_new_stringn(ret, s, SIZE_MAX);
 }
@@ -546,7 +800,13 @@ static void json_variant_set(sd_json_variant *a, sd_json_variant *b) {
         case SD_JSON_VARIANT_ARRAY:
         case SD_JSON_VARIANT_OBJECT:
                 a->is_reference = true;
-                a->reference = sd_json_variant_ref(json_variant_conservative_formalize(b));
+                a->reference = json_variant_conservative_formalize(b);
+
+                /* Members of an arena don't pin each other, they are released all at once */
+                if (a->in_arena)
+                        assert(!json_variant_is_regular(a->reference) || a->reference->in_arena);
+                else
+                        sd_json_variant_ref(a->reference);
                 break;
 
         case SD_JSON_VARIANT_NULL:
@@ -582,6 +842,7 @@ static int json_variant_array_put_element(sd_json_variant *array, sd_json_varian
         *w = (sd_json_variant) {
                 .is_embedded = true,
                 .parent = array,
+                .in_arena = array->in_arena,
         };
 
         json_variant_set(w, element);
@@ -593,7 +854,7 @@ static int json_variant_array_put_element(sd_json_variant *array, sd_json_varian
         return 0;
 }
 
-_public_ int sd_json_variant_new_array(sd_json_variant **ret, sd_json_variant **array, size_t n) {
+static int json_variant_new_array(JsonArena *arena, sd_json_variant **ret, sd_json_variant **array, size_t n) {
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
         int r;
 
@@ -604,15 +865,14 @@ _public_ int sd_json_variant_new_array(sd_json_variant **ret, sd_json_variant **
         }
         assert_return(array, -EINVAL);
 
-        v = new(sd_json_variant, n + 1);
+        if (size_multiply_overflow(sizeof(sd_json_variant), n + 1))
+                return -ENOMEM;
+
+        v = json_variant_alloc(arena, SD_JSON_VARIANT_ARRAY, sizeof(sd_json_variant) * (n + 1));
         if (!v)
                 return -ENOMEM;
 
-        *v = (sd_json_variant) {
-                .n_ref = 1,
-                .type = SD_JSON_VARIANT_ARRAY,
-                .normalized = true,
-        };
+        v->normalized = true;
 
         while (v->n_elements < n) {
                 r = json_variant_array_put_element(v, array[v->n_elements]);
@@ -624,6 +884,10 @@ _public_ int sd_json_variant_new_array(sd_json_variant **ret, sd_json_variant **
         return 0;
 }
 
+_public_ int sd_json_variant_new_array(sd_json_variant **ret, sd_json_variant **array, size_t n) {
+        return json_variant_new_array(/* arena= */ NULL, ret, array, n);
+}
+
 _public_ int sd_json_variant_new_array_bytes(sd_json_variant **ret, const void *p, size_t n) {
         assert_return(ret, -EINVAL);
         if (n == 0) {
@@ -717,10 +981,10 @@ _public_ int sd_json_variant_new_array_strv(sd_json_variant **ret, char **l) {
         return 0;
 }
 
-_public_ int sd_json_variant_new_object(sd_json_variant **ret, sd_json_variant **array, size_t n) {
+static int json_variant_new_object(JsonArena *arena, sd_json_variant **ret, sd_json_variant **array, size_t n) {
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
         const char *prev = NULL;
-        bool sorted = true, normalized = true;
+        bool sorted = true, normalized = true, has_index;
 
         assert_return(ret, -EINVAL);
         if (n == 0) {
@@ -730,14 +994,16 @@ _public_ int sd_json_variant_new_object(sd_json_variant **ret, sd_json_variant *
         assert_return(array, -EINVAL);
         assert_return(n % 2 == 0, -EINVAL);
 
-        v = new(sd_json_variant, n + 1);
-        if (!v)
+        if (size_multiply_overflow(sizeof(sd_json_variant), n + 1))
                 return -ENOMEM;
 
-        *v = (sd_json_variant) {
-                .n_ref = 1,
-                .type = SD_JSON_VARIANT_OBJECT,
-        };
+        /* Large objects get room for a pointer to their hash index after the elements */
+        has_index = n / 2 >= JSON_OBJECT_INDEX_MIN;
+
+        v = json_variant_alloc(arena, SD_JSON_VARIANT_OBJECT,
+                               sizeof(sd_json_variant) * (n + 1) + (has_index ? sizeof(JsonObjectIndex*) : 0));
+        if (!v)
+                return -ENOMEM;
 
         for (v->n_elements = 0; v->n_elements < n; v->n_elements++) {
                 sd_json_variant *w = v + 1 + v->n_elements,
@@ -768,6 +1034,7 @@ _public_ int sd_json_variant_new_object(sd_json_variant **ret, sd_json_variant *
                 *w = (sd_json_variant) {
                         .is_embedded = true,
                         .parent = v,
+                        .in_arena = v->in_arena,
                 };
 
                 json_variant_set(w, c);
@@ -777,10 +1044,19 @@ _public_ int sd_json_variant_new_object(sd_json_variant **ret, sd_json_variant *
         v->normalized = normalized;
         v->sorted = sorted;
 
+        if (has_index) {
+                v->has_index = true;
+                *json_variant_object_index_slot(v) = NULL; /* built on first use */
+        }
+
         *ret = TAKE_PTR(v);
         return 0;
 }
 
+_public_ int sd_json_variant_new_object(sd_json_variant **ret, sd_json_variant **array, size_t n) {
+        return json_variant_new_object(/* arena= */ NULL, ret, array, n);
+}
+
 static size_t json_variant_size(sd_json_variant* v) {
         if (!json_variant_is_regular(v))
                 return 0;
@@ -841,6 +1117,10 @@ static void json_variant_free_inner(sd_json_variant *v, bool force_sensitive) {
                 for (size_t i = 0; i < v->n_elements; i++)
                         json_variant_free_inner(v + 1 + i, sensitive);
 
+        /* An index allocated from an arena goes away with it */
+        if (v->has_index && !v->in_arena)
+                free(*json_variant_object_index_slot(v));
+
         if (sensitive)
                 explicit_bzero_safe(v, json_variant_size(v));
 }
@@ -887,8 +1167,12 @@ _public_ sd_json_variant *sd_json_variant_unref(sd_json_variant *v) {
                 v->n_ref--;
 
                 if (v->n_ref == 0) {
-                        json_variant_free_inner(v, false);
-                        free(v);
+                        if (v->in_arena) /* the anchor of an arena, see above */
+                                json_arena_free(container_of(v, JsonArena, anchor));
+                        else {
+                                json_variant_free_inner(v, false);
+                                free(v);
+                        }
                 }
         }
 
@@ -1302,6 +1586,57 @@ mismatch:
         return NULL;
 }
 
+static JsonObjectIndex* json_variant_object_index(sd_json_variant *v) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        JsonObjectIndex **slot, *index;
+        size_t n_buckets, size;
+
+        assert(v);
+
+        slot = json_variant_object_index_slot(v);
+        if (*slot)
+                return *slot;
+
+        assert_se(pthread_once(&once, object_index_hash_key_initialize) == 0);
+
+        n_buckets = 1U << log2u_round_up(v->n_elements); /* i.e. at least twice the number of keys */
+        size = offsetof(JsonObjectIndex, buckets) + sizeof(size_t) * n_buckets;
+
+        if (v->in_arena) {
+                JsonArena *arena = container_of(json_variant_arena_anchor(v), JsonArena, anchor);
+
+                index = json_arena_block_alloc(&arena->blocks, ALIGN_TO(size, alignof(sd_json_variant)));
+                if (index)
+                        memzero(index, size);
+        } else
+                index = malloc0(size);
+        if (!index)
+                return NULL;
+
+        index->n_buckets = n_buckets;
+
+        for (size_t i = 0; i < v->n_elements; i += 2) {
+                const char *k;
+                size_t b;
+
+                k = sd_json_variant_string(json_variant_dereference(v + 1 + i));
+                if (!k)
+                        continue;
+
+                for (b = json_object_index_hash(k) & (n_buckets - 1);
+                     index->buckets[b] != 0;
+                     b = (b + 1) & (n_buckets - 1))
+                        if (streq(sd_json_variant_string(json_variant_dereference(v + index->buckets[b])), k))
+                                break;
+
+                /* If a key is listed twice, the first entry wins, like with the linear search */
+                if (index->buckets[b] == 0)
+                        index->buckets[b] = i + 1;
+        }
+
+        return (*slot = index);
+}
+
 _public_ sd_json_variant *sd_json_variant_by_key_full(sd_json_variant *v, const char *key, sd_json_variant **ret_key) {
         if (!v)
                 goto not_found;
@@ -1314,7 +1649,32 @@ _public_ sd_json_variant *sd_json_variant_by_key_full(sd_json_variant *v, const
         if (v->type != SD_JSON_VARIANT_OBJECT)
                 goto mismatch;
         if (v->is_reference)
-                return sd_json_variant_by_key(v->reference, key);
+                return sd_json_variant_by_key_full(v->reference, key, ret_key);
+
+        if (v->has_index) {
+                JsonObjectIndex *index;
+
+                /* Large objects are looked up via their hash index in O(1). If we cannot allocate it, fall
+                 * back to the searches below. */
+
+                index = json_variant_object_index(v);
+                if (index) {
+                        for (size_t b = json_object_index_hash(key) & (index->n_buckets - 1);
+                             index->buckets[b] != 0;
+                             b = (b + 1) & (index->n_buckets - 1)) {
+                                size_t i = index->buckets[b];
+
+                                if (streq(sd_json_variant_string(json_variant_dereference(v + i)), key)) {
+                                        if (ret_key)
+                                                *ret_key = json_variant_conservative_formalize(v + i);
+
+                                        return json_variant_conservative_formalize(v + i + 1);
+                                }
+                        }
+
+                        goto not_found;
+                }
+        }
 
         if (v->sorted) {
                 size_t a = 0, b = v->n_elements/2;
@@ -1496,6 +1856,10 @@ _public_ void sd_json_variant_sensitive(sd_json_variant *v) {
                 return;
 
         v->sensitive = true;
+
+        /* An arena is only released as a whole, hence erase all of it then */
+        if (v->in_arena)
+                json_variant_arena_anchor(v)->sensitive = true;
 }
 
 _public_ int sd_json_variant_is_sensitive(sd_json_variant *v) {
@@ -2510,12 +2874,83 @@ static int json_variant_set_source(sd_json_variant **v, JsonSource *source, unsi
         return 1;
 }
 
+static bool json_char_is_plain(char c) {
+        /* Printable ASCII that needs no special treatment inside a string: no control characters, no
+         * quotes, no backslashes, nothing that might start a multi-byte UTF-8 sequence */
+        return c >= ' ' && c < 0x7f && !IN_SET(c, '"', '\\');
+}
+
+static size_t json_scan_plain(const char *s, size_t n) {
+        const char *p = s;
+
+        /* Returns the number of "plain" characters at the beginning of the NUL terminated string s, see
+         * above, looking at no more than n of them. This is where the parser spends most of its time, hence
+         * look at 16 bytes at once if we can. Loads are aligned so that they never cross a page boundary,
+         * which makes it safe to read beyond the terminating NUL byte. */
+
+        assert(s);
+
+#if defined(JSON_SCAN_SSE2) || defined(JSON_SCAN_NEON)
+        for (; ((uintptr_t) p & 15) != 0; p++)
+                if ((size_t) (p - s) >= n || !json_char_is_plain(*p))
+                        return p - s;
+
+        for (; (size_t) (p - s) < n; p += 16) {
+#  if defined(JSON_SCAN_SSE2)
+                __m128i v = _mm_load_si128((const __m128i*) p);
+                unsigned mask;
+
+                /* The signed comparison catches everything >= 0x80 together with the control characters */
+                mask = _mm_movemask_epi8(
+                                _mm_or_si128(
+                                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                                                _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+                                                             _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)))));
+                if (mask != 0)
+                        return MIN((size_t) (p - s) + __builtin_ctz(mask), n);
+#  else
+                uint8x16_t v = vld1q_u8((const uint8_t*) p);
+
+                if (vmaxvq_u8(vorrq_u8(
+                                        vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                                                 vceqq_u8(v, vdupq_n_u8('\\'))),
+                                        vorrq_u8(vcltq_u8(v, vdupq_n_u8(' ')),
+                                                 vcgeq_u8(v, vdupq_n_u8(0x7f))))) != 0) {
+                        while ((size_t) (p - s) < n && json_char_is_plain(*p))
+                                p++;
+
+                        return p - s;
+                }
+#  endif
+        }
+
+        return n;
+#else
+        while ((size_t) (p - s) < n && json_char_is_plain(*p))
+                p++;
+
+        return p - s;
+#endif
+}
+
 static void inc_lines_columns(unsigned *line, unsigned *column, const char *s, size_t n) {
         assert(line);
         assert(column);
         assert(s || n == 0);
 
         while (n > 0) {
+                size_t k;
+
+                /* Skip over runs of ASCII without newlines in one go */
+                k = json_scan_plain(s, n);
+                if (k > 0) {
+                        *column += k;
+                        s += k;
+                        n -= k;
+                        continue;
+                }
+
                 if (*s == '\n') {
                         (*line)++;
                         *column = 1;
@@ -2578,14 +3013,16 @@ static int unhex_ucs2(const char *c, uint16_t *ret) {
         return 0;
 }
 
-static int json_parse_string(const char **p, char **ret) {
-        _cleanup_free_ char *s = NULL;
+static int json_parse_string(const char **p, char **buffer) {
         size_t n = 0;
         const char *c;
 
         assert(p);
         assert(*p);
-        assert(ret);
+        assert(buffer);
+
+        /* Unescapes the string into *buffer, which is reused if already allocated, so that parsing a
+         * series of strings doesn't need to allocate memory for each of them. */
 
         c = *p;
 
@@ -2595,8 +3032,20 @@ static int json_parse_string(const char **p, char **ret) {
         c++;
 
         for (;;) {
+                size_t k;
                 int len;
 
+                /* Copy runs of characters that need no further checking in one go */
+                k = json_scan_plain(c, SIZE_MAX);
+                if (k > 0) {
+                        if (!GREEDY_REALLOC(*buffer, n + k + 1))
+                                return -ENOMEM;
+
+                        memcpy(*buffer + n, c, k);
+                        n += k;
+                        c += k;
+                }
+
                 /* Check for EOF */
                 if (*c == 0)
                         return -EINVAL;
@@ -2610,16 +3059,12 @@ static int json_parse_string(const char **p, char **ret) {
                         return -EINVAL;
 
                 if (*c == '"') {
-                        if (!s) {
-                                s = strdup("");
-                                if (!s)
-                                        return -ENOMEM;
-                        } else
-                                s[n] = 0;
+                        if (!GREEDY_REALLOC(*buffer, n + 1))
+                                return -ENOMEM;
 
+                        (*buffer)[n] = 0;
                         *p = c + 1;
 
-                        *ret = TAKE_PTR(s);
                         return JSON_TOKEN_STRING;
                 }
 
@@ -2652,11 +3097,11 @@ static int json_parse_string(const char **p, char **ret) {
 
                                 c += 5;
 
-                                if (!GREEDY_REALLOC(s, n + 5))
+                                if (!GREEDY_REALLOC(*buffer, n + 5))
                                         return -ENOMEM;
 
                                 if (!utf16_is_surrogate(x))
-                                        n += utf8_encode_unichar(s + n, (char32_t) x);
+                                        n += utf8_encode_unichar(*buffer + n, (char32_t) x);
                                 else if (utf16_is_trailing_surrogate(x))
                                         return -EINVAL;
                                 else {
@@ -2674,17 +3119,17 @@ static int json_parse_string(const char **p, char **ret) {
                                         if (!utf16_is_trailing_surrogate(y))
                                                 return -EINVAL;
 
-                                        n += utf8_encode_unichar(s + n, utf16_surrogate_pair_to_unichar(x, y));
+                                        n += utf8_encode_unichar(*buffer + n, utf16_surrogate_pair_to_unichar(x, y));
                                 }
 
                                 continue;
                         } else
                                 return -EINVAL;
 
-                        if (!GREEDY_REALLOC(s, n + 2))
+                        if (!GREEDY_REALLOC(*buffer, n + 2))
                                 return -ENOMEM;
 
-                        s[n++] = ch;
+                        (*buffer)[n++] = ch;
                         c++;
                         continue;
                 }
@@ -2693,10 +3138,10 @@ static int json_parse_string(const char **p, char **ret) {
                 if (len < 0)
                         return len;
 
-                if (!GREEDY_REALLOC(s, n + len + 1))
+                if (!GREEDY_REALLOC(*buffer, n + len + 1))
                         return -ENOMEM;
 
-                memcpy(s + n, c, len);
+                memcpy(*buffer + n, c, len);
                 n += len;
                 c += len;
         }
@@ -2809,7 +3254,7 @@ static int json_parse_number(const char **p, JsonValue *ret) {
 
 int json_tokenize(
                 const char **p,
-                char **ret_string,
+                char **ret_string,    /* 'ret_string' is only set for string tokens, and reused as buffer if non-NULL */
                 JsonValue *ret_value,
                 unsigned *ret_line,   /* 'reterr_line' returns the line at the beginning of this token */
                 unsigned *ret_column,
@@ -2856,7 +3301,6 @@ int json_tokenize(
         start_column = *column;
 
         if (*c == 0) {
-                *ret_string = NULL;
                 *ret_value = JSON_VALUE_NULL;
                 r = JSON_TOKEN_END;
                 goto finish;
@@ -2906,12 +3350,10 @@ int json_tokenize(
                         if (r < 0)
                                 return r;
 
-                        *ret_string = NULL;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
                         goto finish;
 
                 } else if (startswith(c, "true")) {
-                        *ret_string = NULL;
                         ret_value->boolean = true;
                         c += 4;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2919,7 +3361,6 @@ int json_tokenize(
                         goto finish;
 
                 } else if (startswith(c, "false")) {
-                        *ret_string = NULL;
                         ret_value->boolean = false;
                         c += 5;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2927,7 +3368,6 @@ int json_tokenize(
                         goto finish;
 
                 } else if (startswith(c, "null")) {
-                        *ret_string = NULL;
                         *ret_value = JSON_VALUE_NULL;
                         c += 4;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2972,7 +3412,6 @@ int json_tokenize(
         }
 
 null_return:
-        *ret_string = NULL;
         *ret_value = JSON_VALUE_NULL;
 
 finish:
@@ -2986,7 +3425,7 @@ finish:
 }
 
 typedef enum JsonExpect {
-        /* The following values are used by sd_json_parse() */
+        /* The following values are used by sd_json_parse(), and a few of them by json_parse_cbor() */
         EXPECT_TOPLEVEL,
         EXPECT_END,
         EXPECT_OBJECT_FIRST_KEY,
@@ -3010,6 +3449,8 @@ typedef struct JsonStack {
         unsigned line_before;
         unsigned column_before;
         size_t n_suppress; /* When building: if > 0, suppress this many subsequent elements. If == SIZE_MAX, suppress all subsequent elements */
+        bool sort;         /* When building: sort the fields of the object by key once it is complete */
+        uint64_t n_left;   /* When decoding CBOR: how many more elements this container is made of */
 } JsonStack;
 
 static void json_stack_release(JsonStack *s) {
@@ -3018,6 +3459,37 @@ static void json_stack_release(JsonStack *s) {
         CLEANUP_ARRAY(s->elements, s->n_elements, sd_json_variant_unref_many);
 }
 
+static void json_stack_clear(JsonStack *s, JsonArena *arena, sd_json_variant *container) {
+        assert(s);
+
+        /* Drops the elements collected for a container once it has been created, but keeps the buffer
+         * around for the next container on the same level. Elements the container copied rather than
+         * referenced aren't needed anymore, hence can be reused right away when parsing into an arena. */
+
+        for (size_t i = 0; i < s->n_elements; i++) {
+                sd_json_variant *e = s->elements[i];
+
+                if (arena && json_variant_is_regular(e) && !container[1 + i].is_reference)
+                        json_arena_recycle(arena, e);
+                else
+                        sd_json_variant_unref(e);
+        }
+
+        s->n_elements = 0;
+}
+
+static int json_parse_take_root(JsonArena *arena, sd_json_variant *v, sd_json_variant **ret) {
+        assert(ret);
+
+        /* Only containers and long strings live in the arena proper, everything else came from its scratch
+         * blocks, which go away once parsing is complete. Hence hand out a copy of a top-level scalar. */
+        if (arena && json_variant_is_regular(v) && !IN_SET(v->type, SD_JSON_VARIANT_ARRAY, SD_JSON_VARIANT_OBJECT))
+                return json_variant_copy(ret, v);
+
+        *ret = sd_json_variant_ref(v);
+        return 0;
+}
+
 static int json_parse_internal(
                 const char **input,
                 JsonSource *source,
@@ -3030,6 +3502,8 @@ static int json_parse_internal(
         size_t n_stack = 1;
         unsigned line_buffer = 0, column_buffer = 0;
         void *tokenizer_state = NULL;
+        _cleanup_free_ char *string = NULL;
+        JsonArena *arena = NULL;
         JsonStack *stack = NULL;
         const char *p;
         int r;
@@ -3039,13 +3513,22 @@ static int json_parse_internal(
 
         p = *input;
 
-        if (!GREEDY_REALLOC(stack, n_stack))
+        /* Zero-initialize, so that the element buffers of all levels ever used can be reused and freed */
+        if (!GREEDY_REALLOC0(stack, n_stack))
                 return -ENOMEM;
 
         stack[0] = (JsonStack) {
                 .expect = EXPECT_TOPLEVEL,
         };
 
+        if (FLAGS_SET(flags, SD_JSON_PARSE_ARENA)) {
+                arena = json_arena_new(strnlen(p, JSON_ARENA_SIZE_MAX));
+                if (!arena) {
+                        free(stack);
+                        return -ENOMEM;
+                }
+        }
+
         if (!line)
                 line = &line_buffer;
         if (!column)
@@ -3053,7 +3536,6 @@ static int json_parse_internal(
 
         for (;;) {
                 _cleanup_(sd_json_variant_unrefp) sd_json_variant *add = NULL;
-                _cleanup_free_ char *string = NULL;
                 unsigned line_token, column_token;
                 JsonStack *current;
                 JsonValue value;
@@ -3113,7 +3595,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        if (!GREEDY_REALLOC(stack, n_stack+1)) {
+                        if (!GREEDY_REALLOC0(stack, n_stack+1)) {
                                 r = -ENOMEM;
                                 goto finish;
                         }
@@ -3129,11 +3611,13 @@ static int json_parse_internal(
                                 current->expect = EXPECT_ARRAY_COMMA;
                         }
 
-                        stack[n_stack++] = (JsonStack) {
+                        stack[n_stack] = (JsonStack) {
                                 .expect = EXPECT_OBJECT_FIRST_KEY,
+                                .elements = stack[n_stack].elements,
                                 .line_before = line_token,
                                 .column_before = column_token,
                         };
+                        n_stack++;
 
                         current = stack + n_stack - 1;
                         break;
@@ -3146,14 +3630,14 @@ static int json_parse_internal(
 
                         assert(n_stack > 1);
 
-                        r = sd_json_variant_new_object(&add, current->elements, current->n_elements);
+                        r = json_variant_new_object(arena, &add, current->elements, current->n_elements);
                         if (r < 0)
                                 goto finish;
 
                         line_token = current->line_before;
                         column_token = current->column_before;
 
-                        json_stack_release(current);
+                        json_stack_clear(current, arena, add);
                         n_stack--, current--;
 
                         break;
@@ -3164,7 +3648,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        if (!GREEDY_REALLOC(stack, n_stack+1)) {
+                        if (!GREEDY_REALLOC0(stack, n_stack+1)) {
                                 r = -ENOMEM;
                                 goto finish;
                         }
@@ -3180,11 +3664,13 @@ static int json_parse_internal(
                                 current->expect = EXPECT_ARRAY_COMMA;
                         }
 
-                        stack[n_stack++] = (JsonStack) {
+                        stack[n_stack] = (JsonStack) {
                                 .expect = EXPECT_ARRAY_FIRST_ELEMENT,
+                                .elements = stack[n_stack].elements,
                                 .line_before = line_token,
                                 .column_before = column_token,
                         };
+                        n_stack++;
 
                         break;
 
@@ -3196,14 +3682,14 @@ static int json_parse_internal(
 
                         assert(n_stack > 1);
 
-                        r = sd_json_variant_new_array(&add, current->elements, current->n_elements);
+                        r = json_variant_new_array(arena, &add, current->elements, current->n_elements);
                         if (r < 0)
                                 goto finish;
 
                         line_token = current->line_before;
                         column_token = current->column_before;
 
-                        json_stack_release(current);
+                        json_stack_clear(current, arena, add);
                         n_stack--, current--;
                         break;
 
@@ -3213,7 +3699,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        r = sd_json_variant_new_string(&add, string);
+                        r = json_variant_new_stringn(arena, &add, string, SIZE_MAX);
                         if (r < 0)
                                 goto finish;
 
@@ -3236,7 +3722,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        r = sd_json_variant_new_real(&add, value.real);
+                        r = json_variant_new_real(arena, &add, value.real);
                         if (r < 0)
                                 goto finish;
 
@@ -3257,7 +3743,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        r = sd_json_variant_new_integer(&add, value.integer);
+                        r = json_variant_new_integer(arena, &add, value.integer);
                         if (r < 0)
                                 goto finish;
 
@@ -3278,7 +3764,7 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        r = sd_json_variant_new_unsigned(&add, value.unsig);
+                        r = json_variant_new_unsigned(arena, &add, value.unsig);
                         if (r < 0)
                                 goto finish;
 
@@ -3346,7 +3832,9 @@ static int json_parse_internal(
                         if (FLAGS_SET(flags, SD_JSON_PARSE_SENSITIVE))
                                 sd_json_variant_sensitive(add);
 
-                        (void) json_variant_set_source(&add, source, line_token, column_token);
+                        /* Variants in an arena don't carry their source location, to keep them compact */
+                        if (!arena)
+                                (void) json_variant_set_source(&add, source, line_token, column_token);
 
                         if (!GREEDY_REALLOC(current->elements, current->n_elements + 1)) {
                                 r = -ENOMEM;
@@ -3361,16 +3849,25 @@ done:
         assert(n_stack == 1);
         assert(stack[0].n_elements == 1);
 
-        *ret = sd_json_variant_ref(stack[0].elements[0]);
+        r = json_parse_take_root(arena, stack[0].elements[0], ret);
+        if (r < 0)
+                goto finish;
+
         *input = p;
         r = 0;
 
 finish:
-        for (size_t i = 0; i < n_stack; i++)
+        for (size_t i = 0; i < MALLOC_ELEMENTSOF(stack); i++)
                 json_stack_release(stack + i);
 
         free(stack);
 
+        if (arena) {
+                /* All temporaries are released now, hence the scratch blocks are not needed anymore */
+                json_arena_trim(arena);
+                sd_json_variant_unref(&arena->anchor);
+        }
+
         return r;
 }
 
@@ -3470,6 +3967,385 @@ _public_ int sd_json_parse_file(
         return sd_json_parse_file_at(f, AT_FDCWD, path, flags, ret, reterr_line, reterr_column);
 }
 
+size_t json_cbor_format_head(uint8_t *buf, unsigned major, uint64_t value) {
+        assert(buf);
+        assert(major <= CBOR_MAJOR_SIMPLE);
+
+        /* The initial byte carries the major type in the upper 3 bits. Values below 24 are stored in the
+         * lower 5 bits directly, otherwise these say how many bytes of big-endian argument follow. */
+
+        major <<= 5;
+
+        if (value < 24) {
+                buf[0] = major | value;
+                return 1;
+        }
+        if (value <= UINT8_MAX) {
+                buf[0] = major | 24;
+                buf[1] = value;
+                return 2;
+        }
+        if (value <= UINT16_MAX) {
+                buf[0] = major | 25;
+                unaligned_write_be16(buf + 1, value);
+                return 3;
+        }
+        if (value <= UINT32_MAX) {
+                buf[0] = major | 26;
+                unaligned_write_be32(buf + 1, value);
+                return 5;
+        }
+
+        buf[0] = major | 27;
+        unaligned_write_be64(buf + 1, value);
+        return 9;
+}
+
+int json_cbor_parse_head(const uint8_t *p, size_t size, unsigned *ret_major, uint64_t *ret_value) {
+        unsigned info;
+        size_t n;
+
+        assert(p || size == 0);
+        assert(ret_major);
+        assert(ret_value);
+
+        /* Returns the size of the head, or 0 if it is incomplete. Note that for CBOR_MAJOR_SIMPLE the size
+         * tells apart simple values (1), their two byte variant (2) and half (3), single (5) and double (9)
+         * precision floats, whose bits are returned as value. */
+
+        if (size < 1)
+                return 0;
+
+        info = p[0] & 0x1f;
+        if (info < 24)
+                n = 0;
+        else if (info <= 27)
+                n = 1U << (info - 24);
+        else /* Reserved, or indefinite lengths, which we don't support */
+                return -EBADMSG;
+
+        if (size < 1 + n)
+                return 0;
+
+        *ret_major = p[0] >> 5;
+        *ret_value = n == 0 ? info :
+                     n == 1 ? p[1] :
+                     n == 2 ? unaligned_read_be16(p + 1) :
+                     n == 4 ? unaligned_read_be32(p + 1) :
+                              unaligned_read_be64(p + 1);
+
+        return 1 + n;
+}
+
+static int json_cbor_append(uint8_t **buf, size_t *size, unsigned major, uint64_t value, const void *data, size_t n) {
+        assert(buf);
+        assert(size);
+        assert(data || n == 0);
+
+        if (!GREEDY_REALLOC(*buf, *size + CBOR_HEAD_MAX + n))
+                return -ENOMEM;
+
+        *size += json_cbor_format_head(*buf + *size, major, value);
+        *size = (uint8_t*) mempcpy_safe(*buf + *size, data, n) - *buf;
+
+        return 0;
+}
+
+static int json_variant_format_cbor_internal(sd_json_variant *v, uint8_t **buf, size_t *size) {
+        int r;
+
+        assert(buf);
+        assert(size);
+
+        switch (sd_json_variant_type(v)) {
+
+        case SD_JSON_VARIANT_NULL:
+                return json_cbor_append(buf, size, CBOR_MAJOR_SIMPLE, 22, NULL, 0);
+
+        case SD_JSON_VARIANT_BOOLEAN:
+                return json_cbor_append(buf, size, CBOR_MAJOR_SIMPLE, sd_json_variant_boolean(v) ? 21 : 20, NULL, 0);
+
+        case SD_JSON_VARIANT_INTEGER: {
+                int64_t i = sd_json_variant_integer(v);
+
+                if (i >= 0)
+                        return json_cbor_append(buf, size, CBOR_MAJOR_UNSIGNED, i, NULL, 0);
+
+                return json_cbor_append(buf, size, CBOR_MAJOR_NEGATIVE, (uint64_t) -(i + 1), NULL, 0);
+        }
+
+        case SD_JSON_VARIANT_UNSIGNED:
+                return json_cbor_append(buf, size, CBOR_MAJOR_UNSIGNED, sd_json_variant_unsigned(v), NULL, 0);
+
+        case SD_JSON_VARIANT_REAL: {
+                double d = sd_json_variant_real(v);
+                uint8_t be[8];
+                uint64_t u;
+
+                /* The argument of the head is sized by value, hence write the double precision float
+                 * (additional information 27) out explicitly */
+                memcpy(&u, &d, sizeof(u));
+                unaligned_write_be64(be, u);
+
+                if (!GREEDY_REALLOC(*buf, *size + 1 + sizeof(be)))
+                        return -ENOMEM;
+
+                (*buf)[(*size)++] = CBOR_MAJOR_SIMPLE << 5 | 27;
+                *size = (uint8_t*) mempcpy(*buf + *size, be, sizeof(be)) - *buf;
+                return 0;
+        }
+
+        case SD_JSON_VARIANT_STRING: {
+                const char *s = sd_json_variant_string(v);
+                size_t n = strlen(s);
+
+                return json_cbor_append(buf, size, CBOR_MAJOR_STRING, n, s, n);
+        }
+
+        case SD_JSON_VARIANT_ARRAY:
+        case SD_JSON_VARIANT_OBJECT: {
+                size_t n = sd_json_variant_elements(v);
+
+                if (sd_json_variant_is_object(v))
+                        r = json_cbor_append(buf, size, CBOR_MAJOR_MAP, n / 2, NULL, 0);
+                else
+                        r = json_cbor_append(buf, size, CBOR_MAJOR_ARRAY, n, NULL, 0);
+                if (r < 0)
+                        return r;
+
+                /* Objects are encoded as alternating keys and values, just like we store them */
+                for (size_t i = 0; i < n; i++) {
+                        r = json_variant_format_cbor_internal(sd_json_variant_by_index(v, i), buf, size);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        default:
+                assert_not_reached();
+        }
+}
+
+int json_variant_format_cbor(sd_json_variant *v, uint8_t **ret, size_t *ret_size) {
+        _cleanup_(erase_and_freep) uint8_t *buf = NULL;
+        size_t size = 0;
+        int r;
+
+        assert(ret);
+        assert(ret_size);
+
+        r = json_variant_format_cbor_internal(v, &buf, &size);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = size;
+        return 0;
+}
+
+int json_parse_cbor(const uint8_t *p, size_t size, sd_json_parse_flags_t flags, sd_json_variant **ret) {
+        const uint8_t *e = p + size;
+        size_t n_stack = 1;
+        JsonArena *arena = NULL;
+        JsonStack *stack = NULL;
+        int r;
+
+        assert(p || size == 0);
+        assert(ret);
+
+        /* Decodes exactly one CBOR data item covering the whole buffer. This follows json_parse_internal()
+         * closely, except that the sizes of containers are known in advance. */
+
+        if (!GREEDY_REALLOC0(stack, n_stack))
+                return -ENOMEM;
+
+        stack[0] = (JsonStack) {
+                .expect = EXPECT_TOPLEVEL,
+                .n_left = 1,
+        };
+
+        if (FLAGS_SET(flags, SD_JSON_PARSE_ARENA)) {
+                arena = json_arena_new(size);
+                if (!arena) {
+                        free(stack);
+                        return -ENOMEM;
+                }
+        }
+
+        for (;;) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *add = NULL;
+                JsonStack *current;
+                unsigned major;
+                uint64_t value;
+                int k;
+
+                assert(n_stack > 0);
+                current = stack + n_stack - 1;
+
+                if (current->n_left == 0) {
+                        if (n_stack == 1)
+                                break;
+
+                        if (current->expect == EXPECT_OBJECT_NEXT_KEY)
+                                r = json_variant_new_object(arena, &add, current->elements, current->n_elements);
+                        else
+                                r = json_variant_new_array(arena, &add, current->elements, current->n_elements);
+                        if (r < 0)
+                                goto finish;
+
+                        json_stack_clear(current, arena, add);
+                        n_stack--, current--;
+
+                } else {
+                        k = json_cbor_parse_head(p, e - p, &major, &value);
+                        if (k <= 0) {
+                                r = k < 0 ? k : -EBADMSG;
+                                goto finish;
+                        }
+                        p += k;
+
+                        if (current->expect == EXPECT_OBJECT_NEXT_KEY &&
+                            current->n_elements % 2 == 0 &&
+                            major != CBOR_MAJOR_STRING) {
+                                r = -EBADMSG;
+                                goto finish;
+                        }
+
+                        switch (major) {
+
+                        case CBOR_MAJOR_UNSIGNED:
+                                /* Like the JSON tokenizer, which picks the type by the sign alone */
+                                r = json_variant_new_unsigned(arena, &add, value);
+                                break;
+
+                        case CBOR_MAJOR_NEGATIVE:
+                                if (value > INT64_MAX) {
+                                        r = -ERANGE;
+                                        goto finish;
+                                }
+
+                                r = json_variant_new_integer(arena, &add, -(int64_t) value - 1);
+                                break;
+
+                        case CBOR_MAJOR_STRING:
+                                if (value > (uint64_t) (e - p)) {
+                                        r = -EBADMSG;
+                                        goto finish;
+                                }
+
+                                r = json_variant_new_stringn(arena, &add, (const char*) p, value);
+                                p += value;
+                                break;
+
+                        case CBOR_MAJOR_ARRAY:
+                        case CBOR_MAJOR_MAP:
+                                /* Each element takes up at least one byte, hence refuse sizes that can't
+                                 * possibly fit before allocating anything for them */
+                                if (value > (uint64_t) (e - p) / (major == CBOR_MAJOR_MAP ? 2 : 1)) {
+                                        r = -EBADMSG;
+                                        goto finish;
+                                }
+
+                                /* The first stack entry is for the top-level value, the others are the
+                                 * containers opened so far. Allow as many of those as variants may nest. */
+                                if (n_stack - 1 >= DEPTH_MAX) {
+                                        r = -ELNRNG;
+                                        goto finish;
+                                }
+
+                                if (!GREEDY_REALLOC0(stack, n_stack+1)) {
+                                        r = -ENOMEM;
+                                        goto finish;
+                                }
+                                current = stack + n_stack - 1;
+                                current->n_left--;
+
+                                stack[n_stack] = (JsonStack) {
+                                        .expect = major == CBOR_MAJOR_MAP ? EXPECT_OBJECT_NEXT_KEY : EXPECT_ARRAY_NEXT_ELEMENT,
+                                        .elements = stack[n_stack].elements,
+                                        .n_left = major == CBOR_MAJOR_MAP ? value * 2 : value,
+                                };
+                                n_stack++;
+                                continue;
+
+                        case CBOR_MAJOR_SIMPLE:
+                                if (k == 1 && IN_SET(value, 20, 21))
+                                        r = sd_json_variant_new_boolean(&add, value == 21);
+                                else if (k == 1 && value == 22)
+                                        r = sd_json_variant_new_null(&add);
+                                else if (k == 5) {
+                                        uint32_t u = value;
+                                        float f;
+
+                                        memcpy(&f, &u, sizeof(f));
+                                        r = json_variant_new_real(arena, &add, f);
+                                } else if (k == 9) {
+                                        double d;
+
+                                        memcpy(&d, &value, sizeof(d));
+                                        r = json_variant_new_real(arena, &add, d);
+                                } else {
+                                        /* 'undefined', other simple values and half precision floats */
+                                        r = -EBADMSG;
+                                        goto finish;
+                                }
+                                break;
+
+                        default: /* Byte strings and tags have no counterpart in JSON */
+                                r = -EBADMSG;
+                                goto finish;
+                        }
+                        if (r < 0)
+                                goto finish;
+
+                        current->n_left--;
+                }
+
+                if (FLAGS_SET(flags, SD_JSON_PARSE_SENSITIVE))
+                        sd_json_variant_sensitive(add);
+
+                if (!GREEDY_REALLOC(current->elements, current->n_elements + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                current->elements[current->n_elements++] = TAKE_PTR(add);
+        }
+
+        if (p != e) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        assert(stack[0].n_elements == 1);
+
+        r = json_parse_take_root(arena, stack[0].elements[0], ret);
+
+finish:
+        for (size_t i = 0; i < MALLOC_ELEMENTSOF(stack); i++)
+                json_stack_release(stack + i);
+
+        free(stack);
+
+        if (arena) {
+                json_arena_trim(arena);
+                sd_json_variant_unref(&arena->anchor);
+        }
+
+        return r;
+}
+
+static int json_cmp_strings(const void *x, const void *y) {
+        sd_json_variant *const *a = x, *const *b = y;
+
+        if (!sd_json_variant_is_string(*a) || !sd_json_variant_is_string(*b))
+                return CMP(*a, *b);
+
+        return strcmp(sd_json_variant_string(*a), sd_json_variant_string(*b));
+}
+
 _public_ int sd_json_buildv(sd_json_variant **ret, va_list ap) {
         JsonStack *stack = NULL;
         size_t n_stack = 1;
@@ -4153,6 +5029,7 @@ _public_ int sd_json_buildv(sd_json_variant **ret, va_list ap) {
                 }
 
                 case _SD_JSON_BUILD_OBJECT_BEGIN:
+                case _JSON_BUILD_OBJECT_SORTED_BEGIN:
 
                         if (!IN_SET(current->expect, EXPECT_TOPLEVEL, EXPECT_OBJECT_VALUE, EXPECT_ARRAY_ELEMENT)) {
                                 r = -EINVAL;
@@ -4178,6 +5055,7 @@ _public_ int sd_json_buildv(sd_json_variant **ret, va_list ap) {
                                                                                         * new object, then we should
                                                                                         * also suppress all object
                                                                                         * members. */
+                                .sort = command == _JSON_BUILD_OBJECT_SORTED_BEGIN,
                         };
 
                         break;
@@ -4192,6 +5070,21 @@ _public_ int sd_json_buildv(sd_json_variant **ret, va_list ap) {
                         assert(n_stack > 1);
 
                         if (current->n_suppress == 0) {
+                                /* Sorted objects can be looked up by bisection later on. qsort() isn't stable,
+                                 * hence which of several fields with the same key comes first would be
+                                 * arbitrary. Refuse those. */
+                                if (current->sort && current->n_elements > 2) {
+                                        qsort(current->elements, current->n_elements / 2,
+                                              sizeof(sd_json_variant*) * 2, json_cmp_strings);
+
+                                        for (size_t i = 2; i < current->n_elements; i += 2)
+                                                if (json_cmp_strings(current->elements + i - 2,
+                                                                     current->elements + i) == 0) {
+                                                        r = -ENOTUNIQ;
+                                                        goto finish;
+                                                }
+                                }
+
                                 r = sd_json_variant_new_object(&add, current->elements, current->n_elements);
                                 if (r < 0)
                                         goto finish;
@@ -4658,6 +5551,75 @@ static void *dispatch_userdata(const sd_json_dispatch_field *p, void *userdata)
         return SIZE_TO_PTR(p->offset);
 }
 
+/* Dispatch tables with at least this many entries are looked up via a hash index */
+#define JSON_DISPATCH_INDEX_MIN 8U
+
+typedef struct JsonDispatchIndex {
+        size_t n_buckets;      /* always a power of two */
+        size_t *buckets;       /* table index + 1, 0 for an empty bucket */
+        size_t wildcard;       /* index of the first POINTER_MAX entry, or SIZE_MAX */
+} JsonDispatchIndex;
+
+static void json_dispatch_index_fill(JsonDispatchIndex *index, const sd_json_dispatch_field table[]) {
+        assert(index);
+        assert(index->buckets);
+        assert(index->n_buckets > 0 && (index->n_buckets & (index->n_buckets - 1)) == 0);
+
+        index->wildcard = SIZE_MAX;
+
+        for (const sd_json_dispatch_field *p = table; p->name; p++) {
+                size_t b;
+
+                if (p->name == POINTER_MAX) {
+                        if (index->wildcard == SIZE_MAX)
+                                index->wildcard = p - table;
+                        continue;
+                }
+
+                for (b = json_field_hash(p->name) & (index->n_buckets - 1);
+                     index->buckets[b] != 0;
+                     b = (b + 1) & (index->n_buckets - 1))
+                        if (streq(table[index->buckets[b] - 1].name, p->name))
+                                break;
+
+                /* If a name is listed twice, the first entry wins, like with the linear search */
+                if (index->buckets[b] == 0)
+                        index->buckets[b] = p - table + 1;
+        }
+}
+
+static const sd_json_dispatch_field* json_dispatch_lookup(
+                const sd_json_dispatch_field table[],
+                const JsonDispatchIndex *index,
+                const char *name) {
+
+        size_t i = SIZE_MAX;
+
+        assert(index);
+
+        if (!index->buckets) {
+                for (const sd_json_dispatch_field *p = table; p->name; p++)
+                        if (p->name == POINTER_MAX ||
+                            streq_ptr(name, p->name))
+                                return p;
+
+                return NULL;
+        }
+
+        if (name)
+                for (size_t b = json_field_hash(name) & (index->n_buckets - 1);
+                     index->buckets[b] != 0;
+                     b = (b + 1) & (index->n_buckets - 1))
+                        if (streq(table[index->buckets[b] - 1].name, name)) {
+                                i = index->buckets[b] - 1;
+                                break;
+                        }
+
+        /* A catch-all entry listed before the matching one takes precedence */
+        i = MIN(i, index->wildcard);
+        return i == SIZE_MAX ? NULL : table + i;
+}
+
 _public_ int sd_json_dispatch_full(
                 sd_json_variant *v,
                 const sd_json_dispatch_field table[],
@@ -4665,9 +5627,10 @@ _public_ int sd_json_dispatch_full(
                 sd_json_dispatch_flags_t flags,
                 void *userdata,
                 const char **reterr_bad_field) {
+        JsonDispatchIndex index = {};
+        uint64_t *found;
         size_t m;
         int r, done = 0;
-        bool *found;
 
         if (!sd_json_variant_is_object(v)) {
                 json_log(v, flags, 0, "JSON variant is not an object.");
@@ -4685,9 +5648,18 @@ _public_ int sd_json_dispatch_full(
         for (const sd_json_dispatch_field *p = table; p->name; p++)
                 m++;
 
-        found = newa0(bool, m);
+        found = newa0(uint64_t, DIV_ROUND_UP(m, 64));
 
         size_t n = sd_json_variant_elements(v);
+
+        /* Comparing each key with each table entry is quadratic, hence for larger tables and objects build
+         * a hash index first. The tables are frequently on the caller's stack, so this is not cached. */
+        if (m >= JSON_DISPATCH_INDEX_MIN && n > 2) {
+                index.n_buckets = 1U << log2u_round_up(m * 2);
+                index.buckets = newa0(size_t, index.n_buckets);
+                json_dispatch_index_fill(&index, table);
+        }
+
         for (size_t i = 0; i < n; i += 2) {
                 sd_json_variant *key, *value;
                 const sd_json_dispatch_field *p;
@@ -4695,12 +5667,8 @@ _public_ int sd_json_dispatch_full(
                 assert_se(key = sd_json_variant_by_index(v, i));
                 assert_se(value = sd_json_variant_by_index(v, i+1));
 
-                for (p = table; p->name; p++)
-                        if (p->name == POINTER_MAX ||
-                            streq_ptr(sd_json_variant_string(key), p->name))
-                                break;
-
-                if (p->name) { /* Found a matching entry! 🙂 */
+                p = json_dispatch_lookup(table, &index, sd_json_variant_string(key));
+                if (p) { /* Found a matching entry! 🙂 */
                         sd_json_dispatch_flags_t merged_flags;
 
                         merged_flags = flags | p->flags;
@@ -4739,7 +5707,7 @@ _public_ int sd_json_dispatch_full(
                                 return -EINVAL;
                         }
 
-                        if (found[p-table]) {
+                        if (BIT_SET(found[(p-table) / 64], (p-table) % 64)) {
                                 json_log(value, merged_flags, 0, "Duplicate object field '%s'.", sd_json_variant_string(key));
 
                                 if (merged_flags & SD_JSON_PERMISSIVE)
@@ -4751,7 +5719,7 @@ _public_ int sd_json_dispatch_full(
                                 return -ENOTUNIQ;
                         }
 
-                        found[p-table] = true;
+                        SET_BIT(found[(p-table) / 64], (p-table) % 64);
 
                         if (p->callback) {
                                 r = p->callback(sd_json_variant_string(key), value, merged_flags, dispatch_userdata(p, userdata));
@@ -4804,7 +5772,7 @@ _public_ int sd_json_dispatch_full(
         for (const sd_json_dispatch_field *p = table; p->name; p++) {
                 sd_json_dispatch_flags_t merged_flags = p->flags | flags;
 
-                if ((merged_flags & SD_JSON_MANDATORY) && !found[p-table]) {
+                if ((merged_flags & SD_JSON_MANDATORY) && !BIT_SET(found[(p-table) / 64], (p-table) % 64)) {
                         json_log(v, merged_flags, 0, "Missing object field '%s'.", p->name);
 
                         if ((merged_flags & SD_JSON_PERMISSIVE))
@@ -5200,15 +6168,6 @@ _public_ int sd_json_dispatch_unsupported(const char *name, sd_json_variant *var
         return json_log(variant, flags, SYNTHETIC_ERRNO(EINVAL), "JSON field '%s' is not allowed in this object.", strna(name));
 }
 
-static int json_cmp_strings(const void *x, const void *y) {
-        sd_json_variant *const *a = x, *const *b = y;
-
-        if (!sd_json_variant_is_string(*a) || !sd_json_variant_is_string(*b))
-                return CMP(*a, *b);
-
-        return strcmp(sd_json_variant_string(*a), sd_json_variant_string(*b));
-}
-
 _public_ int sd_json_variant_sort(sd_json_variant **v) {
         _cleanup_free_ sd_json_variant **a = NULL;
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *n = NULL;
@@ -2,6 +2,8 @@
 
 #include <malloc.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 
 #include "sd-daemon.h"
 #include "sd-varlink.h"
@@ -15,12 +17,15 @@
 #include "hashmap.h"
 #include "io-util.h"
 #include "iovec-util.h"
+#include "json-internal.h"
 #include "json-util.h"
 #include "list.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "set.h"
+#include "signal-util.h"
 #include "socket-util.h"
+#include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -40,6 +45,9 @@
 #define VARLINK_BUFFER_MAX (16U*1024U*1024U)
 #define VARLINK_READ_SIZE (64U*1024U)
 #define VARLINK_COLLECT_MAX 1024U
+#define VARLINK_PIPELINE_MAX 64U
+#define VARLINK_DEFER_WRITE_MAX (64U*1024U)
+#define VARLINK_SERVER_THREADS_MAX 256U
 
 static const char* const varlink_state_table[_VARLINK_STATE_MAX] = {
         [VARLINK_IDLE_CLIENT]              = "idle-client",
@@ -793,6 +801,76 @@ static int varlink_write(sd_varlink *v) {
         return 1;
 }
 
+static int varlink_find_message(sd_varlink *v, size_t *ret_head, size_t *ret_size) {
+        const char *begin;
+
+        assert(v);
+        assert(ret_head);
+        assert(ret_size);
+
+        /* Looks for the next complete message in the input buffer. Returns > 0 if there is one, together
+         * with the size of its framing before and of the message itself, including the framing after it. */
+
+        if (v->input_buffer_unscanned <= 0)
+                return 0;
+
+        begin = v->input_buffer + v->input_buffer_index;
+
+        if (!v->cbor_input) {
+                const char *e;
+
+                /* JSON messages are terminated by a NUL byte */
+                e = memchr(begin + v->input_buffer_size - v->input_buffer_unscanned, 0, v->input_buffer_unscanned);
+                if (!e)
+                        return 0;
+
+                *ret_head = 0;
+                *ret_size = e - begin + 1;
+                return 1;
+        }
+
+        /* CBOR messages are prefixed by their size instead, itself encoded as CBOR unsigned integer. That way
+         * the stream remains a valid CBOR sequence (RFC 8742). */
+        unsigned major;
+        uint64_t size;
+        int k;
+
+        k = json_cbor_parse_head((const uint8_t*) begin, v->input_buffer_size, &major, &size);
+        if (k < 0)
+                return k;
+        if (k == 0)
+                return 0;
+        if (major != CBOR_MAJOR_UNSIGNED || size > VARLINK_BUFFER_MAX)
+                return -EBADMSG;
+        if (size > v->input_buffer_size - k)
+                return 0;
+
+        *ret_head = k;
+        *ret_size = size;
+        return 1;
+}
+
+static bool varlink_defer_write(sd_varlink *v) {
+        assert(v);
+
+        /* If we are a server and already received the next method call, let's process that first, so that
+         * the replies to method calls sent in a pipelined fashion are written out together. But don't hold
+         * back file descriptors, or too much data. */
+
+        if (v->state != VARLINK_IDLE_SERVER)
+                return false;
+        if (v->n_output_fds > 0 || v->output_queue)
+                return false;
+        if (v->output_buffer_size == 0 || v->output_buffer_size >= VARLINK_DEFER_WRITE_MAX)
+                return false;
+
+        if (v->current)
+                return true;
+
+        size_t head, size;
+        return varlink_find_message(v, &head, &size) > 0;
+}
+
 #define VARLINK_FDS_MAX (16U*1024U)
 
 static int varlink_read(sd_varlink *v) {
@@ -933,9 +1011,8 @@ static int varlink_read(sd_varlink *v) {
 }
 
 static int varlink_parse_message(sd_varlink *v) {
-        const char *e;
+        size_t head, sz;
         char *begin;
-        size_t sz;
         int r;
 
         assert(v);
@@ -948,24 +1025,32 @@ static int varlink_parse_message(sd_varlink *v) {
         assert(v->input_buffer_unscanned <= v->input_buffer_size);
         assert(v->input_buffer_index + v->input_buffer_size <= MALLOC_SIZEOF_SAFE(v->input_buffer));
 
-        begin = v->input_buffer + v->input_buffer_index;
-
-        e = memchr(begin + v->input_buffer_size - v->input_buffer_unscanned, 0, v->input_buffer_unscanned);
-        if (!e) {
+        r = varlink_find_message(v, &head, &sz);
+        if (r < 0) {
+                /* Without a message boundary we cannot possibly recover, see below */
+                v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
+                return varlink_log_errno(v, r, "Failed to parse message size: %m");
+        }
+        if (r == 0) {
                 v->input_buffer_unscanned = 0;
                 return 0;
         }
 
-        sz = e - begin + 1;
+        begin = v->input_buffer + v->input_buffer_index;
 
-        r = sd_json_parse(begin, 0, &v->current, NULL, NULL);
+        /* Messages are short-lived and usually dropped as a whole, hence allocate them from a single arena */
+        if (v->cbor_input)
+                r = json_parse_cbor((const uint8_t*) begin + head, sz, SD_JSON_PARSE_ARENA, &v->current);
+        else
+                r = sd_json_parse(begin, SD_JSON_PARSE_ARENA, &v->current, NULL, NULL);
+        sz += head;
         if (v->input_sensitive)
                 explicit_bzero_safe(begin, sz);
         if (r < 0) {
                 /* If we encounter a parse failure flush all data. We cannot possibly recover from this,
                  * hence drop all buffered data now. */
                 v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
-                return varlink_log_errno(v, r, "Failed to parse JSON: %m");
+                return varlink_log_errno(v, r, "Failed to parse %s: %m", v->cbor_input ? "CBOR" : "JSON");
         }
 
         if (v->input_sensitive) {
@@ -1258,6 +1343,41 @@ static int generic_method_get_interface_description(
                         SD_JSON_BUILD_PAIR_STRING("description", text));
 }
 
+static int generic_method_upgrade_encoding(
+                sd_varlink *link,
+                sd_json_variant *parameters,
+                sd_varlink_method_flags_t flags,
+                void *userdata) {
+
+        static const struct sd_json_dispatch_field dispatch_table[] = {
+                { "encoding", SD_JSON_VARIANT_STRING, sd_json_dispatch_const_string, 0, SD_JSON_MANDATORY },
+                {}
+        };
+        const char *encoding = NULL;
+        int r;
+
+        assert(link);
+
+        r = sd_varlink_dispatch(link, parameters, dispatch_table, &encoding);
+        if (r != 0)
+                return r;
+
+        if (!streq(encoding, "cbor"))
+                return sd_varlink_error_invalid_parameter_name(link, "encoding");
+
+        /* Without a reply the client couldn't know where the switch happens */
+        if (FLAGS_SET(flags, SD_VARLINK_METHOD_ONEWAY))
+                return 0;
+
+        r = sd_varlink_reply(link, NULL);
+        if (r < 0)
+                return r;
+
+        /* The reply still went out as JSON, everything after it and after the method call is CBOR */
+        link->cbor_input = link->cbor_output = true;
+        return 0;
+}
+
 static int varlink_dispatch_method(sd_varlink *v) {
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *parameters = NULL;
         sd_varlink_method_flags_t flags = 0;
@@ -1341,6 +1461,9 @@ static int varlink_dispatch_method(sd_varlink *v) {
                         callback = generic_method_get_info;
                 else if (streq(method, "org.varlink.service.GetInterfaceDescription"))
                         callback = generic_method_get_interface_description;
+                else if (streq(method, "io.systemd.UpgradeEncoding") &&
+                         FLAGS_SET(v->server->flags, SD_VARLINK_SERVER_ALLOW_CBOR))
+                        callback = generic_method_upgrade_encoding;
         }
 
         if (callback) {
@@ -1429,11 +1552,13 @@ _public_ int sd_varlink_process(sd_varlink *v) {
 
         sd_varlink_ref(v);
 
-        r = varlink_write(v);
-        if (r < 0)
-                varlink_log_errno(v, r, "Write failed: %m");
-        if (r != 0)
-                goto finish;
+        if (!varlink_defer_write(v)) {
+                r = varlink_write(v);
+                if (r < 0)
+                        varlink_log_errno(v, r, "Write failed: %m");
+                if (r != 0)
+                        goto finish;
+        }
 
         r = varlink_dispatch_reply(v);
         if (r < 0)
@@ -1808,19 +1933,32 @@ _public_ sd_varlink* sd_varlink_flush_close_unref(sd_varlink *v) {
         return sd_varlink_close_unref(v);
 }
 
-static int varlink_format_json(sd_varlink *v, sd_json_variant *m) {
+static int varlink_format_json(sd_varlink *v, sd_json_variant *m, bool cbor) {
         _cleanup_(erase_and_freep) char *text = NULL;
-        int sz, r;
+        uint8_t head[CBOR_HEAD_MAX];
+        size_t sz, head_size = 0;
+        int r;
 
         assert(v);
         assert(m);
 
-        sz = sd_json_variant_format(m, /* flags= */ 0, &text);
-        if (sz < 0)
-                return sz;
-        assert(text[sz] == '\0');
+        if (cbor) {
+                /* See varlink_find_message() for the framing */
+                r = json_variant_format_cbor(m, (uint8_t**) &text, &sz);
+                if (r < 0)
+                        return r;
 
-        if (v->output_buffer_size + sz + 1 > VARLINK_BUFFER_MAX)
+                head_size = json_cbor_format_head(head, CBOR_MAJOR_UNSIGNED, sz);
+        } else {
+                r = sd_json_variant_format(m, /* flags= */ 0, &text);
+                if (r < 0)
+                        return r;
+                assert(text[r] == '\0');
+
+                sz = r + 1; /* Include the trailing NUL byte */
+        }
+
+        if (v->output_buffer_size + head_size + sz > VARLINK_BUFFER_MAX)
                 return -ENOBUFS;
 
         if (DEBUG_LOGGING) {
@@ -1834,29 +1972,29 @@ static int varlink_format_json(sd_varlink *v, sd_json_variant *m) {
                 varlink_log(v, "Sending message: %s", censored_text);
         }
 
-        if (v->output_buffer_size == 0) {
+        if (v->output_buffer_size == 0 && head_size == 0) {
 
                 free_and_replace(v->output_buffer, text);
 
-                v->output_buffer_size = sz + 1;
+                v->output_buffer_size = sz;
                 v->output_buffer_index = 0;
 
         } else if (v->output_buffer_index == 0) {
 
-                if (!GREEDY_REALLOC(v->output_buffer, v->output_buffer_size + sz + 1))
+                if (!GREEDY_REALLOC(v->output_buffer, v->output_buffer_size + head_size + sz))
                         return -ENOMEM;
 
-                memcpy(v->output_buffer + v->output_buffer_size, text, sz + 1);
-                v->output_buffer_size += sz + 1;
+                memcpy(mempcpy(v->output_buffer + v->output_buffer_size, head, head_size), text, sz);
+                v->output_buffer_size += head_size + sz;
         } else {
                 char *n;
-                const size_t new_size = v->output_buffer_size + sz + 1;
+                const size_t new_size = v->output_buffer_size + head_size + sz;
 
                 n = new(char, new_size);
                 if (!n)
                         return -ENOMEM;
 
-                memcpy(mempcpy(n, v->output_buffer + v->output_buffer_index, v->output_buffer_size), text, sz + 1);
+                memcpy(mempcpy(mempcpy(n, v->output_buffer + v->output_buffer_index, v->output_buffer_size), head, head_size), text, sz);
 
                 free_and_replace(v->output_buffer, n);
                 v->output_buffer_size = new_size;
@@ -1880,7 +2018,7 @@ static int varlink_enqueue_json(sd_varlink *v, sd_json_variant *m) {
         /* If there are no file descriptors to be queued and no queue entries yet we can shortcut things and
          * append this entry directly to the output buffer */
         if (v->n_pushed_fds == 0 && !v->output_queue)
-                return varlink_format_json(v, m);
+                return varlink_format_json(v, m, v->cbor_output);
 
         /* Otherwise add a queue entry for this */
         q = varlink_json_queue_item_new(m, v->pushed_fds, v->n_pushed_fds);
@@ -1888,6 +2026,7 @@ static int varlink_enqueue_json(sd_varlink *v, sd_json_variant *m) {
                 return -ENOMEM;
 
         v->n_pushed_fds = 0; /* fds now belong to the queue entry */
+        q->cbor = v->cbor_output;
 
         LIST_INSERT_AFTER(queue, v->output_queue, v->output_queue_tail, q);
         v->output_queue_tail = q;
@@ -1915,7 +2054,7 @@ static int varlink_format_queue(sd_varlink *v) {
                                 return -ENOMEM;
                 }
 
-                r = varlink_format_json(v, q->data);
+                r = varlink_format_json(v, q->data, q->cbor);
                 if (r < 0)
                         return r;
 
@@ -2199,6 +2338,44 @@ _public_ int sd_varlink_call(
         return sd_varlink_call_full(v, method, parameters, ret_parameters, ret_error_id, NULL);
 }
 
+_public_ int sd_varlink_upgrade_cbor(sd_varlink *v) {
+        sd_json_variant *reply = NULL;
+        const char *error_id = NULL;
+        int r;
+
+        assert_return(v, -EINVAL);
+
+        if (v->cbor_output)
+                return 1;
+
+        r = sd_varlink_callbo(
+                        v,
+                        "io.systemd.UpgradeEncoding",
+                        &reply,
+                        &error_id,
+                        SD_JSON_BUILD_PAIR_STRING("encoding", "cbor"));
+        if (r < 0)
+                return r;
+        if (error_id) {
+                /* Servers from before the encoding was introduced don't know the method, stay with JSON
+                 * for them */
+                if (STR_IN_SET(error_id,
+                               SD_VARLINK_ERROR_METHOD_NOT_FOUND,
+                               SD_VARLINK_ERROR_METHOD_NOT_IMPLEMENTED,
+                               SD_VARLINK_ERROR_INVALID_PARAMETER)) {
+                        varlink_log(v, "Server does not support CBOR encoding, continuing with JSON.");
+                        return 0;
+                }
+
+                return sd_varlink_error_to_errno(error_id, reply);
+        }
+
+        /* The server switched right after sending the reply, and we didn't send anything since the call */
+        v->cbor_input = v->cbor_output = true;
+        varlink_log(v, "Switched to CBOR encoding.");
+        return 1;
+}
+
 _public_ int sd_varlink_callb_ap(
                 sd_varlink *v,
                 const char *method,
@@ -2253,6 +2430,152 @@ _public_ int sd_varlink_callb_full(
         return r;
 }
 
+_public_ int sd_varlink_call_many(
+                sd_varlink *v,
+                const char *method,
+                sd_json_variant **parameters,
+                size_t n,
+                sd_json_variant **ret_parameters,
+                const char **ret_error_ids) {
+
+        sd_json_variant **replies = NULL;
+        size_t n_sent = 0, n_received = 0;
+        int r;
+
+        assert_return(v, -EINVAL);
+        assert_return(method, -EINVAL);
+        assert_return(parameters || n == 0, -EINVAL);
+
+        if (v->state == VARLINK_DISCONNECTED)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
+        if (v->state != VARLINK_IDLE_CLIENT)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
+
+        assert(v->n_pending == 0); /* n_pending can't be > 0 if we are in VARLINK_IDLE_CLIENT state */
+
+        varlink_clear_current(v);
+
+        if (n == 0)
+                return 1;
+
+        replies = new0(sd_json_variant*, n);
+        if (!replies)
+                return log_oom_debug();
+
+        CLEANUP_ARRAY(replies, n_received, sd_json_variant_unref_many);
+
+        /* Issues the same method call with each of the specified parameters, without waiting for the replies
+         * in between. Replies come in the same order as the calls were made, hence each reply belongs to the
+         * oldest call still pending. Calls are enqueued as long as no more than VARLINK_PIPELINE_MAX are in
+         * flight, and all that are enqueued at once are written to the socket together. */
+
+        while (n_received < n) {
+
+                while (n_sent < n && v->n_pending < VARLINK_PIPELINE_MAX) {
+                        _cleanup_(sd_json_variant_unrefp) sd_json_variant *m = NULL;
+                        sd_json_variant *p = parameters[n_sent];
+
+                        r = varlink_sanitize_parameters(&p);
+                        if (r < 0) {
+                                varlink_log_errno(v, r, "Failed to sanitize parameters: %m");
+                                goto fail;
+                        }
+
+                        r = sd_json_buildo(
+                                        &m,
+                                        SD_JSON_BUILD_PAIR("method", SD_JSON_BUILD_STRING(method)),
+                                        SD_JSON_BUILD_PAIR("parameters", SD_JSON_BUILD_VARIANT(p)));
+                        if (r < 0) {
+                                varlink_log_errno(v, r, "Failed to build json message: %m");
+                                goto fail;
+                        }
+
+                        r = varlink_enqueue_json(v, m);
+                        if (r < 0) {
+                                varlink_log_errno(v, r, "Failed to enqueue json message: %m");
+                                goto fail;
+                        }
+
+                        varlink_set_state(v, VARLINK_CALLING);
+                        v->n_pending++;
+                        v->timestamp = now(CLOCK_MONOTONIC);
+                        n_sent++;
+                }
+
+                while (v->state == VARLINK_CALLING) {
+                        r = sd_varlink_process(v);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                continue;
+
+                        r = sd_varlink_wait(v, USEC_INFINITY);
+                        if (r < 0)
+                                return r;
+                }
+
+                switch (v->state) {
+
+                case VARLINK_CALLED:
+                        assert(v->current);
+                        assert(v->n_pending > 0);
+
+                        replies[n_received++] = TAKE_PTR(v->current);
+                        varlink_clear_current(v);
+
+                        v->n_pending--;
+                        varlink_set_state(v, v->n_pending > 0 ? VARLINK_CALLING : VARLINK_IDLE_CLIENT);
+                        break;
+
+                case VARLINK_PENDING_DISCONNECT:
+                case VARLINK_DISCONNECTED:
+                        return varlink_log_errno(v, SYNTHETIC_ERRNO(ECONNRESET), "Connection was closed.");
+
+                case VARLINK_PENDING_TIMEOUT:
+                        return varlink_log_errno(v, SYNTHETIC_ERRNO(ETIME), "Connection timed out.");
+
+                default:
+                        assert_not_reached();
+                }
+        }
+
+        /* If caller doesn't ask for the error strings, then let's return an error code in case of failure */
+        if (!ret_error_ids)
+                for (size_t i = 0; i < n; i++) {
+                        sd_json_variant *e = sd_json_variant_by_key(replies[i], "error");
+
+                        if (e)
+                                return sd_varlink_error_to_errno(
+                                                sd_json_variant_string(e),
+                                                sd_json_variant_by_key(replies[i], "parameters"));
+                }
+
+        /* Install the replies in the connection object, so that we can hand out pointers into them without
+         * passing over ownership, like for regular method call replies */
+        r = sd_json_variant_new_array(&v->current_collected, replies, n);
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to allocate JSON array: %m");
+
+        for (size_t i = 0; i < n; i++) {
+                sd_json_variant *e = sd_json_variant_by_key(replies[i], "error");
+
+                if (ret_parameters)
+                        ret_parameters[i] = sd_json_variant_by_key(replies[i], "parameters");
+                if (ret_error_ids)
+                        ret_error_ids[i] = e ? sd_json_variant_string(e) : NULL;
+        }
+
+        return 1;
+
+fail:
+        /* If some of the calls are already on their way the peer will reply to them, and we cannot tell
+         * those replies apart from the ones to later calls anymore. Hence give up on the connection. */
+        if (v->n_pending > 0)
+                sd_varlink_close(v);
+
+        return r;
+}
+
 _public_ int sd_varlink_collect_full(
                 sd_varlink *v,
                 const char *method,
@@ -3191,7 +3514,7 @@ _public_ int sd_varlink_server_new(sd_varlink_server **ret, sd_varlink_server_fl
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return((flags & ~(SD_VARLINK_SERVER_ROOT_ONLY|SD_VARLINK_SERVER_MYSELF_ONLY|SD_VARLINK_SERVER_ACCOUNT_UID|SD_VARLINK_SERVER_INHERIT_USERDATA|SD_VARLINK_SERVER_INPUT_SENSITIVE)) == 0, -EINVAL);
+        assert_return((flags & ~(SD_VARLINK_SERVER_ROOT_ONLY|SD_VARLINK_SERVER_MYSELF_ONLY|SD_VARLINK_SERVER_ACCOUNT_UID|SD_VARLINK_SERVER_INHERIT_USERDATA|SD_VARLINK_SERVER_INPUT_SENSITIVE|SD_VARLINK_SERVER_THREAD_SAFE|SD_VARLINK_SERVER_ALLOW_CBOR)) == 0, -EINVAL);
 
         s = new(sd_varlink_server, 1);
         if (!s)
@@ -3202,11 +3525,13 @@ _public_ int sd_varlink_server_new(sd_varlink_server **ret, sd_varlink_server_fl
                 .flags = flags,
                 .connections_max = sd_varlink_server_connections_max(NULL),
                 .connections_per_uid_max = sd_varlink_server_connections_per_uid_max(NULL),
+                .shard_stop_fd = -EBADF,
         };
 
+        /* Only list io.systemd.UpgradeEncoding() if we actually implement it */
         r = sd_varlink_server_add_interface_many(
                         s,
-                        &vl_interface_io_systemd,
+                        FLAGS_SET(flags, SD_VARLINK_SERVER_ALLOW_CBOR) ? &vl_interface_io_systemd_cbor : &vl_interface_io_systemd,
                         &vl_interface_org_varlink_service);
         if (r < 0)
                 return r;
@@ -3232,6 +3557,7 @@ static sd_varlink_server* varlink_server_destroy(sd_varlink_server *s) {
         hashmap_free(s->by_uid);
 
         sd_event_unref(s->event);
+        safe_close(s->shard_stop_fd);
 
         free(s->description);
 
@@ -3456,6 +3782,10 @@ static int varlink_server_create_listen_fd_socket(sd_varlink_server *s, int fd,
         assert(fd >= 0);
         assert(ret_ss);
 
+        /* The shards copied the list of sockets when they were started, they won't pick up new ones */
+        if (s->n_shards > 0)
+                return varlink_server_log_errno(s, SYNTHETIC_ERRNO(EBUSY), "Cannot add listening socket while server threads are running.");
+
         ss = new(VarlinkServerSocket, 1);
         if (!ss)
                 return log_oom_debug();
@@ -3723,9 +4053,216 @@ static VarlinkServerSocket* varlink_server_socket_destroy(VarlinkServerSocket *s
         return mfree(ss);
 }
 
+static int shard_on_stop(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        /* Don't read from the eventfd here: it is shared by all shards, and all of them need to see it. */
+        return sd_event_exit(sd_event_source_get_event(s), 0);
+}
+
+static int varlink_server_shard_setup(VarlinkServerShard *shard, sd_event **ret_event, sd_varlink_server **ret_server) {
+        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        const sd_varlink_interface *interface;
+        _cleanup_free_ char *description = NULL;
+        sd_varlink_server *parent;
+        const char *method;
+        void *callback;
+        int r;
+
+        assert(shard);
+        assert(ret_event);
+        assert(ret_server);
+
+        /* Runs in the shard's thread. Everything the shard uses is allocated here, so that it is also freed
+         * here again, and nothing allocated in one thread is ever released in another. The parent server is
+         * not changed while shards are running, hence we can read from it without locking. */
+
+        parent = ASSERT_PTR(shard->server);
+
+        r = sd_varlink_server_new(&s, parent->flags);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(interface, parent->interfaces) {
+                if (hashmap_contains(s->interfaces, interface->name))
+                        continue;
+
+                r = sd_varlink_server_add_interface(s, interface);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH_KEY(callback, method, parent->methods) {
+                r = sd_varlink_server_bind_method(s, method, callback);
+                if (r < 0)
+                        return r;
+        }
+
+        s->connect_callback = parent->connect_callback;
+        s->disconnect_callback = parent->disconnect_callback;
+        s->userdata = parent->userdata;
+
+        /* Connections are accounted per shard, hence split the limits between them */
+        s->connections_max = DIV_ROUND_UP(parent->connections_max, parent->n_threads);
+        s->connections_per_uid_max = DIV_ROUND_UP(parent->connections_per_uid_max, parent->n_threads);
+
+        r = asprintf(&description, "%s-shard%u", varlink_server_description(parent), shard->index);
+        if (r < 0)
+                return -ENOMEM;
+
+        free_and_replace(s->description, description);
+
+        r = sd_event_new(&e);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_io(e, NULL, parent->shard_stop_fd, EPOLLIN, shard_on_stop, NULL);
+        if (r < 0)
+                return r;
+
+        r = sd_varlink_server_attach_event(s, e, parent->event_priority);
+        if (r < 0)
+                return r;
+
+        /* All shards wait for connections on the same listening sockets, and the kernel hands each new
+         * connection to one of them. */
+        LIST_FOREACH(sockets, ss, parent->sockets) {
+                _cleanup_close_ int fd = -EBADF;
+
+                fd = fcntl(ss->fd, F_DUPFD_CLOEXEC, 3);
+                if (fd < 0)
+                        return -errno;
+
+                r = sd_varlink_server_listen_fd(s, fd);
+                if (r < 0)
+                        return r;
+
+                TAKE_FD(fd);
+        }
+
+        *ret_event = TAKE_PTR(e);
+        *ret_server = TAKE_PTR(s);
+        return 0;
+}
+
+static void* varlink_server_shard_thread(void *p) {
+        VarlinkServerShard *shard = ASSERT_PTR(p);
+        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        char name[16];
+        int r;
+
+        xsprintf(name, "sd-varlink/%u", shard->index);
+        (void) pthread_setname_np(pthread_self(), name);
+
+        r = varlink_server_shard_setup(shard, &e, &s);
+
+        /* Tell the parent how the setup went. After this the parent might stop us any time. */
+        if (loop_write(shard->ready_fd, &r, sizeof(r)) < 0 || r < 0)
+                return NULL;
+
+        r = sd_event_loop(e);
+        if (r < 0)
+                varlink_server_log_errno(s, r, "Event loop failed: %m");
+
+        /* Connections are closed by the exit callbacks already, and the listening socket copies together
+         * with the server */
+        return NULL;
+}
+
+static void varlink_server_stop_shards(sd_varlink_server *s) {
+        assert(s);
+
+        if (s->n_shards == 0)
+                return;
+
+        if (eventfd_write(s->shard_stop_fd, 1) < 0)
+                varlink_server_log_errno(s, errno, "Failed to signal server threads to stop, ignoring: %m");
+
+        FOREACH_ARRAY(shard, s->shards, s->n_shards)
+                (void) pthread_join(shard->thread, NULL);
+
+        s->shards = mfree(s->shards);
+        s->n_shards = 0;
+        s->shard_stop_fd = safe_close(s->shard_stop_fd);
+}
+
+static int varlink_server_start_shards(sd_varlink_server *s) {
+        _cleanup_close_pair_ int ready[2] = EBADF_PAIR;
+        sigset_t ss, saved_ss;
+        int r = 0;
+
+        assert(s);
+        assert(s->n_threads > 0);
+        assert(s->n_shards == 0);
+
+        s->shard_stop_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (s->shard_stop_fd < 0)
+                return -errno;
+
+        if (pipe2(ready, O_CLOEXEC) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        s->shards = new0(VarlinkServerShard, s->n_threads);
+        if (!s->shards) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        /* Like sd-resolve, make sure the threads don't steal any signals from the caller */
+        assert_se(sigfillset(&ss) >= 0);
+        r = -pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r < 0)
+                goto fail;
+
+        for (unsigned i = 0; i < s->n_threads; i++) {
+                VarlinkServerShard *shard = s->shards + s->n_shards;
+
+                *shard = (VarlinkServerShard) {
+                        .server = s,
+                        .index = i,
+                        .ready_fd = ready[1],
+                };
+
+                r = -pthread_create(&shard->thread, NULL, varlink_server_shard_thread, shard);
+                if (r < 0)
+                        break;
+
+                s->n_shards++;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        /* Wait for every thread we started, even if starting some other failed, so that the shards are
+         * fully set up or torn down once we return */
+        for (size_t i = 0; i < s->n_shards; i++) {
+                int k, q;
+
+                k = loop_read_exact(ready[0], &q, sizeof(q), /* do_poll= */ false);
+                if (k < 0)
+                        q = k;
+                if (q < 0 && r >= 0)
+                        r = q;
+        }
+        if (r < 0)
+                goto fail;
+
+        varlink_server_log(s, "Started %zu server threads.", s->n_shards);
+        return 0;
+
+fail:
+        varlink_server_stop_shards(s);
+        s->shards = mfree(s->shards);
+        s->shard_stop_fd = safe_close(s->shard_stop_fd);
+        return varlink_server_log_errno(s, r, "Failed to start server threads: %m");
+}
+
 _public_ int sd_varlink_server_shutdown(sd_varlink_server *s) {
         assert_return(s, -EINVAL);
 
+        varlink_server_stop_shards(s);
+
         while (s->sockets)
                 varlink_server_socket_destroy(s->sockets);
 
@@ -3741,12 +4278,24 @@ static void varlink_server_test_exit_on_idle(sd_varlink_server *s) {
 
 _public_ int sd_varlink_server_set_exit_on_idle(sd_varlink_server *s, int b) {
         assert_return(s, -EINVAL);
+        assert_return(!b || s->n_threads == 0, -EOPNOTSUPP);
 
         s->exit_on_idle = b;
         varlink_server_test_exit_on_idle(s);
         return 0;
 }
 
+_public_ int sd_varlink_server_set_threads(sd_varlink_server *s, unsigned n) {
+        assert_return(s, -EINVAL);
+        assert_return(n <= VARLINK_SERVER_THREADS_MAX, -ERANGE);
+        assert_return(n == 0 || FLAGS_SET(s->flags, SD_VARLINK_SERVER_THREAD_SAFE), -EOPNOTSUPP);
+        assert_return(n == 0 || !s->exit_on_idle, -EOPNOTSUPP);
+        assert_return(!s->event, -EBUSY);
+
+        s->n_threads = n;
+        return 0;
+}
+
 int varlink_server_add_socket_event_source(sd_varlink_server *s, VarlinkServerSocket *ss, int64_t priority) {
         _cleanup_(sd_event_source_unrefp) sd_event_source *es = NULL;
         int r;
@@ -3783,13 +4332,23 @@ _public_ int sd_varlink_server_attach_event(sd_varlink_server *s, sd_event *e, i
                         return r;
         }
 
+        s->event_priority = priority;
+
+        /* With threads the shards listen on the sockets in their own event loops, not us */
+        if (s->n_threads > 0) {
+                r = varlink_server_start_shards(s);
+                if (r < 0)
+                        goto fail;
+
+                return 0;
+        }
+
         LIST_FOREACH(sockets, ss, s->sockets) {
                 r = varlink_server_add_socket_event_source(s, ss, priority);
                 if (r < 0)
                         goto fail;
         }
 
-        s->event_priority = priority;
         return 0;
 
 fail:
@@ -3800,6 +4359,8 @@ fail:
 _public_ int sd_varlink_server_detach_event(sd_varlink_server *s) {
         assert_return(s, -EINVAL);
 
+        varlink_server_stop_shards(s);
+
         LIST_FOREACH(sockets, ss, s->sockets)
                 ss->event_source = sd_event_source_disable_unref(ss->event_source);
 
@@ -3836,6 +4397,7 @@ _public_ int sd_varlink_server_bind_method(sd_varlink_server *s, const char *met
         assert_return(s, -EINVAL);
         assert_return(method, -EINVAL);
         assert_return(callback, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         if (varlink_symbol_in_interface(method, "org.varlink.service") ||
             varlink_symbol_in_interface(method, "io.systemd"))
@@ -3884,6 +4446,7 @@ _public_ int sd_varlink_server_bind_method_many_internal(sd_varlink_server *s, .
 
 _public_ int sd_varlink_server_bind_connect(sd_varlink_server *s, sd_varlink_connect_t callback) {
         assert_return(s, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         if (callback && s->connect_callback && callback != s->connect_callback)
                 return varlink_server_log_errno(s, SYNTHETIC_ERRNO(EBUSY), "A different callback was already set.");
@@ -3894,6 +4457,7 @@ _public_ int sd_varlink_server_bind_connect(sd_varlink_server *s, sd_varlink_con
 
 _public_ int sd_varlink_server_bind_disconnect(sd_varlink_server *s, sd_varlink_disconnect_t callback) {
         assert_return(s, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         if (callback && s->disconnect_callback && callback != s->disconnect_callback)
                 return varlink_server_log_errno(s, SYNTHETIC_ERRNO(EBUSY), "A different callback was already set.");
@@ -3908,6 +4472,7 @@ _public_ int sd_varlink_server_add_interface(sd_varlink_server *s, const sd_varl
         assert_return(s, -EINVAL);
         assert_return(interface, -EINVAL);
         assert_return(interface->name, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         if (hashmap_contains(s->interfaces, interface->name))
                 return varlink_server_log_errno(s, SYNTHETIC_ERRNO(EEXIST), "Duplicate registration of interface '%s'.", interface->name);
@@ -3993,6 +4558,7 @@ _public_ unsigned sd_varlink_server_connections_per_uid_max(sd_varlink_server *s
 _public_ int sd_varlink_server_set_connections_per_uid_max(sd_varlink_server *s, unsigned m) {
         assert_return(s, -EINVAL);
         assert_return(m > 0, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         s->connections_per_uid_max = m;
         return 0;
@@ -4001,6 +4567,7 @@ _public_ int sd_varlink_server_set_connections_per_uid_max(sd_varlink_server *s,
 _public_ int sd_varlink_server_set_connections_max(sd_varlink_server *s, unsigned m) {
         assert_return(s, -EINVAL);
         assert_return(m > 0, -EINVAL);
+        assert_return(s->n_shards == 0, -EBUSY);
 
         s->connections_max = m;
         return 0;
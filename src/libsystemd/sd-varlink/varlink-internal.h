@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include <pthread.h>
 #include <sys/socket.h>
 
 #include "sd-event.h"
@@ -71,6 +72,7 @@ typedef struct VarlinkJsonQueueItem VarlinkJsonQueueItem;
 struct VarlinkJsonQueueItem {
         LIST_FIELDS(VarlinkJsonQueueItem, queue);
         sd_json_variant *data;
+        bool cbor; /* The encoding is fixed when the message is enqueued, not when it is formatted */
         size_t n_fds;
         int fds[];
 };
@@ -165,6 +167,11 @@ struct sd_varlink {
         bool output_buffer_sensitive:1; /* whether to erase the output buffer after writing it to the socket */
         bool input_sensitive:1; /* Whether incoming messages might be sensitive */
 
+        /* Whether messages are encoded in CBOR rather than JSON, after a successful
+         * io.systemd.UpgradeEncoding() call. Each direction switches right after the reply to it. */
+        bool cbor_input:1;
+        bool cbor_output:1;
+
         int af; /* address family if socket; AF_UNSPEC if not socket; negative if not known */
 
         usec_t timestamp;
@@ -196,6 +203,13 @@ struct VarlinkServerSocket {
         LIST_FIELDS(VarlinkServerSocket, sockets);
 };
 
+typedef struct VarlinkServerShard {
+        sd_varlink_server *server;     /* The server we are a shard of. Only read from the shard's thread. */
+        unsigned index;
+        pthread_t thread;
+        int ready_fd;                  /* The shard writes the result of its setup here */
+} VarlinkServerShard;
+
 struct sd_varlink_server {
         unsigned n_ref;
         sd_varlink_server_flags_t flags;
@@ -221,6 +235,13 @@ struct sd_varlink_server {
         unsigned connections_per_uid_max;
 
         bool exit_on_idle;
+
+        /* If threads are requested, each thread runs a copy of this server with its own event loop, which
+         * accepts connections on the listening sockets on its own. */
+        unsigned n_threads;
+        VarlinkServerShard *shards;
+        size_t n_shards;
+        int shard_stop_fd;             /* eventfd, becomes readable when the shards shall exit */
 };
 
 #define varlink_log_errno(v, error, fmt, ...)                           \
@@ -12,6 +12,12 @@ static SD_VARLINK_DEFINE_ERROR(
                 System,
                 SD_VARLINK_DEFINE_FIELD(errno, SD_VARLINK_INT, 0));
 
+/* Implemented by servers created with SD_VARLINK_SERVER_ALLOW_CBOR. After the reply both sides switch to the
+ * requested encoding of messages, see sd_varlink_upgrade_cbor(). */
+static SD_VARLINK_DEFINE_METHOD(
+                UpgradeEncoding,
+                SD_VARLINK_DEFINE_INPUT(encoding, SD_VARLINK_STRING, 0));
+
 SD_VARLINK_DEFINE_INTERFACE(
                 io_systemd,
                 "io.systemd",
@@ -19,3 +25,13 @@ SD_VARLINK_DEFINE_INTERFACE(
                 &vl_error_TimedOut,
                 &vl_error_Protocol,
                 &vl_error_System);
+
+/* The same, for servers that allow switching to CBOR */
+SD_VARLINK_DEFINE_INTERFACE(
+                io_systemd_cbor,
+                "io.systemd",
+                &vl_method_UpgradeEncoding,
+                &vl_error_Disconnected,
+                &vl_error_TimedOut,
+                &vl_error_Protocol,
+                &vl_error_System);
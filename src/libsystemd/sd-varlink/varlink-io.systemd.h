@@ -4,3 +4,4 @@
 #include "sd-varlink-idl.h"
 
 extern const sd_varlink_interface vl_interface_io_systemd;
+extern const sd_varlink_interface vl_interface_io_systemd_cbor;
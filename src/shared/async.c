@@ -34,54 +34,75 @@ int asynchronous_sync(pid_t *ret_pid) {
         return 0;
 }
 
-/* We encode the fd to close in the userdata pointer as an unsigned value. The highest bit indicates whether
- * we need to fork again */
-#define NEED_DOUBLE_FORK (1U << (sizeof(unsigned) * 8 - 1))
+typedef struct CloseArgs {
+        const int *fds;
+        size_t n_fds;
+        bool need_double_fork;
+} CloseArgs;
 
 static int close_func(void *p) {
-        unsigned v = PTR_TO_UINT(p);
+        CloseArgs *a = ASSERT_PTR(p);
 
         (void) prctl(PR_SET_NAME, (unsigned long*) "(sd-close)");
 
         /* Note: 💣 This function is invoked in a child process created via glibc's clone() wrapper. In such
          *       children memory allocation is not allowed, since glibc does not release malloc mutexes in
-         *       clone() 💣 */
+         *       clone() 💣
+         *
+         * Since we clone() without CLONE_VM we operate on a copy of the parent's memory here, hence it's
+         * fine to access the fd array the parent passed to us, even if the parent frees it right away. */
 
-        if (v & NEED_DOUBLE_FORK) {
+        if (a->need_double_fork) {
                 pid_t pid;
 
-                v &= ~NEED_DOUBLE_FORK;
+                a->need_double_fork = false;
 
                 /* This inner child will be reparented to the subreaper/PID 1. Here we turn on SIGCHLD, so
                  * that the reaper knows when it's time to reap. */
-                pid = clone_with_nested_stack(close_func, SIGCHLD|CLONE_FILES, UINT_TO_PTR(v));
+                pid = clone_with_nested_stack(close_func, SIGCHLD|CLONE_FILES, a);
                 if (pid >= 0)
                         return 0;
         }
 
-        close((int) v); /* no assert() here, we are in the child and the result would be eaten up anyway */
+        /* no assert() here, we are in the child and the result would be eaten up anyway */
+        for (size_t i = 0; i < a->n_fds; i++)
+                if (a->fds[i] >= 0)
+                        (void) close(a->fds[i]);
+
         return 0;
 }
 
-int asynchronous_close(int fd) {
-        unsigned v;
+void asynchronous_close_many(const int fds[], size_t n_fds) {
+        CloseArgs a = {
+                .fds = fds,
+                .n_fds = n_fds,
+        };
+        bool any = false;
         pid_t pid;
         int r;
 
-        /* This is supposed to behave similar to safe_close(), but actually invoke close() asynchronously, so
-         * that it will never block. Ideally the kernel would have an API for this, but it doesn't, so we
+        /* This is supposed to behave similar to close_many(), but actually invoke close() asynchronously,
+         * so that it will never block. Ideally the kernel would have an API for this, but it doesn't, so we
          * work around it, and hide this as a far away as we can.
          *
          * It is important to us that we don't use threads (via glibc pthread) in PID 1, hence we'll do a
-         * minimal subprocess instead which shares our fd table via CLONE_FILES. */
+         * minimal subprocess instead which shares our fd table via CLONE_FILES. A single subprocess closes
+         * all specified fds, hence callers releasing many fds at once should pass them in one go rather
+         * than calling asynchronous_close() for each, which would fork off one subprocess per fd.
+         *
+         * Negative fds are skipped. The fds must be distinct, as otherwise the subprocess might close an
+         * fd that we have allocated again in the meantime under the same number. */
 
-        if (fd < 0)
-                return -EBADF; /* already invalid */
+        FOREACH_ARRAY(fd, fds, n_fds)
+                if (*fd >= 0) {
+                        any = true;
+                        break;
+                }
+        if (!any)
+                return;
 
         PROTECT_ERRNO;
 
-        v = (unsigned) fd;
-
         /* We want to fork off a process that is automatically reaped. For that we'd usually double-fork. But
          * we can optimize this a bit: if we are PID 1 or a subreaper anyway (the systemd service manager
          * process qualifies as this), we can avoid the double forking, since the double forked process would
@@ -90,12 +111,13 @@ int asynchronous_close(int fd) {
         if (r < 0)
                 log_debug_errno(r, "Cannot determine if we are a reaper process, assuming we are not: %m");
         if (r <= 0)
-                v |= NEED_DOUBLE_FORK;
+                a.need_double_fork = true;
 
-        pid = clone_with_nested_stack(close_func, CLONE_FILES | ((v & NEED_DOUBLE_FORK) ? 0 : SIGCHLD), UINT_TO_PTR(v));
+        pid = clone_with_nested_stack(close_func, CLONE_FILES | (a.need_double_fork ? 0 : SIGCHLD), &a);
         if (pid < 0)
-                safe_close(fd); /* local fallback */
-        else if (v & NEED_DOUBLE_FORK) {
+                FOREACH_ARRAY(fd, fds, n_fds)
+                        safe_close(*fd); /* local fallback */
+        else if (a.need_double_fork) {
 
                 /* Reap the intermediate child. Key here is that we specify __WCLONE, since we didn't ask for
                  * any signal to be sent to us on process exit, and otherwise waitid() would refuse waiting
@@ -107,6 +129,13 @@ int asynchronous_close(int fd) {
                         if (waitpid(pid, NULL, __WCLONE) >= 0 || errno != EINTR)
                                 break;
         }
+}
+
+int asynchronous_close(int fd) {
+        if (fd < 0)
+                return -EBADF; /* already invalid */
+
+        asynchronous_close_many(&fd, 1);
 
         return -EBADF; /* return an invalidated fd */
 }
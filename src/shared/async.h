@@ -21,6 +21,7 @@
 
 int asynchronous_sync(pid_t *ret_pid);
 int asynchronous_close(int fd);
+void asynchronous_close_many(const int fds[], size_t n_fds);
 int asynchronous_rm_rf(const char *p, RemoveFlags flags);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(int, asynchronous_close);
@@ -25,6 +25,7 @@
 #include "env-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "mempool.h"
 #include "memstream-util.h"
 #include "path-util.h"
 #include "socket-util.h"
@@ -242,6 +243,10 @@ int bus_connect_system_systemd(sd_bus **ret_bus) {
         if (r < 0)
                 return r;
 
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_system(ret_bus);
@@ -278,6 +283,10 @@ int bus_connect_user_systemd(sd_bus **ret_bus) {
         if (!bus->address)
                 return -ENOMEM;
 
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_user(ret_bus);
@@ -785,6 +794,9 @@ static int method_dump_memory_state_by_fd(sd_bus_message *message, void *userdat
         if (r < 0)
                 return r;
 
+        /* Objects handed out from our own memory pools are invisible to malloc, list them separately */
+        mempool_info(f);
+
         r = memstream_finalize(&m, &dump, &dump_size);
         if (r < 0)
                 return r;
@@ -164,6 +164,7 @@ int sd_bus_get_description(sd_bus *bus, const char **description);
 int sd_bus_negotiate_creds(sd_bus *bus, int b, uint64_t creds_mask);
 int sd_bus_negotiate_timestamp(sd_bus *bus, int b);
 int sd_bus_negotiate_fds(sd_bus *bus, int b);
+int sd_bus_negotiate_memfd(sd_bus *bus, int b);
 int sd_bus_can_send(sd_bus *bus, char type);
 int sd_bus_get_creds_mask(sd_bus *bus, uint64_t *creds_mask);
 int sd_bus_set_allow_interactive_authorization(sd_bus *bus, int b);
@@ -172,6 +173,8 @@ int sd_bus_set_exit_on_disconnect(sd_bus *bus, int b);
 int sd_bus_get_exit_on_disconnect(sd_bus *bus);
 int sd_bus_set_close_on_exit(sd_bus *bus, int b);
 int sd_bus_get_close_on_exit(sd_bus *bus);
+int sd_bus_set_property_cache(sd_bus *bus, int b);
+int sd_bus_get_property_cache(sd_bus *bus);
 int sd_bus_set_watch_bind(sd_bus *bus, int b);
 int sd_bus_get_watch_bind(sd_bus *bus);
 int sd_bus_set_connected_signal(sd_bus *bus, int b);
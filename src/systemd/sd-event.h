@@ -118,6 +118,8 @@ int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
 int sd_event_set_signal_exit(sd_event *e, int b);
+int sd_event_set_statistics(sd_event *e, int b);
+int sd_event_get_statistics(sd_event *e);
 
 sd_event_source* sd_event_source_ref(sd_event_source *s);
 sd_event_source* sd_event_source_unref(sd_event_source *s);
@@ -175,6 +177,7 @@ int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_interval_use
 int sd_event_source_is_ratelimited(sd_event_source *s);
 int sd_event_source_set_ratelimit_expire_callback(sd_event_source *s, sd_event_handler_t callback);
 int sd_event_source_leave_ratelimit(sd_event_source *s);
+int sd_event_source_get_statistics(sd_event_source *s, uint64_t *ret_n_dispatched, uint64_t *ret_dispatch_usec, uint64_t *ret_dispatch_max_usec, uint64_t *ret_pending_usec);
 
 int sd_event_trim_memory(void);
 
@@ -70,6 +70,8 @@ __extension__ typedef enum _SD_ENUM_TYPE_S64(sd_varlink_server_flags_t) {
         SD_VARLINK_SERVER_ACCOUNT_UID      = 1 << 2, /* Do per user accounting */
         SD_VARLINK_SERVER_INHERIT_USERDATA = 1 << 3, /* Initialize Varlink connection userdata from VarlinkServer userdata */
         SD_VARLINK_SERVER_INPUT_SENSITIVE  = 1 << 4, /* Automatically mark all connection input as sensitive */
+        SD_VARLINK_SERVER_THREAD_SAFE      = 1 << 5, /* Method and (dis)connect callbacks may be called from multiple threads at once */
+        SD_VARLINK_SERVER_ALLOW_CBOR       = 1 << 6, /* Let clients switch to CBOR encoding, see sd_varlink_upgrade_cbor() */
         _SD_ENUM_FORCE_S64(SD_VARLINK_SERVER)
 } sd_varlink_server_flags_t;
 
@@ -132,6 +134,15 @@ int sd_varlink_callb(sd_varlink *v, const char *method, sd_json_variant **ret_pa
 #define sd_varlink_callbo(v, method, ret_parameters, ret_error_id, ...)    \
         sd_varlink_callb((v), (method), (ret_parameters), (ret_error_id), SD_JSON_BUILD_OBJECT(__VA_ARGS__))
 
+/* Send the same method call once for each of the specified parameter objects, without waiting for replies
+ * in between, and wait for all replies. The nth reply is returned in the nth element of the output arrays. */
+int sd_varlink_call_many(sd_varlink *v, const char *method, sd_json_variant **parameters, size_t n, sd_json_variant **ret_parameters, const char **ret_error_ids);
+
+/* Switch the connection to the more compact CBOR encoding of messages, if the server supports it, i.e. was
+ * created with SD_VARLINK_SERVER_ALLOW_CBOR. Returns > 0 if it did, 0 if the connection continues to use
+ * JSON. */
+int sd_varlink_upgrade_cbor(sd_varlink *v);
+
 /* Send method call and begin collecting all 'more' replies into an array, finishing when a final reply is sent */
 int sd_varlink_collect_full(sd_varlink *v, const char *method, sd_json_variant *parameters, sd_json_variant **ret_parameters, const char **ret_error_id, sd_varlink_reply_flags_t *ret_flags);
 int sd_varlink_collect(sd_varlink *v, const char *method, sd_json_variant *parameters, sd_json_variant **ret_parameters, const char **ret_error_id);
@@ -252,6 +263,10 @@ int sd_varlink_server_shutdown(sd_varlink_server *server);
 
 int sd_varlink_server_set_exit_on_idle(sd_varlink_server *s, int b);
 
+/* Serve connections from n threads, each with its own event loop, instead of the attached event loop. Requires
+ * SD_VARLINK_SERVER_THREAD_SAFE, and needs to be called before sd_varlink_server_attach_event(). */
+int sd_varlink_server_set_threads(sd_varlink_server *s, unsigned n);
+
 unsigned sd_varlink_server_connections_max(sd_varlink_server *s);
 unsigned sd_varlink_server_connections_per_uid_max(sd_varlink_server *s);
 
@@ -56,6 +56,25 @@ TEST(asynchronous_close) {
         }
 }
 
+TEST(asynchronous_close_many) {
+        int fds[] = { -EBADF, -EBADF, -EBADF, -EBADF };
+
+        for (size_t i = 1; i < ELEMENTSOF(fds); i++) {
+                fds[i] = open("/dev/null", O_RDONLY|O_CLOEXEC);
+                ASSERT_OK(fds[i]);
+        }
+
+        /* Negative entries are skipped */
+        asynchronous_close_many(fds, ELEMENTSOF(fds));
+
+        for (size_t i = 1; i < ELEMENTSOF(fds); i++)
+                wait_fd_closed(fds[i]);
+
+        /* Nothing to do at all */
+        asynchronous_close_many(NULL, 0);
+        asynchronous_close_many(fds, 1);
+}
+
 static void wait_rm_rf(const char *path) {
         for (unsigned trial = 0; trial < 100; trial++) {
                 usleep_safe(100 * USEC_PER_MSEC);
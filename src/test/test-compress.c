@@ -269,6 +269,53 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+typedef struct PushedData {
+        char *buf;
+        size_t size;
+} PushedData;
+
+static int decompressor_collect(const void *data, size_t size, void *userdata) {
+        PushedData *p = ASSERT_PTR(userdata);
+
+        assert_se(GREEDY_REALLOC(p->buf, p->size + size));
+        memcpy(p->buf + p->size, data, size);
+        p->size += size;
+        return 0;
+}
+
+static void test_decompressor_push_zstd(const char *data, size_t data_len) {
+        _cleanup_(decompressor_freep) Decompressor *d = NULL;
+        _cleanup_free_ char *compressed = NULL;
+        _cleanup_free_ char *collected = NULL;
+        PushedData p = {};
+        size_t csize1, csize2;
+
+        log_info("/* testing ZSTD push decompression */");
+
+        /* Two concatenated frames, as produced by uploaders compressing each chunk separately */
+        assert_se(compressed = malloc(2 * data_len));
+        assert_se(compress_blob_zstd(data, data_len, compressed, data_len, &csize1) >= 0);
+        assert_se(compress_blob_zstd(data, data_len, compressed + csize1, data_len, &csize2) >= 0);
+
+        assert_se(decompressor_new(&d, COMPRESSION_ZSTD) >= 0);
+
+        /* Feed the compressed stream in small pieces that do not align with frame boundaries */
+        for (size_t i = 0; i < csize1 + csize2; i += 7)
+                assert_se(decompressor_push(d, compressed + i, MIN((size_t) 7, csize1 + csize2 - i),
+                                            decompressor_collect, &p) >= 0);
+
+        collected = p.buf;
+        assert_se(p.size == 2 * data_len);
+        assert_se(memcmp(collected, data, data_len) == 0);
+        assert_se(memcmp(collected + data_len, data, data_len) == 0);
+
+        d = decompressor_free(d);
+        assert_se(decompressor_new(&d, COMPRESSION_ZSTD) >= 0);
+        assert_se(decompressor_push(d, "garbage", 7, decompressor_collect, &(PushedData) {}) < 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
 #if HAVE_COMPRESSION
         _unused_ const char text[] =
@@ -365,6 +412,8 @@ int main(int argc, char *argv[]) {
                              compress_stream_zstd, decompress_stream_zstd, srcfile);
 
         test_decompress_startswith_short("ZSTD", compress_blob_zstd, decompress_startswith_zstd);
+
+        test_decompressor_push_zstd(huge, HUGE_SIZE);
 #else
         log_info("/* ZSTD test skipped */");
 #endif
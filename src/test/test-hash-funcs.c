@@ -3,6 +3,7 @@
 #include "tests.h"
 #include "hash-funcs.h"
 #include "set.h"
+#include "strv.h"
 
 TEST(path_hash_set) {
         /* The goal is to make sure that non-simplified path are hashed as expected,
@@ -74,4 +75,61 @@ TEST(path_hash_set) {
         assert_se(!set_contains(set, "/////../bar/./"));
 }
 
+TEST(hash_bytes_trusted) {
+        uint64_t seen[129];
+        uint8_t buf[128];
+
+        for (size_t i = 0; i < sizeof(buf); i++)
+                buf[i] = i * 7;
+
+        /* Every length takes a different path through the function, make sure each one covers all of its
+         * input and the seed */
+        for (size_t n = 0; n <= sizeof(buf); n++) {
+                uint64_t h = hash_bytes_trusted(buf, n, 4711);
+
+                ASSERT_EQ(hash_bytes_trusted(buf, n, 4711), h);
+                ASSERT_NE(hash_bytes_trusted(buf, n, 4712), h);
+                for (size_t i = 0; i < n; i++)
+                        ASSERT_NE(seen[i], h);
+                seen[n] = h;
+
+                for (size_t i = 0; i < n; i++) {
+                        buf[i] ^= 1;
+                        ASSERT_NE(hash_bytes_trusted(buf, n, 4711), h);
+                        buf[i] ^= 1;
+                }
+        }
+
+        ASSERT_NE(hash_uint64_trusted(0, 0), hash_uint64_trusted(1, 0));
+        ASSERT_NE(hash_uint64_trusted(0, 0), hash_uint64_trusted(0, 1));
+        ASSERT_EQ(string_hash_func_trusted("foo", 1), hash_bytes_trusted("foo", 3, 1));
+}
+
+TEST(trusted_hash_ops) {
+        _cleanup_set_free_ Set *s = NULL;
+        char **names = STRV_MAKE("foo", "bar", "foo.service", "bar.service", "a-rather-long-unit-name-beyond-48-bytes.service");
+
+        STRV_FOREACH(n, names)
+                ASSERT_EQ(set_ensure_put(&s, &string_hash_ops_trusted, *n), 1);
+        STRV_FOREACH(n, names) {
+                ASSERT_EQ(set_ensure_put(&s, &string_hash_ops_trusted, *n), 0);
+                ASSERT_TRUE(set_contains(s, *n));
+        }
+        ASSERT_FALSE(set_contains(s, "baz"));
+        ASSERT_FALSE(set_contains(s, "foo.socket"));
+
+        s = set_free(s);
+
+        /* Enough entries to go through a couple of resizes */
+        for (unsigned i = 1; i <= 10000; i++)
+                ASSERT_EQ(set_ensure_put(&s, &trivial_hash_ops_trusted, UINT_TO_PTR(i)), 1);
+        for (unsigned i = 1; i <= 10000; i++)
+                ASSERT_TRUE(set_contains(s, UINT_TO_PTR(i)));
+        for (unsigned i = 1; i <= 10000; i += 2)
+                ASSERT_TRUE(set_remove(s, UINT_TO_PTR(i)) == UINT_TO_PTR(i));
+        for (unsigned i = 1; i <= 10000; i++)
+                ASSERT_EQ(set_contains(s, UINT_TO_PTR(i)), i % 2 == 0);
+        ASSERT_EQ(set_size(s), 5000u);
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Keys shaped like the ones PID 1 keeps in its tables: unit names hashed as strings, and objects hashed by
+ * their address. Misses are looked up with keys that are never inserted, but otherwise look the same. Each
+ * is run with SipHash and with the cheaper hash functions for trusted keys. */
+
+static char** make_names(unsigned n, const char *suffix) {
+        _cleanup_strv_free_ char **l = NULL;
+
+        ASSERT_NOT_NULL(l = new0(char*, n + 1));
+        for (unsigned i = 0; i < n; i++)
+                ASSERT_OK(asprintf(l + i, "benchmark-%u%s", i, suffix));
+
+        return TAKE_PTR(l);
+}
+
+static void** make_pointers(unsigned n, unsigned offset) {
+        void **l;
+
+        /* Addresses handed out by malloc() for same-sized objects are evenly spaced, mimic that */
+        ASSERT_NOT_NULL(l = new(void*, n));
+        for (unsigned i = 0; i < n; i++)
+                l[i] = UINT_TO_PTR(0x10000 + (offset + i) * 0x40);
+
+        return l;
+}
+
+static void log_rate(const char *what, const char *op, unsigned n, unsigned n_ops, usec_t t) {
+        log_info("%-16s %7u entries, %-11s %8.1f M ops/s",
+                 what, n, op, (double) n_ops / MAX(t, (usec_t) 1));
+}
+
+static void run_benchmark(const char *what, const struct hash_ops *ops, void **keys, void **missing, unsigned n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        unsigned n_rounds, found = 0;
+        const void *k;
+        void *v;
+        usec_t t;
+
+        /* Repeat the cheap operations often enough so that the small tables don't end up measuring the
+         * clock only */
+        n_rounds = MAX(1000000U / n, 1U);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < n_rounds; r++) {
+                h = hashmap_free(h);
+                ASSERT_NOT_NULL(h = hashmap_new(ops));
+                for (unsigned i = 0; i < n; i++)
+                        ASSERT_EQ(hashmap_put(h, keys[i], UINT_TO_PTR(i + 1)), 1);
+        }
+        log_rate(what, "insert", n, n * n_rounds, usec_sub_unsigned(now(CLOCK_MONOTONIC), t));
+        ASSERT_EQ(hashmap_size(h), n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < n_rounds; r++)
+                for (unsigned i = 0; i < n; i++)
+                        found += hashmap_get(h, keys[i]) == UINT_TO_PTR(i + 1);
+        log_rate(what, "lookup-hit", n, n * n_rounds, usec_sub_unsigned(now(CLOCK_MONOTONIC), t));
+        ASSERT_EQ(found, n * n_rounds);
+
+        found = 0;
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < n_rounds; r++)
+                for (unsigned i = 0; i < n; i++)
+                        found += hashmap_contains(h, missing[i]);
+        log_rate(what, "lookup-miss", n, n * n_rounds, usec_sub_unsigned(now(CLOCK_MONOTONIC), t));
+        ASSERT_EQ(found, 0u);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < n_rounds; r++)
+                HASHMAP_FOREACH_KEY(v, k, h)
+                        found += !!k;
+        log_rate(what, "iterate", n, n * n_rounds, usec_sub_unsigned(now(CLOCK_MONOTONIC), t));
+        ASSERT_EQ(found, n * n_rounds);
+}
+
+TEST(hashmap_benchmark) {
+        unsigned n_max = slow_tests_enabled() ? 1000000 : 100000;
+
+        for (unsigned n = 1000; n <= n_max; n *= 10) {
+                _cleanup_strv_free_ char **names = NULL, **missing_names = NULL;
+                _cleanup_free_ void **pointers = NULL, **missing_pointers = NULL;
+
+                names = make_names(n, ".service");
+                missing_names = make_names(n, ".socket");
+                run_benchmark("string", &string_hash_ops, (void**) names, (void**) missing_names, n);
+                run_benchmark("string/trusted", &string_hash_ops_trusted, (void**) names, (void**) missing_names, n);
+
+                pointers = make_pointers(n, 0);
+                missing_pointers = make_pointers(n, n);
+                run_benchmark("pointer", &trivial_hash_ops, pointers, missing_pointers, n);
+                run_benchmark("pointer/trusted", &trivial_hash_ops_trusted, pointers, missing_pointers, n);
+        }
+}
+
+/* What a typical block device carries after udev rules ran, see sd-device's property map */
+static const char* const device_properties[] = {
+        "ACTION", "DEVPATH", "SUBSYSTEM", "DEVNAME", "DEVTYPE", "DISKSEQ", "SEQNUM", "USEC_INITIALIZED",
+        "MAJOR", "MINOR", "ID_BUS", "ID_MODEL", "ID_MODEL_ENC", "ID_MODEL_ID", "ID_SERIAL", "ID_SERIAL_SHORT",
+        "ID_VENDOR", "ID_VENDOR_ENC", "ID_VENDOR_ID", "ID_REVISION", "ID_TYPE", "ID_PATH", "ID_PATH_TAG",
+        "ID_PART_TABLE_UUID", "ID_PART_TABLE_TYPE", "ID_FS_UUID", "ID_FS_UUID_ENC", "ID_FS_TYPE",
+        "ID_FS_USAGE", "ID_FS_VERSION", "DEVLINKS", "TAGS", "CURRENT_TAGS", "SYSTEMD_WANTS",
+        "UDISKS_IGNORE", "ID_WWN", "ID_WWN_WITH_EXTENSION", "ID_USB_DRIVER", "ID_USB_INTERFACES",
+        "ID_USB_INTERFACE_NUM",
+};
+
+static void run_properties_benchmark(const char *what, const struct hash_ops *ops) {
+        unsigned n_rounds = slow_tests_enabled() ? 200000 : 20000, found = 0;
+        usec_t t;
+
+        /* Fill a fresh map for each device and look up every property once, like a rule set would */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < n_rounds; r++) {
+                _cleanup_ordered_hashmap_free_ OrderedHashmap *h = NULL;
+
+                ASSERT_NOT_NULL(h = ordered_hashmap_new(ops));
+                FOREACH_ELEMENT(p, device_properties)
+                        ASSERT_EQ(ordered_hashmap_put(h, *p, (void*) *p), 1);
+                FOREACH_ELEMENT(p, device_properties)
+                        found += ordered_hashmap_get(h, *p) == *p;
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        ASSERT_EQ(found, n_rounds * ELEMENTSOF(device_properties));
+        log_info("%-16s %.0f devices/s", what, (double) n_rounds * USEC_PER_SEC / MAX(t, (usec_t) 1));
+}
+
+TEST(properties_benchmark) {
+        run_properties_benchmark("properties", &string_hash_ops);
+        run_properties_benchmark("properties/trusted", &string_hash_ops_trusted);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
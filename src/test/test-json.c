@@ -8,9 +8,11 @@
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "hexdecoct.h"
 #include "iovec-util.h"
 #include "json-internal.h"
 #include "json-util.h"
+#include "mallinfo-util.h"
 #include "math-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -610,6 +612,91 @@ TEST(bisect) {
         }
 }
 
+static void test_object_index_one(sd_json_variant *v, unsigned n) {
+        /* Look up every field twice, to check both building the index and using it afterwards */
+        for (unsigned iteration = 0; iteration < 2; iteration++)
+                for (unsigned i = 0; i < n; i++) {
+                        char name[DECIMAL_STR_MAX(unsigned) + STRLEN("field")];
+                        sd_json_variant *k = NULL, *w;
+
+                        xsprintf(name, "field%u", i);
+
+                        ASSERT_NOT_NULL(w = sd_json_variant_by_key_full(v, name, &k));
+                        ASSERT_EQ(sd_json_variant_unsigned(w), (uint64_t) i);
+                        ASSERT_STREQ(sd_json_variant_string(k), name);
+                }
+
+        ASSERT_NULL(sd_json_variant_by_key(v, "field"));
+        ASSERT_NULL(sd_json_variant_by_key(v, ""));
+}
+
+TEST(object_index) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL, *w = NULL;
+        _cleanup_free_ char *text = NULL;
+        sd_json_variant **array;
+        unsigned n = 100;
+        size_t m = n * 2 + 2;
+
+        /* Tests the hash index used for looking up fields of large objects in sd_json_variant_by_key() */
+
+        ASSERT_NOT_NULL(array = new0(sd_json_variant*, m));
+        CLEANUP_ARRAY(array, m, sd_json_variant_unref_many);
+
+        /* Add the fields in reverse order, so that the object is not sorted and no bisection is done */
+        for (unsigned i = 0; i < n; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + STRLEN("field")];
+
+                xsprintf(name, "field%u", n - 1 - i);
+                ASSERT_OK(sd_json_variant_new_string(array + i * 2, name));
+                ASSERT_OK(sd_json_variant_new_unsigned(array + i * 2 + 1, n - 1 - i));
+        }
+
+        /* A duplicate key is ignored, the first occurrence wins */
+        ASSERT_OK(sd_json_variant_new_string(array + n * 2, "field7"));
+        ASSERT_OK(sd_json_variant_new_unsigned(array + n * 2 + 1, 4711));
+
+        ASSERT_OK(sd_json_variant_new_object(&v, array, m));
+        ASSERT_FALSE(sd_json_variant_is_sorted(v));
+        test_object_index_one(v, n);
+
+        /* Same for an object allocated from an arena */
+        ASSERT_OK(sd_json_variant_format(v, 0, &text));
+        ASSERT_OK(sd_json_parse(text, SD_JSON_PARSE_ARENA, &w, NULL, NULL));
+        test_object_index_one(w, n);
+        ASSERT_TRUE(sd_json_variant_equal(v, w));
+}
+
+TEST(build_object_sorted) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ char *s = NULL;
+
+        ASSERT_OK(sd_json_build(&v, JSON_BUILD_OBJECT_SORTED(
+                                        SD_JSON_BUILD_PAIR_STRING("zzz", "last"),
+                                        SD_JSON_BUILD_PAIR_UNSIGNED("aaa", 1),
+                                        SD_JSON_BUILD_PAIR_CONDITION(false, "mmm", SD_JSON_BUILD_NULL),
+                                        SD_JSON_BUILD_PAIR("bbb", JSON_BUILD_OBJECT_SORTED(
+                                                                           SD_JSON_BUILD_PAIR_BOOLEAN("y", true),
+                                                                           SD_JSON_BUILD_PAIR_BOOLEAN("x", false))),
+                                        SD_JSON_BUILD_PAIR("ccc", SD_JSON_BUILD_OBJECT(
+                                                                           SD_JSON_BUILD_PAIR_BOOLEAN("y", true),
+                                                                           SD_JSON_BUILD_PAIR_BOOLEAN("x", false))))));
+
+        ASSERT_TRUE(sd_json_variant_is_sorted(v));
+        ASSERT_TRUE(sd_json_variant_is_sorted(sd_json_variant_by_key(v, "bbb")));
+        ASSERT_FALSE(sd_json_variant_is_sorted(sd_json_variant_by_key(v, "ccc")));
+
+        ASSERT_OK(sd_json_variant_format(v, 0, &s));
+        ASSERT_STREQ(s, "{\"aaa\":1,\"bbb\":{\"x\":false,\"y\":true},\"ccc\":{\"y\":true,\"x\":false},\"zzz\":\"last\"}");
+        v = sd_json_variant_unref(v);
+
+        /* Which of two fields with the same key would come first after sorting is arbitrary */
+        ASSERT_ERROR(sd_json_build(&v, JSON_BUILD_OBJECT_SORTED(
+                                           SD_JSON_BUILD_PAIR_UNSIGNED("aaa", 1),
+                                           SD_JSON_BUILD_PAIR_UNSIGNED("bbb", 2),
+                                           SD_JSON_BUILD_PAIR_UNSIGNED("aaa", 3))), ENOTUNIQ);
+        ASSERT_NULL(v);
+}
+
 static void test_float_match(sd_json_variant *v) {
         const double delta = 0.0001;
 
@@ -916,6 +1003,51 @@ TEST(json_dispatch) {
         assert_se(foobar.p == INT8_MIN);
 }
 
+TEST(json_dispatch_index) {
+        struct foobar {
+                unsigned first, second, other;
+                const char *catch_all;
+        } foobar = {};
+
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        const char *bad_field = NULL;
+
+        /* Enough entries that a hash index is used for the lookups, which needs to give the same results as
+         * the linear search: the first entry for a name wins, and a catch-all entry covers everything after
+         * it. */
+        static const sd_json_dispatch_field table[] = {
+                { "a",         _SD_JSON_VARIANT_TYPE_INVALID, sd_json_dispatch_uint,         offsetof(struct foobar, first),     SD_JSON_MANDATORY },
+                { "a",         _SD_JSON_VARIANT_TYPE_INVALID, sd_json_dispatch_uint,         offsetof(struct foobar, second),    0                 },
+                { "b",         _SD_JSON_VARIANT_TYPE_INVALID, sd_json_dispatch_uint,         offsetof(struct foobar, other),     0                 },
+                { "c",         _SD_JSON_VARIANT_TYPE_INVALID, NULL,                          0,                                  0                 },
+                { "d",         _SD_JSON_VARIANT_TYPE_INVALID, NULL,                          0,                                  0                 },
+                { "e",         _SD_JSON_VARIANT_TYPE_INVALID, NULL,                          0,                                  0                 },
+                { POINTER_MAX, _SD_JSON_VARIANT_TYPE_INVALID, sd_json_dispatch_const_string, offsetof(struct foobar, catch_all), 0                 },
+                { "f",         _SD_JSON_VARIANT_TYPE_INVALID, sd_json_dispatch_uint,         offsetof(struct foobar, second),    0                 },
+                {}
+        };
+
+        ASSERT_OK(sd_json_buildo(&v,
+                                 SD_JSON_BUILD_PAIR_UNSIGNED("a", 1),
+                                 SD_JSON_BUILD_PAIR_UNSIGNED("b", 2),
+                                 SD_JSON_BUILD_PAIR_UNSIGNED("c", 3),
+                                 SD_JSON_BUILD_PAIR_STRING("f", "foo")));
+
+        ASSERT_OK(sd_json_dispatch_full(v, table, NULL, 0, &foobar, &bad_field));
+        ASSERT_EQ(foobar.first, 1u);
+        ASSERT_EQ(foobar.second, 0u);
+        ASSERT_EQ(foobar.other, 2u);
+        ASSERT_STREQ(foobar.catch_all, "foo");
+
+        v = sd_json_variant_unref(v);
+        ASSERT_OK(sd_json_buildo(&v,
+                                 SD_JSON_BUILD_PAIR_UNSIGNED("b", 2),
+                                 SD_JSON_BUILD_PAIR_UNSIGNED("c", 3)));
+
+        ASSERT_ERROR(sd_json_dispatch_full(v, table, NULL, 0, &foobar, &bad_field), ENXIO);
+        ASSERT_STREQ(bad_field, "a");
+}
+
 typedef enum mytestenum {
         myfoo, mybar, mybaz, with_some_dashes, _mymax, _myinvalid = -EINVAL,
 } mytestenum;
@@ -1238,4 +1370,407 @@ TEST(parse_continue) {
         assert_se(sd_json_parse_with_source_continue(&p, "piff", /* flags= */ 0, &x, &line, &column) == -EINVAL);
 }
 
+TEST(json_parse_string_scan) {
+        /* Plain runs of various lengths, so that the special characters end up at every position relative
+         * to the blocks the string scanner looks at */
+        for (unsigned k = 0; k < 40; k++) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+                _cleanup_free_ char *plain = NULL, *text = NULL, *expected = NULL;
+                const char *source;
+                unsigned line, column;
+
+                ASSERT_NOT_NULL(plain = strrep("x", k));
+
+                ASSERT_NOT_NULL(text = strjoin("[\"", plain, "\\n\\\"ä\\u00e4/\", \"", plain, "\"]"));
+                ASSERT_NOT_NULL(expected = strjoin(plain, "\n\"ää/"));
+                ASSERT_OK(sd_json_parse(text, 0, &v, NULL, NULL));
+                ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_index(v, 0)), expected);
+                ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_index(v, 1)), plain);
+                v = sd_json_variant_unref(v);
+                text = mfree(text);
+
+                ASSERT_NOT_NULL(text = strjoin("\"", plain, "\x01\""));
+                ASSERT_ERROR(sd_json_parse(text, 0, &v, NULL, NULL), EINVAL);
+                text = mfree(text);
+
+                ASSERT_NOT_NULL(text = strjoin("\"", plain, "\x7f\""));
+                ASSERT_ERROR(sd_json_parse(text, 0, &v, NULL, NULL), EINVAL);
+                text = mfree(text);
+
+                ASSERT_NOT_NULL(text = strjoin("\"", plain));
+                ASSERT_ERROR(sd_json_parse(text, 0, &v, NULL, NULL), EINVAL);
+                text = mfree(text);
+
+                /* Columns are still counted correctly when skipping over plain characters in bulk */
+                ASSERT_NOT_NULL(text = strjoin("{ \"", plain, "\" : 7,\n\"", plain, "y\" : 8 }"));
+                ASSERT_OK(sd_json_parse_with_source(text, "scan", 0, &v, NULL, NULL));
+                ASSERT_OK(sd_json_variant_get_source(sd_json_variant_by_key(v, plain), &source, &line, &column));
+                ASSERT_STREQ(source, "scan");
+                ASSERT_EQ(line, 1u);
+                ASSERT_EQ(column, k + 8);
+                ASSERT_OK(sd_json_variant_get_source(sd_json_variant_by_index(v, 3), &source, &line, &column));
+                ASSERT_EQ(line, 2u);
+                ASSERT_EQ(column, k + 7);
+        }
+}
+
+TEST(json_parse_long_line) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ char *elements = NULL, *text = NULL;
+        const char *source;
+        unsigned line, column;
+        size_t n = 200000;
+
+        /* A long line of compact JSON, i.e. plain characters only: counting columns must only look at each
+         * token, not at the rest of the line every time, or this takes forever */
+        ASSERT_NOT_NULL(elements = strrep("1,", n - 1));
+        ASSERT_NOT_NULL(text = strjoin("[", elements, "1]"));
+        ASSERT_OK(sd_json_parse_with_source(text, "long", 0, &v, NULL, NULL));
+        ASSERT_EQ(sd_json_variant_elements(v), n);
+        ASSERT_OK(sd_json_variant_get_source(sd_json_variant_by_index(v, n - 1), &source, &line, &column));
+        ASSERT_EQ(line, 1u);
+        ASSERT_EQ(column, (unsigned) (2 * n));
+}
+
+TEST(json_parse_arena) {
+        static const char text[] =
+                "{\"name\":\"a rather long string\",\"short\":\"foo\",\"escaped\":\"\\u00e4\\n\","
+                "\"numbers\":[1,-2,3.5,0,18446744073709551615],\"flags\":[true,false,null],"
+                "\"nested\":{\"b\":{\"c\":[\"xyz\",\"another long string\",{},[]]},\"a\":4711},"
+                "\"empty\":\"\"}";
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL, *w = NULL, *nested = NULL, *a = NULL;
+        _cleanup_free_ char *s = NULL, *t = NULL;
+        const char *source;
+        unsigned line, column;
+
+        ASSERT_OK(sd_json_parse(text, 0, &v, NULL, NULL));
+        ASSERT_OK(sd_json_parse_with_source(text, "arena.json", SD_JSON_PARSE_ARENA, &w, NULL, NULL));
+
+        ASSERT_TRUE(sd_json_variant_equal(v, w));
+        ASSERT_OK(sd_json_variant_format(v, 0, &s));
+        ASSERT_OK(sd_json_variant_format(w, 0, &t));
+        ASSERT_STREQ(s, t);
+
+        ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_key(w, "escaped")), "ä\n");
+        ASSERT_EQ(sd_json_variant_unsigned(sd_json_variant_by_index(sd_json_variant_by_key(w, "numbers"), 4)), UINT64_MAX);
+
+        /* No source information is recorded */
+        ASSERT_OK(sd_json_variant_get_source(sd_json_variant_by_key(w, "nested"), &source, &line, &column));
+        ASSERT_NULL(source);
+        ASSERT_EQ(line, 0u);
+        ASSERT_EQ(column, 0u);
+
+        /* Members keep the whole tree alive */
+        nested = sd_json_variant_ref(sd_json_variant_by_key(w, "nested"));
+        w = sd_json_variant_unref(w);
+        ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_index(sd_json_variant_by_key(sd_json_variant_by_key(nested, "b"), "c"), 1)),
+                     "another long string");
+
+        /* Modifications create new variants referencing the arena */
+        ASSERT_FALSE(sd_json_variant_is_sorted(nested));
+        ASSERT_OK(sd_json_variant_sort(&nested));
+        ASSERT_TRUE(sd_json_variant_is_sorted(nested));
+        ASSERT_OK(sd_json_variant_set_field_string(&nested, "d", "bar"));
+        ASSERT_EQ(sd_json_variant_elements(nested), 6u);
+
+        ASSERT_OK(sd_json_parse("[\"first element\",2]", SD_JSON_PARSE_ARENA, &a, NULL, NULL));
+        ASSERT_OK(sd_json_variant_append_array(&a, nested));
+        nested = sd_json_variant_unref(nested);
+        ASSERT_EQ(sd_json_variant_elements(a), 3u);
+        ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_index(a, 0)), "first element");
+        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(sd_json_variant_by_index(a, 2), "a")), 4711);
+        a = sd_json_variant_unref(a);
+
+        /* Sensitivity applies to the whole arena */
+        ASSERT_OK(sd_json_parse(text, SD_JSON_PARSE_ARENA|SD_JSON_PARSE_SENSITIVE, &a, NULL, NULL));
+        ASSERT_TRUE(sd_json_variant_is_sensitive(a));
+        a = sd_json_variant_unref(a);
+
+        /* Toplevel values that aren't containers */
+        ASSERT_OK(sd_json_parse("\"a string that is not that short\"", SD_JSON_PARSE_ARENA, &a, NULL, NULL));
+        ASSERT_STREQ(sd_json_variant_string(a), "a string that is not that short");
+        a = sd_json_variant_unref(a);
+        ASSERT_OK(sd_json_parse("4711", SD_JSON_PARSE_ARENA, &a, NULL, NULL));
+        ASSERT_EQ(sd_json_variant_integer(a), 4711);
+        a = sd_json_variant_unref(a);
+        ASSERT_OK(sd_json_parse("[]", SD_JSON_PARSE_ARENA, &a, NULL, NULL));
+        ASSERT_TRUE(sd_json_variant_is_blank_array(a));
+        a = sd_json_variant_unref(a);
+
+        /* Everything allocated so far is released when parsing fails half-way */
+        ASSERT_ERROR(sd_json_parse("[\"foobarbazwaldo\",{\"a\":[1,2],\"b\":]", SD_JSON_PARSE_ARENA, &a, NULL, NULL), EINVAL);
+        ASSERT_NULL(a);
+}
+
+static void parse_benchmark(const char *what, const char *text, sd_json_parse_flags_t flags, unsigned n_iterations) {
+        size_t size = strlen(text);
+        usec_t t;
+
+#if HAVE_GENERIC_MALLINFO
+        /* Keep a couple of trees around at the same time, so that the allocator's caches don't hide small ones */
+        size_t n_trees = CLAMP(U64_MB / size, 1U, 1000U);
+        sd_json_variant **trees;
+        generic_mallinfo before, after;
+
+        ASSERT_NOT_NULL(trees = new0(sd_json_variant*, n_trees));
+
+        before = generic_mallinfo_get();
+        for (size_t i = 0; i < n_trees; i++)
+                ASSERT_OK(sd_json_parse(text, flags, trees + i, NULL, NULL));
+        after = generic_mallinfo_get();
+
+        log_info("%s, %s: %zu bytes of JSON take up %zu bytes parsed",
+                 what, FLAGS_SET(flags, SD_JSON_PARSE_ARENA) ? "arena" : "regular",
+                 size, LESS_BY((size_t) (after.uordblks + after.hblkhd), (size_t) (before.uordblks + before.hblkhd)) / n_trees);
+
+        sd_json_variant_unref_many(trees, n_trees);
+#endif
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+
+                ASSERT_OK(sd_json_parse(text, flags, &v, NULL, NULL));
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%s, %s: parsed %.1f MiB/s, %.0f/s",
+                 what, FLAGS_SET(flags, SD_JSON_PARSE_ARENA) ? "arena" : "regular",
+                 (double) size * n_iterations * USEC_PER_SEC / MAX(t, (usec_t) 1) / U64_MB,
+                 (double) n_iterations * USEC_PER_SEC / MAX(t, (usec_t) 1));
+}
+
+TEST(json_parse_benchmark) {
+        _cleanup_free_ char *text = NULL, *objects = NULL, *name = NULL, *description = NULL;
+        unsigned n_iterations = slow_tests_enabled() ? 1000 : 50;
+        sd_json_parse_flags_t flags;
+
+        /* Mostly strings, like the records passed around via Varlink */
+        ASSERT_NOT_NULL(name = strrep("n", 64));
+        ASSERT_NOT_NULL(description = strrep("Lorem ipsum dolor sit amet.\\n", 8));
+        for (unsigned i = 0; i < 1000; i++)
+                ASSERT_OK(strextendf_with_separator(&objects, ",",
+                                                    "{\"name\":\"%s%u\",\"description\":\"%s\",\"value\":%u}",
+                                                    name, i, description, i));
+        ASSERT_NOT_NULL(text = strjoin("[", objects, "]"));
+
+        FOREACH_ARGUMENT(flags, 0, SD_JSON_PARSE_ARENA)
+                parse_benchmark("Records", text, flags, n_iterations);
+
+        /* A typical Varlink method call */
+        FOREACH_ARGUMENT(flags, 0, SD_JSON_PARSE_ARENA)
+                parse_benchmark("Method call",
+                                "{\"method\":\"io.systemd.UserDatabase.GetUserRecord\","
+                                "\"parameters\":{\"userName\":\"foobar\",\"uid\":4711,\"service\":\"io.systemd.Multiplexer\"}}",
+                                flags, n_iterations * 1000);
+}
+
+static void test_cbor_one(const char *json, const char *hex) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL, *w = NULL;
+        _cleanup_free_ uint8_t *cbor = NULL;
+        _cleanup_free_ char *h = NULL;
+        size_t size;
+
+        log_info("/* %s: %s */", __func__, json);
+
+        ASSERT_OK(sd_json_parse(json, 0, &v, NULL, NULL));
+        ASSERT_OK(json_variant_format_cbor(v, &cbor, &size));
+        ASSERT_NOT_NULL(h = hexmem(cbor, size));
+        ASSERT_STREQ(h, hex);
+
+        ASSERT_OK(json_parse_cbor(cbor, size, 0, &w));
+        ASSERT_TRUE(sd_json_variant_equal(v, w));
+        ASSERT_EQ(sd_json_variant_type(v), sd_json_variant_type(w));
+}
+
+static int parse_cbor_hex(const char *hex, sd_json_variant **ret) {
+        _cleanup_free_ void *cbor = NULL;
+        size_t size;
+
+        ASSERT_OK(unhexmem(hex, &cbor, &size));
+
+        return json_parse_cbor(cbor, size, SD_JSON_PARSE_ARENA, ret);
+}
+
+TEST(json_cbor) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL, *w = NULL;
+        _cleanup_free_ uint8_t *cbor = NULL;
+        size_t size;
+
+        /* Examples from RFC 8949, appendix A */
+        test_cbor_one("0", "00");
+        test_cbor_one("23", "17");
+        test_cbor_one("24", "1818");
+        test_cbor_one("1000", "1903e8");
+        test_cbor_one("1000000", "1a000f4240");
+        test_cbor_one("1000000000000", "1b000000e8d4a51000");
+        test_cbor_one("18446744073709551615", "1bffffffffffffffff");
+        test_cbor_one("-1", "20");
+        test_cbor_one("-1000", "3903e7");
+        test_cbor_one("-9223372036854775808", "3b7fffffffffffffff");
+        test_cbor_one("1.1", "fb3ff199999999999a");
+        test_cbor_one("-4.1", "fbc010666666666666");
+        test_cbor_one("false", "f4");
+        test_cbor_one("true", "f5");
+        test_cbor_one("null", "f6");
+        test_cbor_one("\"\"", "60");
+        test_cbor_one("\"IETF\"", "6449455446");
+        test_cbor_one("\"\\u00fc\"", "62c3bc");
+        test_cbor_one("[]", "80");
+        test_cbor_one("[1,[2,3],[4,5]]", "8301820203820405");
+        test_cbor_one("{}", "a0");
+        test_cbor_one("{\"a\":1,\"b\":[2,3]}", "a26161016162820203");
+
+        /* Single precision floats are accepted too */
+        ASSERT_OK(parse_cbor_hex("fa47c35000", &v));
+        ASSERT_TRUE(sd_json_variant_real(v) == 100000.0);
+        v = sd_json_variant_unref(v);
+
+        /* A larger document survives the round trip in both parse modes */
+        ASSERT_OK(sd_json_parse("{\"name\":\"a rather long string\",\"numbers\":[1,-2,3.5,0,18446744073709551615],"
+                                "\"flags\":[true,false,null],\"nested\":{\"b\":{\"c\":[\"xyz\",{},[]]},\"a\":4711},\"empty\":\"\"}",
+                                0, &v, NULL, NULL));
+        ASSERT_OK(json_variant_format_cbor(v, &cbor, &size));
+        ASSERT_OK(json_parse_cbor(cbor, size, 0, &w));
+        ASSERT_TRUE(sd_json_variant_equal(v, w));
+        w = sd_json_variant_unref(w);
+        ASSERT_OK(json_parse_cbor(cbor, size, SD_JSON_PARSE_ARENA|SD_JSON_PARSE_SENSITIVE, &w));
+        ASSERT_TRUE(sd_json_variant_equal(v, w));
+        ASSERT_TRUE(sd_json_variant_is_sensitive(w));
+        w = sd_json_variant_unref(w);
+
+        /* Truncated at any point */
+        for (size_t i = 0; i < size; i++)
+                ASSERT_ERROR(json_parse_cbor(cbor, i, SD_JSON_PARSE_ARENA, &w), EBADMSG);
+
+        /* Trailing data */
+        ASSERT_ERROR(parse_cbor_hex("0000", &w), EBADMSG);
+        /* Indefinite lengths */
+        ASSERT_ERROR(parse_cbor_hex("9f01ff", &w), EBADMSG);
+        /* Byte strings and tags */
+        ASSERT_ERROR(parse_cbor_hex("4101", &w), EBADMSG);
+        ASSERT_ERROR(parse_cbor_hex("c001", &w), EBADMSG);
+        /* Keys that aren't strings */
+        ASSERT_ERROR(parse_cbor_hex("a10101", &w), EBADMSG);
+        /* 'undefined', other simple values and half precision floats */
+        ASSERT_ERROR(parse_cbor_hex("f7", &w), EBADMSG);
+        ASSERT_ERROR(parse_cbor_hex("f814", &w), EBADMSG);
+        ASSERT_ERROR(parse_cbor_hex("f93c00", &w), EBADMSG);
+        /* Sizes that can't fit into the buffer */
+        ASSERT_ERROR(parse_cbor_hex("9bffffffffffffffff", &w), EBADMSG);
+        ASSERT_ERROR(parse_cbor_hex("7a7fffffff41", &w), EBADMSG);
+        /* Strings JSON can't express */
+        ASSERT_ERROR(parse_cbor_hex("6100", &w), EINVAL);
+        ASSERT_ERROR(parse_cbor_hex("61ff", &w), EUCLEAN);
+        /* Integers below INT64_MIN */
+        ASSERT_ERROR(parse_cbor_hex("3bffffffffffffffff", &w), ERANGE);
+        ASSERT_NULL(w);
+}
+
+TEST(json_cbor_depth) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ uint8_t *cbor = NULL;
+
+        /* An array nested 4K times */
+        ASSERT_NOT_NULL(cbor = new(uint8_t, 4096));
+        memset(cbor, 0x81, 4095);
+        cbor[4095] = 0x80;
+
+        ASSERT_ERROR(json_parse_cbor(cbor, 4096, 0, &v), ELNRNG);
+        ASSERT_OK(json_parse_cbor(cbor + 4096 - 1000, 1000, 0, &v));
+        v = sd_json_variant_unref(v);
+
+        /* Exactly as deep as the text parser allows, i.e. DEPTH_MAX arrays around a number, and one more */
+        for (size_t n = DEPTH_MAX; n <= DEPTH_MAX + 1; n++) {
+                _cleanup_free_ char *text = NULL;
+
+                ASSERT_NOT_NULL(text = new(char, 2 * n + 2));
+                memset(text, '[', n);
+                text[n] = '1';
+                memset(text + n + 1, ']', n);
+                text[2 * n + 1] = 0;
+
+                memset(cbor, 0x81, n);
+                cbor[n] = 0x01;
+
+                if (n == DEPTH_MAX) {
+                        ASSERT_OK(sd_json_parse(text, 0, &v, NULL, NULL));
+                        v = sd_json_variant_unref(v);
+                        ASSERT_OK(json_parse_cbor(cbor, n + 1, 0, &v));
+                        v = sd_json_variant_unref(v);
+                } else {
+                        ASSERT_ERROR(sd_json_parse(text, 0, &v, NULL, NULL), ELNRNG);
+                        ASSERT_ERROR(json_parse_cbor(cbor, n + 1, 0, &v), ELNRNG);
+                }
+        }
+}
+
+static void cbor_benchmark(const char *what, const char *text, unsigned n_iterations) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ uint8_t *cbor = NULL;
+        usec_t t_json, t_cbor;
+        size_t size;
+
+        ASSERT_OK(sd_json_parse(text, 0, &v, NULL, NULL));
+        ASSERT_OK(json_variant_format_cbor(v, &cbor, &size));
+
+        /* Format and parse again, as the two ends of a Varlink connection do for each message */
+        t_json = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *w = NULL;
+                _cleanup_free_ char *s = NULL;
+
+                ASSERT_OK(sd_json_variant_format(v, 0, &s));
+                ASSERT_OK(sd_json_parse(s, SD_JSON_PARSE_ARENA, &w, NULL, NULL));
+        }
+        t_json = usec_sub_unsigned(now(CLOCK_MONOTONIC), t_json);
+
+        t_cbor = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *w = NULL;
+                _cleanup_free_ uint8_t *b = NULL;
+                size_t n;
+
+                ASSERT_OK(json_variant_format_cbor(v, &b, &n));
+                ASSERT_OK(json_parse_cbor(b, n, SD_JSON_PARSE_ARENA, &w));
+        }
+        t_cbor = usec_sub_unsigned(now(CLOCK_MONOTONIC), t_cbor);
+
+        log_info("%s: %zu bytes as JSON, %zu bytes as CBOR, %.0f/s vs. %.0f/s formatted and parsed",
+                 what, strlen(text), size,
+                 (double) n_iterations * USEC_PER_SEC / MAX(t_json, (usec_t) 1),
+                 (double) n_iterations * USEC_PER_SEC / MAX(t_cbor, (usec_t) 1));
+}
+
+TEST(json_cbor_benchmark) {
+        _cleanup_free_ char *text = NULL, *objects = NULL, *name = NULL, *description = NULL;
+        unsigned n_iterations = slow_tests_enabled() ? 1000 : 50;
+
+        /* Mostly strings, like the records passed around via Varlink */
+        ASSERT_NOT_NULL(name = strrep("n", 64));
+        ASSERT_NOT_NULL(description = strrep("Lorem ipsum dolor sit amet.\\n", 8));
+        for (unsigned i = 0; i < 1000; i++)
+                ASSERT_OK(strextendf_with_separator(&objects, ",",
+                                                    "{\"name\":\"%s%u\",\"description\":\"%s\",\"value\":%u}",
+                                                    name, i, description, i));
+        ASSERT_NOT_NULL(text = strjoin("[", objects, "]"));
+        cbor_benchmark("Records", text, n_iterations);
+
+        /* Mostly numbers, like the samples io.systemd.oom and friends pass around */
+        objects = mfree(objects);
+        for (unsigned i = 0; i < 1000; i++)
+                ASSERT_OK(strextendf_with_separator(&objects, ",",
+                                                    "{\"pressure\":%u,\"total\":%u,\"limit\":18446744073709551615,\"avg10\":%u.25,\"ok\":true}",
+                                                    i * 1000, i * 4711, i));
+        text = mfree(text);
+        ASSERT_NOT_NULL(text = strjoin("[", objects, "]"));
+        cbor_benchmark("Samples", text, n_iterations);
+
+        /* A typical Varlink method call */
+        cbor_benchmark("Method call",
+                       "{\"method\":\"io.systemd.UserDatabase.GetUserRecord\","
+                       "\"parameters\":{\"userName\":\"foobar\",\"uid\":4711,\"service\":\"io.systemd.Multiplexer\"}}",
+                       n_iterations * 1000);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
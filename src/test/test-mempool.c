@@ -1,7 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include "alloc-util.h"
 #include "mempool.h"
+#include "memstream-util.h"
 #include "random-util.h"
+#include "string-util.h"
 #include "tests.h"
 
 struct element {
@@ -26,6 +29,9 @@ TEST(mempool_trim) {
                 a[i]->value = i;
         }
 
+        assert_se(test_mempool.n_used == NN);
+        assert_se(test_mempool.registered);
+
         mempool_trim(&test_mempool);
 
         /* free up to one third randomly */
@@ -82,6 +88,7 @@ TEST(mempool_trim) {
         }
 
         assert_se(n_freed == NN * 2);
+        assert_se(test_mempool.n_used == 0);
 
         mempool_trim(&test_mempool);
 
@@ -89,4 +96,28 @@ TEST(mempool_trim) {
         assert_se(!test_mempool.freelist);
 }
 
+TEST(mempool_info) {
+        _cleanup_(memstream_done) MemStream m = {};
+        _cleanup_free_ char *dump = NULL;
+        struct element *e;
+        FILE *f;
+
+        ASSERT_NOT_NULL(e = mempool_alloc_tile(&test_mempool));
+
+        ASSERT_NOT_NULL(f = memstream_init(&m));
+        mempool_info(f);
+        ASSERT_OK(memstream_finalize(&m, &dump, NULL));
+
+        log_debug("%s", dump);
+        ASSERT_TRUE(startswith(dump, "<!-- mempool "));
+        ASSERT_TRUE(endswith(dump, " -->\n"));
+        ASSERT_NOT_NULL(strstr(dump, "<!-- mempool name=test_mempool tile_size=8 pools=1 "));
+        ASSERT_NOT_NULL(strstr(dump, " used=1 "));
+
+        mempool_free_tile(&test_mempool, e);
+        mempool_trim_all();
+        ASSERT_NULL(test_mempool.first_pool);
+        ASSERT_EQ(test_mempool.n_used, 0u);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "string-intern.h"
+#include "tests.h"
+
+TEST(string_intern) {
+        _cleanup_free_ char *copy = NULL;
+        const char *a, *b, *c;
+
+        ASSERT_NOT_NULL(a = string_intern("/usr/lib/systemd/system/foo@.service"));
+        ASSERT_STREQ(a, "/usr/lib/systemd/system/foo@.service");
+
+        /* Any copy of the string maps to the same interned one */
+        ASSERT_NOT_NULL(copy = strdup(a));
+        ASSERT_NOT_NULL(b = string_intern(copy));
+        ASSERT_TRUE(a == b);
+        ASSERT_NOT_NULL(c = string_intern("/usr/lib/systemd/system/bar@.service"));
+        ASSERT_TRUE(a != c);
+
+        /* Two references on a, one on c */
+        ASSERT_NULL(string_intern_unref(b));
+        ASSERT_STREQ(a, "/usr/lib/systemd/system/foo@.service");
+        ASSERT_TRUE(string_intern_ref(a) == a);
+        ASSERT_NULL(string_intern_unref(a));
+        ASSERT_NULL(string_intern_unref(a));
+        ASSERT_NULL(string_intern_unref(c));
+
+        /* Once all references are gone, the string is interned anew. The old pointer is dangling now,
+         * hence only check that this works at all. */
+        ASSERT_NOT_NULL(a = string_intern(copy));
+        ASSERT_NULL(string_intern_unref(a));
+
+        ASSERT_NULL(string_intern_ref(NULL));
+        ASSERT_NULL(string_intern_unref(NULL));
+}
+
+TEST(string_intern_replace) {
+        _cleanup_(string_intern_unrefp) const char *p = NULL, *q = NULL;
+
+        ASSERT_EQ(string_intern_replace(&p, "foo"), 1);
+        ASSERT_STREQ(p, "foo");
+        ASSERT_EQ(string_intern_replace(&p, "foo"), 0);
+        ASSERT_EQ(string_intern_replace(&q, "foo"), 1);
+        ASSERT_TRUE(p == q);
+
+        ASSERT_EQ(string_intern_replace(&p, "bar"), 1);
+        ASSERT_STREQ(p, "bar");
+        ASSERT_STREQ(q, "foo");
+
+        ASSERT_EQ(string_intern_replace(&q, NULL), 1);
+        ASSERT_NULL(q);
+        ASSERT_EQ(string_intern_replace(&q, NULL), 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
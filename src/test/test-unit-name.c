@@ -16,6 +16,7 @@
 #include "rm-rf.h"
 #include "special.h"
 #include "specifier.h"
+#include "string-intern.h"
 #include "string-util.h"
 #include "tests.h"
 #include "tmpfile-util.h"
@@ -351,7 +352,7 @@ TEST_RET(unit_printf, .sd_booted = true) {
         assert_se(unit_add_name(u, "blah.service") == 0);
 
         /* We need *a* file that exists, but it doesn't even need to have the right suffix. */
-        assert_se(free_and_strdup(&u->fragment_path, filename) == 1);
+        assert_se(string_intern_replace(&u->fragment_path, filename) == 1);
 
         /* This sets the slice to /app.slice. */
         assert_se(unit_set_default_slice(u) == 1);
@@ -414,7 +415,7 @@ TEST_RET(unit_printf, .sd_booted = true) {
         assert_se(unit_add_name(u, "blah@foo-foo.service") == 0);
         assert_se(unit_add_name(u, "blah@foo-foo.service") == 0);
 
-        assert_se(free_and_strdup(&u->fragment_path, filename) == 1);
+        assert_se(string_intern_replace(&u->fragment_path, filename) == 1);
 
         /* This sets the slice to /app.slice/app-blah.slice. */
         assert_se(unit_set_default_slice(u) == 1);
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "sd-json.h"
+
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "user-record.h"
+
+/* A record using a good part of the fields of the regular section, dispatched against the large user record
+ * dispatch table */
+static const char user_record_json[] =
+        "{"
+        "\"userName\":\"bench\","
+        "\"realName\":\"Benchmark User\","
+        "\"emailAddress\":\"bench@example.com\","
+        "\"iconName\":\"avatar-default\","
+        "\"location\":\"Somewhere\","
+        "\"disposition\":\"regular\","
+        "\"lastChangeUSec\":1700000000000000,"
+        "\"lastPasswordChangeUSec\":1700000000000000,"
+        "\"shell\":\"/bin/bash\","
+        "\"umask\":18,"
+        "\"environment\":[\"FOO=bar\",\"BAZ=qux\"],"
+        "\"preferredLanguage\":\"de_DE.UTF-8\","
+        "\"niceLevel\":5,"
+        "\"locked\":false,"
+        "\"storage\":\"directory\","
+        "\"diskSize\":1073741824,"
+        "\"tasksMax\":1000,"
+        "\"memoryHigh\":1073741824,"
+        "\"memoryMax\":2147483648,"
+        "\"cpuWeight\":100,"
+        "\"ioWeight\":100,"
+        "\"mountNoDevices\":true,"
+        "\"mountNoSuid\":true,"
+        "\"mountNoExecute\":false,"
+        "\"homeDirectory\":\"/home/bench\","
+        "\"uid\":60100,"
+        "\"gid\":60100,"
+        "\"memberOf\":[\"wheel\",\"audio\"],"
+        "\"enforcePasswordPolicy\":true,"
+        "\"autoLogin\":false,"
+        "\"killProcesses\":true,"
+        "\"stopDelayUSec\":0,"
+        "\"passwordChangeMinUSec\":0,"
+        "\"passwordChangeMaxUSec\":7776000000000,"
+        "\"passwordChangeWarnUSec\":604800000000,"
+        "\"rateLimitIntervalUSec\":60000000,"
+        "\"rateLimitBurst\":30,"
+        "\"privileged\":{\"hashedPassword\":[\"!\"]}"
+        "}";
+
+static UserRecord* load_user_record(sd_json_variant *v) {
+        _cleanup_(user_record_unrefp) UserRecord *h = NULL;
+
+        ASSERT_NOT_NULL(h = user_record_new());
+        ASSERT_OK(user_record_load(h, v, USER_RECORD_LOAD_FULL|USER_RECORD_LOG));
+
+        return TAKE_PTR(h);
+}
+
+TEST(user_record_load) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_(user_record_unrefp) UserRecord *h = NULL;
+
+        ASSERT_OK(sd_json_parse(user_record_json, 0, &v, NULL, NULL));
+        h = load_user_record(v);
+
+        ASSERT_STREQ(h->user_name, "bench");
+        ASSERT_STREQ(h->real_name, "Benchmark User");
+        ASSERT_STREQ(h->shell, "/bin/bash");
+        ASSERT_EQ(h->uid, (uid_t) 60100);
+        ASSERT_EQ(h->nice_level, 5);
+        ASSERT_EQ(h->disk_size, UINT64_C(1073741824));
+        ASSERT_TRUE(strv_equal(h->member_of, STRV_MAKE("wheel", "audio")));
+}
+
+TEST(user_record_load_benchmark) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        unsigned n_iterations = slow_tests_enabled() ? 100000 : 10000;
+        usec_t t;
+
+        ASSERT_OK(sd_json_parse(user_record_json, 0, &v, NULL, NULL));
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                user_record_unref(load_user_record(v));
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%.0f user records/s dispatched", (double) n_iterations * USEC_PER_SEC / MAX(t, (usec_t) 1));
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
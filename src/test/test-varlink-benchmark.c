@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+
+#include "sd-event.h"
+#include "sd-json.h"
+#include "sd-varlink.h"
+
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+#define N_CLIENTS 8U
+#define N_BATCH 16U
+
+static unsigned n_calls = 0;
+static bool use_cbor = false;
+
+static int method_sum(sd_varlink *link, sd_json_variant *parameters, sd_varlink_method_flags_t flags, void *userdata) {
+        int64_t a, b;
+
+        a = sd_json_variant_integer(sd_json_variant_by_key(parameters, "a"));
+        b = sd_json_variant_integer(sd_json_variant_by_key(parameters, "b"));
+
+        return sd_varlink_replybo(link, SD_JSON_BUILD_PAIR_INTEGER("sum", a + b));
+}
+
+static void* client_thread(void *arg) {
+        _cleanup_(sd_varlink_flush_close_unrefp) sd_varlink *c = NULL;
+        const char *address = ASSERT_PTR(arg);
+
+        ASSERT_OK(sd_varlink_connect_address(&c, address));
+        if (use_cbor)
+                ASSERT_EQ(sd_varlink_upgrade_cbor(c), 1);
+
+        for (unsigned i = 0; i < n_calls; i++) {
+                sd_json_variant *reply = NULL;
+                const char *error_id = NULL;
+
+                ASSERT_OK(sd_varlink_callbo(
+                                c,
+                                "io.test.Sum",
+                                &reply,
+                                &error_id,
+                                SD_JSON_BUILD_PAIR_UNSIGNED("a", i),
+                                SD_JSON_BUILD_PAIR_UNSIGNED("b", 1)));
+                ASSERT_NULL(error_id);
+                ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(reply, "sum")), (int64_t) i + 1);
+        }
+
+        return NULL;
+}
+
+static void* client_thread_pipelined(void *arg) {
+        _cleanup_(sd_varlink_flush_close_unrefp) sd_varlink *c = NULL;
+        const char *address = ASSERT_PTR(arg);
+
+        ASSERT_OK(sd_varlink_connect_address(&c, address));
+        if (use_cbor)
+                ASSERT_EQ(sd_varlink_upgrade_cbor(c), 1);
+
+        for (unsigned i = 0; i < n_calls; i += N_BATCH) {
+                sd_json_variant *parameters[N_BATCH] = {}, *replies[N_BATCH];
+                const char *error_ids[N_BATCH];
+
+                for (unsigned j = 0; j < N_BATCH; j++)
+                        ASSERT_OK(sd_json_buildo(parameters + j,
+                                                 SD_JSON_BUILD_PAIR_UNSIGNED("a", i + j),
+                                                 SD_JSON_BUILD_PAIR_UNSIGNED("b", 1)));
+
+                ASSERT_OK(sd_varlink_call_many(c, "io.test.Sum", parameters, N_BATCH, replies, error_ids));
+
+                for (unsigned j = 0; j < N_BATCH; j++) {
+                        ASSERT_NULL(error_ids[j]);
+                        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(replies[j], "sum")), (int64_t) (i + j) + 1);
+                        sd_json_variant_unref(parameters[j]);
+                }
+        }
+
+        return NULL;
+}
+
+static void run_benchmark(const char *address, unsigned n_threads, bool pipelined) {
+        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        pthread_t clients[N_CLIENTS];
+        usec_t t;
+
+        ASSERT_OK(sd_event_new(&e));
+
+        ASSERT_OK(sd_varlink_server_new(&s, SD_VARLINK_SERVER_THREAD_SAFE|SD_VARLINK_SERVER_ALLOW_CBOR));
+        ASSERT_OK(sd_varlink_server_bind_method(s, "io.test.Sum", method_sum));
+        ASSERT_OK(sd_varlink_server_listen_address(s, address, 0600));
+        ASSERT_OK(sd_varlink_server_set_threads(s, n_threads));
+        ASSERT_OK(sd_varlink_server_attach_event(s, e, 0));
+
+        /* The shards got their own copy of the configuration, hence it cannot be changed anymore */
+        ASSERT_RETURN_EXPECTED_SE(sd_varlink_server_bind_method(s, "io.test.Other", method_sum) == -EBUSY);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < N_CLIENTS; i++)
+                ASSERT_EQ(pthread_create(clients + i, NULL, pipelined ? client_thread_pipelined : client_thread, (void*) address), 0);
+        for (unsigned i = 0; i < N_CLIENTS; i++)
+                ASSERT_EQ(pthread_join(clients[i], NULL), 0);
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%u server threads, %u clients%s%s: %.0f calls/s",
+                 n_threads, N_CLIENTS, pipelined ? ", pipelined" : "", use_cbor ? ", CBOR" : "",
+                 (double) n_calls * N_CLIENTS * USEC_PER_SEC / MAX(t, (usec_t) 1));
+
+        ASSERT_OK(sd_varlink_server_shutdown(s));
+}
+
+TEST(varlink_benchmark) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        const char *address;
+        unsigned n;
+
+        ASSERT_OK(mkdtemp_malloc("/tmp/varlink-benchmark-XXXXXX", &tmpdir));
+        address = strjoina(tmpdir, "/socket");
+
+        n_calls = slow_tests_enabled() ? 20000 : 1000;
+
+        FOREACH_ARGUMENT(n, 1U, 2U, 4U, 8U)
+                FOREACH_ARGUMENT(use_cbor, false, true) {
+                        run_benchmark(address, n, /* pipelined= */ false);
+                        run_benchmark(address, n, /* pipelined= */ true);
+                }
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
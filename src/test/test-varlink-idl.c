@@ -173,6 +173,8 @@ TEST(parse_format) {
         print_separator();
         test_parse_format_one(&vl_interface_io_systemd);
         print_separator();
+        test_parse_format_one(&vl_interface_io_systemd_cbor);
+        print_separator();
         test_parse_format_one(&vl_interface_io_systemd_PCRExtend);
         print_separator();
         test_parse_format_one(&vl_interface_io_systemd_PCRLock);
@@ -25,6 +25,7 @@
 
 static int n_done = 0;
 static int block_write_fd = -EBADF;
+static const char *json_only_address = NULL;
 
 static int method_something(sd_varlink *link, sd_json_variant *parameters, sd_varlink_method_flags_t flags, void *userdata) {
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *ret = NULL;
@@ -238,7 +239,7 @@ static void flood_test(const char *address) {
 }
 
 static void *thread(void *arg) {
-        _cleanup_(sd_varlink_flush_close_unrefp) sd_varlink *c = NULL;
+        _cleanup_(sd_varlink_flush_close_unrefp) sd_varlink *c = NULL, *json_only = NULL;
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *i = NULL;
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *wrong = NULL;
         sd_json_variant *o = NULL, *k = NULL, *j = NULL;
@@ -276,6 +277,52 @@ static void *thread(void *arg) {
         assert_se(sd_json_variant_integer(sd_json_variant_by_key(o, "sum")) == 88 + 99);
         assert_se(!e);
 
+        /* Unknown encodings are refused, and the connection continues to work as before */
+        ASSERT_OK(sd_varlink_callbo(c, "io.systemd.UpgradeEncoding", &o, &e, SD_JSON_BUILD_PAIR_STRING("encoding", "xml")));
+        ASSERT_STREQ(e, SD_VARLINK_ERROR_INVALID_PARAMETER);
+        ASSERT_OK(sd_varlink_call(c, "io.test.DoSomething", i, &o, &e));
+        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(o, "sum")), 88 + 99);
+
+        /* Everything below is encoded in CBOR */
+        ASSERT_EQ(sd_varlink_upgrade_cbor(c), 1);
+        ASSERT_EQ(sd_varlink_upgrade_cbor(c), 1);
+        ASSERT_OK(sd_varlink_call(c, "io.test.DoSomething", i, &o, &e));
+        ASSERT_NULL(e);
+        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(o, "sum")), 88 + 99);
+        ASSERT_OK(sd_varlink_collect(c, "io.test.DoSomethingMore", i, &j, &error_id));
+        ASSERT_NULL(error_id);
+        ASSERT_EQ(sd_json_variant_elements(j), 6u);
+
+        /* More calls than can be in flight at once, one of them failing */
+        sd_json_variant **many, *replies[100];
+        const char *error_ids[ELEMENTSOF(replies)];
+        size_t n_many = ELEMENTSOF(replies);
+
+        assert_se(many = new0(sd_json_variant*, n_many));
+        CLEANUP_ARRAY(many, n_many, sd_json_variant_unref_many);
+
+        for (size_t n = 0; n < n_many; n++)
+                if (n == 77)
+                        ASSERT_OK(sd_json_buildo(&many[n], SD_JSON_BUILD_PAIR_INTEGER("a", n)));
+                else
+                        ASSERT_OK(sd_json_buildo(&many[n],
+                                                 SD_JSON_BUILD_PAIR_INTEGER("a", n),
+                                                 SD_JSON_BUILD_PAIR_INTEGER("b", 1)));
+
+        ASSERT_OK(sd_varlink_call_many(c, "io.test.DoSomething", many, n_many, replies, error_ids));
+        for (size_t n = 0; n < n_many; n++)
+                if (n == 77)
+                        ASSERT_STREQ(error_ids[n], "io.test.BadParameters");
+                else {
+                        ASSERT_NULL(error_ids[n]);
+                        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(replies[n], "sum")), (int64_t) n + 1);
+                }
+
+        /* Without the error ids the first error is returned, after all replies have been received */
+        ASSERT_ERROR(sd_varlink_call_many(c, "io.test.DoSomething", many, n_many, replies, NULL), EBADR);
+        ASSERT_OK(sd_varlink_call_many(c, "io.test.DoSomething", many, 3, replies, NULL));
+        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(replies[2], "sum")), 3);
+
         int fd1 = acquire_data_fd("foo");
         int fd2 = acquire_data_fd("bar");
         int fd3 = acquire_data_fd("quux");
@@ -303,6 +350,22 @@ static void *thread(void *arg) {
         ASSERT_STREQ(sd_json_variant_string(sd_json_variant_by_key(o, "method")), "io.test.IDontExist");
         ASSERT_STREQ(e, SD_VARLINK_ERROR_METHOD_NOT_FOUND);
 
+        /* Only servers that allow it switch to CBOR, and only those list the method */
+        ASSERT_OK(sd_varlink_callbo(c, "org.varlink.service.GetInterfaceDescription", &o, &e,
+                                    SD_JSON_BUILD_PAIR_STRING("interface", "io.systemd")));
+        ASSERT_NULL(e);
+        ASSERT_NOT_NULL(strstr(sd_json_variant_string(sd_json_variant_by_key(o, "description")), "UpgradeEncoding"));
+
+        ASSERT_OK(sd_varlink_connect_address(&json_only, json_only_address));
+        ASSERT_EQ(sd_varlink_upgrade_cbor(json_only), 0);
+        ASSERT_OK(sd_varlink_callbo(json_only, "org.varlink.service.GetInterfaceDescription", &o, &e,
+                                    SD_JSON_BUILD_PAIR_STRING("interface", "io.systemd")));
+        ASSERT_NULL(e);
+        ASSERT_NULL(strstr(sd_json_variant_string(sd_json_variant_by_key(o, "description")), "UpgradeEncoding"));
+        ASSERT_OK(sd_varlink_call(json_only, "io.test.DoSomething", i, &o, &e));
+        ASSERT_NULL(e);
+        ASSERT_EQ(sd_json_variant_integer(sd_json_variant_by_key(o, "sum")), 88 + 99);
+
         flood_test(arg);
 
         assert_se(sd_varlink_send(c, "io.test.Done", NULL) >= 0);
@@ -327,9 +390,23 @@ static int block_fd_handler(sd_event_source *s, int fd, uint32_t revents, void *
         return 0;
 }
 
+static void test_set_threads(void) {
+        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL;
+
+        ASSERT_OK(sd_varlink_server_new(&s, 0));
+        ASSERT_RETURN_EXPECTED_SE(sd_varlink_server_set_threads(s, 2) == -EOPNOTSUPP);
+        ASSERT_OK(sd_varlink_server_set_threads(s, 0));
+        s = sd_varlink_server_unref(s);
+
+        ASSERT_OK(sd_varlink_server_new(&s, SD_VARLINK_SERVER_THREAD_SAFE));
+        ASSERT_RETURN_EXPECTED_SE(sd_varlink_server_set_threads(s, UINT_MAX) == -ERANGE);
+        ASSERT_OK(sd_varlink_server_set_threads(s, 2));
+        ASSERT_RETURN_EXPECTED_SE(sd_varlink_server_set_exit_on_idle(s, true) == -EOPNOTSUPP);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_source_unrefp) sd_event_source *block_event = NULL;
-        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL;
+        _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *s = NULL, *s_json = NULL;
         _cleanup_(sd_varlink_flush_close_unrefp) sd_varlink *c = NULL;
         _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
         _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
@@ -340,6 +417,8 @@ int main(int argc, char *argv[]) {
 
         test_setup_logging(LOG_DEBUG);
 
+        test_set_threads();
+
         assert_se(mkdtemp_malloc("/tmp/varlink-test-XXXXXX", &tmpdir) >= 0);
         sp = strjoina(tmpdir, "/socket");
 
@@ -350,7 +429,7 @@ int main(int argc, char *argv[]) {
         assert_se(sd_event_source_set_priority(block_event, SD_EVENT_PRIORITY_IMPORTANT) >= 0);
         block_write_fd = TAKE_FD(block_fds[1]);
 
-        assert_se(sd_varlink_server_new(&s, SD_VARLINK_SERVER_ACCOUNT_UID) >= 0);
+        assert_se(sd_varlink_server_new(&s, SD_VARLINK_SERVER_ACCOUNT_UID|SD_VARLINK_SERVER_ALLOW_CBOR) >= 0);
         assert_se(sd_varlink_server_set_description(s, "our-server") >= 0);
 
         assert_se(sd_varlink_server_bind_method(s, "io.test.PassFD", method_passfd) >= 0);
@@ -362,6 +441,13 @@ int main(int argc, char *argv[]) {
         assert_se(sd_varlink_server_attach_event(s, e, 0) >= 0);
         assert_se(sd_varlink_server_set_connections_max(s, OVERLOAD_CONNECTIONS) >= 0);
 
+        /* A second server that sticks to JSON */
+        json_only_address = strjoina(tmpdir, "/socket-json");
+        ASSERT_OK(sd_varlink_server_new(&s_json, 0));
+        ASSERT_OK(sd_varlink_server_bind_method(s_json, "io.test.DoSomething", method_something));
+        ASSERT_OK(sd_varlink_server_listen_address(s_json, json_only_address, 0600));
+        ASSERT_OK(sd_varlink_server_attach_event(s_json, e, 0));
+
         assert_se(sd_json_build(&v, SD_JSON_BUILD_OBJECT(SD_JSON_BUILD_PAIR("a", SD_JSON_BUILD_INTEGER(7)),
                                                    SD_JSON_BUILD_PAIR("b", SD_JSON_BUILD_INTEGER(22)))) >= 0);
 
@@ -91,6 +91,37 @@ systemctl stop systemd-journal-upload
 systemctl stop systemd-journal-remote.{socket,service}
 rm -rf /var/log/journal/remote/*
 
+# Upload compressed and in small batches, and check that the transfer still works
+echo "$TEST_MESSAGE" | systemd-cat -t "$TEST_TAG"
+journalctl --sync
+
+cat >>/run/systemd/journal-upload.conf.d/99-test.conf <<EOF
+Compression=yes
+BatchSize=100
+BatchLatencySec=100ms
+EOF
+mkdir -p /run/systemd/system/systemd-journal-upload.service.d
+cat >/run/systemd/system/systemd-journal-upload.service.d/98-debug.conf <<EOF
+[Service]
+Environment=SYSTEMD_LOG_LEVEL=debug
+EOF
+systemctl daemon-reload
+rm -f /var/lib/systemd/journal-upload/state
+
+systemctl restart systemd-journal-remote.socket
+systemctl restart systemd-journal-upload
+timeout 15 bash -xec 'until systemctl -q is-active systemd-journal-remote.service; do sleep 1; done'
+timeout 30 bash -xec "until journalctl --directory=/var/log/journal/remote --identifier='$TEST_TAG' --grep='$TEST_MESSAGE'; do sleep 1; done"
+# Show the amount of data before and after compression
+journalctl --sync
+journalctl -u systemd-journal-upload --grep="compressed to" --no-pager | tail -n 5
+
+systemctl stop systemd-journal-upload
+systemctl stop systemd-journal-remote.{socket,service}
+rm -rf /var/log/journal/remote/*
+rm /run/systemd/system/systemd-journal-upload.service.d/98-debug.conf
+systemctl daemon-reload
+
 # Now let's do the same, but with a full PKI setup
 #
 # journal-upload keeps the cursor of the last uploaded message, so let's send a fresh one